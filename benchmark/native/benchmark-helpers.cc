@@ -0,0 +1,16 @@
+#include "benchmark-helpers.h"
+#include <new>
+#include <stdlib.h>
+
+size_t allocation_count = 0;
+
+void *operator new(size_t size) {
+  allocation_count++;
+  void *result = malloc(size);
+  if (!result) throw std::bad_alloc();
+  return result;
+}
+
+void operator delete(void *pointer) noexcept {
+  free(pointer);
+}
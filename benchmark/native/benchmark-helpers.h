@@ -0,0 +1,11 @@
+#ifndef SUPERSTRING_BENCHMARK_HELPERS_H
+#define SUPERSTRING_BENCHMARK_HELPERS_H
+
+#include <cstddef>
+
+// The number of times the global operator new has been called. The override
+// that maintains it is defined once, in benchmark-helpers.cc, so that every
+// benchmark can be linked into the same binary.
+extern size_t allocation_count;
+
+#endif // SUPERSTRING_BENCHMARK_HELPERS_H
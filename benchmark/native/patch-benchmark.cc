@@ -0,0 +1,73 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "catch.hpp"
+#include "benchmark-helpers.h"
+#include "patch.h"
+
+using namespace std::chrono;
+using std::u16string;
+using std::vector;
+
+static void type_keystrokes(Patch &patch, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    Point position(rand() % 1000, rand() % 80);
+    if (rand() % 4 == 0) {
+      patch.splice(position, Point(0, 1), Point(), Text{u"x"}, Text{u""});
+    } else {
+      patch.splice(position, Point(), Point(0, 1), Text{u""}, Text{u"x"});
+    }
+  }
+}
+
+static void run_keystrokes(const char *description, uint32_t burst_count, uint32_t burst_size) {
+  srand(0);
+  Patch patch;
+
+  size_t initial_allocation_count = allocation_count;
+  nanoseconds start = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch());
+  for (uint32_t i = 0; i < burst_count; i++) {
+    type_keystrokes(patch, burst_size);
+    Patch inverted_patch = patch.invert();
+    patch.clear();
+  }
+  nanoseconds end = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch());
+
+  uint32_t keystroke_count = burst_count * burst_size;
+  std::cout << description << ": "
+            << (end - start).count() / keystroke_count << "ns, "
+            << static_cast<double>(allocation_count - initial_allocation_count) / keystroke_count
+            << " allocations per keystroke\n";
+}
+
+TEST_CASE("Patch::splice - keystrokes") {
+  run_keystrokes("Short bursts of keystrokes", 10000, 10);
+  run_keystrokes("Long bursts of keystrokes", 100, 1000);
+}
+
+static vector<Patch> type_history(uint32_t patch_count, uint32_t patch_size) {
+  srand(0);
+  vector<Patch> history;
+  for (uint32_t i = 0; i < patch_count; i++) {
+    Patch patch;
+    type_keystrokes(patch, patch_size);
+    history.push_back(std::move(patch));
+  }
+  return history;
+}
+
+static void run_compose_all(const char *description, unsigned thread_count) {
+  vector<Patch> history = type_history(10000, 20);
+  nanoseconds start = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch());
+  auto composition = Patch::compose_all(std::move(history), thread_count);
+  nanoseconds end = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch());
+  REQUIRE(composition);
+  std::cout << description << ": " << (end - start).count() / 1000000 << "ms\n";
+}
+
+TEST_CASE("Patch::compose_all - history") {
+  run_compose_all("Composing 10000 patches on one thread", 1);
+  run_compose_all("Composing 10000 patches on four threads", 4);
+  run_compose_all("Composing 10000 patches on every core", 0);
+}
@@ -0,0 +1,64 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "catch.hpp"
+#include "benchmark-helpers.h"
+#include "point.h"
+#include "range.h"
+#include "text-buffer.h"
+
+using namespace std::chrono;
+using std::u16string;
+using std::vector;
+
+static u16string get_text(uint32_t line_count) {
+  u16string result;
+  for (uint32_t i = 0; i < line_count; i++) {
+    result += u"the quick brown fox jumps over the lazy dog\n";
+  }
+  return result;
+}
+
+static vector<Range> get_edit_ranges(uint32_t line_count, uint32_t count) {
+  vector<Range> result;
+  for (uint32_t i = 0; i < count; i++) {
+    Point start(rand() % line_count, rand() % 40);
+    result.push_back(Range{start, start.traverse(Point(0, rand() % 4))});
+  }
+  return result;
+}
+
+static void run_edits(const char *description, bool use_transaction) {
+  srand(0);
+  uint32_t line_count = 10000;
+  TextBuffer buffer{get_text(line_count)};
+  vector<Range> ranges = get_edit_ranges(line_count, 20000);
+  vector<Range> query_ranges = get_edit_ranges(line_count, 100000);
+
+  size_t initial_allocation_count = allocation_count;
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  if (use_transaction) buffer.begin_transaction();
+  for (const Range &range : ranges) {
+    buffer.set_text_in_range(range, u"xyz");
+  }
+  if (use_transaction) buffer.commit_transaction();
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << description << ": " << (end - start).count() << "ms, "
+            << (allocation_count - initial_allocation_count) << " allocations\n";
+
+  start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  for (const Range &range : query_ranges) {
+    buffer.character_at(range.start);
+  }
+  end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Reading characters afterward: " << (end - start).count() << "ms\n";
+}
+
+TEST_CASE("TextBuffer::set_text_in_range") {
+  run_edits("Editing without a transaction", false);
+}
+
+TEST_CASE("TextBuffer::commit_transaction") {
+  run_edits("Editing within a transaction", true);
+}
@@ -30,11 +30,13 @@
             ],
             "sources": [
                 "src/core/encoding-conversion.cc",
+                "src/core/line-offsets.cc",
                 "src/core/marker-index.cc",
                 "src/core/patch.cc",
                 "src/core/point.cc",
                 "src/core/range.cc",
                 "src/core/regex.cc",
+                "src/core/sparse-text-buffer.cc",
                 "src/core/text.cc",
                 "src/core/text-buffer.cc",
                 "src/core/text-slice.cc",
@@ -86,6 +88,7 @@
                     "test/native/tests.cc",
                     "test/native/encoding-conversion-test.cc",
                     "test/native/patch-test.cc",
+                    "test/native/sparse-text-buffer-test.cc",
                     "test/native/text-buffer-test.cc",
                     "test/native/text-test.cc",
                     "test/native/text-diff-test.cc",
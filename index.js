@@ -4,7 +4,7 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
   binding = require('./browser');
 
   const {TextBuffer, Patch} = binding
-  const {findSync, findAllSync, findAndMarkAllSync, findWordsWithSubsequenceInRange, getCharacterAtPosition} = TextBuffer.prototype
+  const {findSync, findAllSync, findAndMarkAllSync, findWordsWithSubsequenceInRange, getCharacterAtPosition, setTextInRanges} = TextBuffer.prototype
   const DEFAULT_RANGE = Object.freeze({start: {row: 0, column: 0}, end: {row: Infinity, column: Infinity}})
 
   TextBuffer.prototype.findInRangeSync = function (pattern, range) {
@@ -82,6 +82,15 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     return new Promise(resolve => resolve(this.findAllInRangeSync(pattern, range)))
   }
 
+  TextBuffer.prototype.setTextInRanges = function (ranges, texts) {
+    const result = setTextInRanges.call(this, ranges, texts)
+    if (typeof result === 'string') {
+      throw new Error(result)
+    } else {
+      return result
+    }
+  }
+
   TextBuffer.prototype.findWordsWithSubsequence = function (query, extraWordCharacters, maxCount) {
     const range = {start: {row: 0, column: 0}, end: this.getExtent()}
     return Promise.resolve(
@@ -124,10 +133,11 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     }
   }
 
-  const {TextBuffer, TextWriter, TextReader} = binding
+  const {TextBuffer, SparseTextBuffer, TextWriter, TextReader} = binding
   const {
-    load, save, baseTextMatchesFile,
-    find, findAll, findSync, findAllSync, findWordsWithSubsequenceInRange
+    load, loadProgressively, save, baseTextMatchesFile,
+    find, findAll, findSync, findAllSync, findWordsWithSubsequenceInRange,
+    setTextInRanges
   } = TextBuffer.prototype
 
   TextBuffer.prototype.load = function (source, options, progressCallback) {
@@ -176,6 +186,29 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     })
   }
 
+  TextBuffer.prototype.loadProgressively = function (filePath, options, progressCallback) {
+    if (typeof options !== 'object') {
+      progressCallback = options
+      options = {}
+    }
+
+    const discardChanges = options.force === true ? true : false
+    const encoding = normalizeEncoding(options.encoding || 'UTF-8')
+    const initialRowCount = options.initialRowCount == null ? 100 : options.initialRowCount
+
+    return new Promise((resolve, reject) => {
+      loadProgressively.call(
+        this,
+        (error, result) => error ? reject(error) : resolve(result),
+        progressCallback,
+        discardChanges,
+        filePath,
+        encoding,
+        initialRowCount
+      )
+    })
+  }
+
   TextBuffer.prototype.save = function (destination, encoding = 'UTF8') {
     const CHUNK_SIZE = 10 * 1024
 
@@ -256,6 +289,30 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     return interpretRangeArray(findAllSync.call(this, pattern, range))
   }
 
+  TextBuffer.prototype.setTextInRanges = function (ranges, texts) {
+    return interpretRangeArray(setTextInRanges.call(this, ranges, texts))
+  }
+
+  const sparseFindSync = SparseTextBuffer.prototype.findSync
+  const sparseFindAllSync = SparseTextBuffer.prototype.findAllSync
+
+  SparseTextBuffer.prototype.findSync = function (pattern) {
+    return this.findInRangeSync(pattern, null)
+  }
+
+  SparseTextBuffer.prototype.findInRangeSync = function (pattern, range) {
+    const result = sparseFindSync.call(this, pattern, range)
+    return result.length > 0 ? interpretRange(result) : null
+  }
+
+  SparseTextBuffer.prototype.findAllSync = function (pattern) {
+    return interpretRangeArray(sparseFindAllSync.call(this, pattern, null))
+  }
+
+  SparseTextBuffer.prototype.findAllInRangeSync = function (pattern, range) {
+    return interpretRangeArray(sparseFindAllSync.call(this, pattern, range))
+  }
+
   TextBuffer.prototype.findWordsWithSubsequence = function (query, extraWordCharacters, maxCount) {
     return this.findWordsWithSubsequenceInRange(query, extraWordCharacters, maxCount, {
       start: {row: 0, column: 0},
@@ -350,6 +407,7 @@ function normalizeEncoding(encoding) {
 
 module.exports = {
   TextBuffer: binding.TextBuffer,
+  SparseTextBuffer: binding.SparseTextBuffer,
   Patch: binding.Patch,
   MarkerIndex: binding.MarkerIndex,
 }
@@ -16,6 +16,7 @@ void Init(Local<Object> exports) {
   PatchWrapper::init(exports);
   MarkerIndexWrapper::init(exports);
   TextBufferWrapper::init(exports);
+  SparseTextBufferWrapper::init(exports);
   TextWriter::init(exports);
   TextReader::init(exports);
   TextBufferSnapshotWrapper::init();
@@ -24,7 +24,9 @@ EMSCRIPTEN_BINDINGS(MarkerIndex) {
     .function("findEndingIn", WRAP(&MarkerIndex::find_ending_in))
     .function("findEndingAt", WRAP(&MarkerIndex::find_ending_at))
     .function("findBoundariesAfter", WRAP(&MarkerIndex::find_boundaries_after))
-    .function("dump", WRAP(&MarkerIndex::dump));
+    .function("dump", WRAP(&MarkerIndex::dump))
+    .function("getMemoryUsage", WRAP(&MarkerIndex::get_memory_usage))
+    .function("trimMemory", WRAP(&MarkerIndex::trim_memory));
 
   emscripten::value_object<MarkerIndex::SpliceResult>("SpliceResult")
     .field("touch", WRAP_FIELD(MarkerIndex::SpliceResult, touch))
@@ -40,4 +42,10 @@ EMSCRIPTEN_BINDINGS(MarkerIndex) {
     .field("position", &MarkerIndex::Boundary::position)
     .field("starting", &MarkerIndex::Boundary::starting)
     .field("ending", &MarkerIndex::Boundary::ending);
+
+  emscripten::value_object<MarkerIndex::MemoryUsage>("MarkerIndexMemoryUsage")
+    .field("nodeCount", &MarkerIndex::MemoryUsage::node_count)
+    .field("nodeBytes", &MarkerIndex::MemoryUsage::node_bytes)
+    .field("markerIdSetBytes", &MarkerIndex::MemoryUsage::marker_id_set_bytes)
+    .field("hashTableBytes", &MarkerIndex::MemoryUsage::hash_table_bytes);
 }
@@ -27,10 +27,14 @@ inline Patch const *emscripten::val::as<Patch const *>(void) const {
 
 Patch *constructor(emscripten::val value) {
   bool merge_adjacent_changes = false;
+  bool store_text = true;
   if (value.as<bool>() && value["mergeAdjacentChanges"].as<bool>()) {
     merge_adjacent_changes = true;
   }
-  return new Patch(merge_adjacent_changes);
+  if (value.as<bool>() && !value["storeText"].isUndefined()) {
+    store_text = value["storeText"].as<bool>();
+  }
+  return new Patch(merge_adjacent_changes, store_text);
 }
 
 vector<uint8_t> serialize(Patch &patch) {
@@ -41,16 +45,9 @@ vector<uint8_t> serialize(Patch &patch) {
 }
 
 Patch *compose(vector<Patch const *> const &patches) {
-  auto result = new Patch();
-  bool left_to_right = true;
-  for (const Patch *patch : patches) {
-    if (!result->combine(*patch, left_to_right)) {
-      delete result;
-      return nullptr;
-    }
-    left_to_right = !left_to_right;
-  }
-  return result;
+  auto result = Patch::compose_all(patches);
+  if (!result) return nullptr;
+  return new Patch{std::move(*result)};
 }
 
 Patch *deserialize(const vector<uint8_t> &bytes) {
@@ -77,6 +74,63 @@ bool splice_with_text(Patch &patch, Point start, Point deleted_extent, Point ins
   );
 }
 
+Patch *transform_with_tie_break(Patch &patch, Patch const &other, emscripten::val js_tie_break) {
+  Patch::TieBreak tie_break = Patch::InsertBeforeOther;
+  if (js_tie_break.isString() && js_tie_break.as<string>() == "after") {
+    tie_break = Patch::InsertAfterOther;
+  }
+  return new Patch{patch.transform(other, tie_break)};
+}
+
+Patch *transform(Patch &patch, Patch const &other) {
+  return new Patch{patch.transform(other)};
+}
+
+// Positions are passed and returned as a Uint32Array of alternating rows and
+// columns, as in the Node bindings.
+emscripten::val translate_positions(Patch &patch, emscripten::val js_positions,
+                                    Patch::TranslationDirection direction,
+                                    emscripten::val js_clip_direction) {
+  Patch::ClipDirection clip_direction = Patch::ClipBackward;
+  if (js_clip_direction.isString() && js_clip_direction.as<string>() == "forward") {
+    clip_direction = Patch::ClipForward;
+  }
+
+  unsigned length = js_positions["length"].as<unsigned>();
+  vector<Point> positions;
+  positions.reserve(length / 2);
+  for (unsigned i = 0; i + 1 < length; i += 2) {
+    positions.push_back(Point(js_positions[i].as<unsigned>(), js_positions[i + 1].as<unsigned>()));
+  }
+
+  patch.translate_positions(positions.data(), positions.size(), direction, clip_direction);
+
+  auto result = emscripten::val::global("Uint32Array").new_(positions.size() * 2);
+  for (unsigned i = 0; i < positions.size(); i++) {
+    result.set(2 * i, positions[i].row);
+    result.set(2 * i + 1, positions[i].column);
+  }
+  return result;
+}
+
+emscripten::val translate_old_positions_with_clip_direction(Patch &patch, emscripten::val js_positions,
+                                                            emscripten::val js_clip_direction) {
+  return translate_positions(patch, js_positions, Patch::OldToNew, js_clip_direction);
+}
+
+emscripten::val translate_old_positions(Patch &patch, emscripten::val js_positions) {
+  return translate_positions(patch, js_positions, Patch::OldToNew, emscripten::val::undefined());
+}
+
+emscripten::val translate_new_positions_with_clip_direction(Patch &patch, emscripten::val js_positions,
+                                                            emscripten::val js_clip_direction) {
+  return translate_positions(patch, js_positions, Patch::NewToOld, js_clip_direction);
+}
+
+emscripten::val translate_new_positions(Patch &patch, emscripten::val js_positions) {
+  return translate_positions(patch, js_positions, Patch::NewToOld, emscripten::val::undefined());
+}
+
 template <typename T>
 void change_set_noop(Patch::Change &change, T const &) {}
 
@@ -89,10 +143,17 @@ EMSCRIPTEN_BINDINGS(Patch) {
     .function("spliceOld", WRAP(&Patch::splice_old))
     .function("copy", WRAP(&Patch::copy))
     .function("invert", WRAP(&Patch::invert))
+    .function("transform", transform, emscripten::allow_raw_pointers())
+    .function("transform", transform_with_tie_break, emscripten::allow_raw_pointers())
+    .function("translateOldPositions", translate_old_positions)
+    .function("translateOldPositions", translate_old_positions_with_clip_direction)
+    .function("translateNewPositions", translate_new_positions)
+    .function("translateNewPositions", translate_new_positions_with_clip_direction)
     .function("getChanges", WRAP(&Patch::get_changes))
     .function("getChangesInNewRange", WRAP(&Patch::grab_changes_in_new_range))
     .function("getChangesInOldRange", WRAP(&Patch::grab_changes_in_old_range))
     .function("getChangeCount", WRAP(&Patch::get_change_count))
+    .function("getMemoryUsage", WRAP(&Patch::get_memory_usage))
     .function("changeForOldPosition", WRAP(&Patch::grab_change_starting_before_old_position))
     .function("changeForNewPosition", WRAP(&Patch::grab_change_starting_before_new_position))
     .function("getBounds", WRAP(&Patch::get_bounds))
@@ -108,4 +169,10 @@ EMSCRIPTEN_BINDINGS(Patch) {
     .field("newEnd", WRAP_FIELD(Patch::Change, new_end))
     .field("oldText", WRAP_FIELD(Patch::Change, old_text))
     .field("newText", WRAP_FIELD(Patch::Change, new_text));
+
+  emscripten::value_object<Patch::MemoryUsage>("PatchMemoryUsage")
+    .field("nodeCount", &Patch::MemoryUsage::node_count)
+    .field("nodeBytes", &Patch::MemoryUsage::node_bytes)
+    .field("textBytes", &Patch::MemoryUsage::text_bytes)
+    .field("stackBytes", &Patch::MemoryUsage::stack_bytes);
 }
@@ -37,6 +37,21 @@ static emscripten::val find_all_sync(TextBuffer &buffer, std::wstring js_pattern
   return em_transmit(buffer.find_all(regex, range));
 }
 
+static emscripten::val set_text_in_ranges(TextBuffer &buffer, emscripten::val js_ranges, emscripten::val js_texts) {
+  std::vector<std::pair<Range, u16string>> changes;
+  for (unsigned i = 0, n = js_ranges["length"].as<unsigned>(); i < n; i++) {
+    auto text = js_texts[i].as<std::wstring>();
+    changes.push_back({js_ranges[i].as<Range>(), u16string(text.begin(), text.end())});
+  }
+
+  auto result = buffer.set_text_in_ranges(std::move(changes));
+  if (!result) {
+    return emscripten::val("Ranges must be sorted and must not overlap");
+  }
+
+  return em_transmit(*result);
+}
+
 static emscripten::val find_and_mark_all_sync(TextBuffer &buffer, MarkerIndex &index, unsigned next_id,
                                               bool exclusive, std::wstring js_pattern, bool ignore_case, bool unicode,
                                               Range range) {
@@ -76,6 +91,10 @@ static Point position_for_character_index(TextBuffer &buffer, long index) {
     buffer.position_for_offset(static_cast<uint32_t>(index));
 }
 
+static void trim_memory(TextBuffer &buffer, uint32_t level) {
+  buffer.trim_memory(level > 0 ? TextBuffer::TrimCaches : TextBuffer::TrimContainers);
+}
+
 EMSCRIPTEN_BINDINGS(TextBuffer) {
   emscripten::class_<TextBuffer>("TextBuffer")
     .constructor<>()
@@ -85,17 +104,27 @@ EMSCRIPTEN_BINDINGS(TextBuffer) {
     .function("getCharacterAtPosition", WRAP(&TextBuffer::character_at))
     .function("getTextInRange", WRAP(&TextBuffer::text_in_range))
     .function("setTextInRange", WRAP_OVERLOAD(&TextBuffer::set_text_in_range, void (TextBuffer::*)(Range, u16string &&)))
+    .function("setTextInRanges", set_text_in_ranges)
+    .function("beginTransaction", &TextBuffer::begin_transaction)
+    .function("commitTransaction", &TextBuffer::commit_transaction)
     .function("getLength", &TextBuffer::size)
     .function("getExtent", &TextBuffer::extent)
     .function("getLineCount", get_line_count)
     .function("hasAstral", &TextBuffer::has_astral)
+    .function("getStatistics", &TextBuffer::statistics)
+    .function("getMemoryUsage", &TextBuffer::get_memory_usage)
+    .function("trimMemory", trim_memory)
     .function("reset", WRAP(&TextBuffer::reset))
     .function("lineLengthForRow", WRAP(&TextBuffer::line_length_for_row))
     .function("lineEndingForRow", line_ending_for_row)
+    .function("getLineEndingCounts", &TextBuffer::line_ending_counts)
+    .function("hasMixedLineEndings", &TextBuffer::has_mixed_line_endings)
+    .function("normalizeLineEndings", WRAP(&TextBuffer::normalize_line_endings))
     .function("lineForRow", WRAP(&TextBuffer::line_for_row))
     .function("characterIndexForPosition", character_index_for_position)
     .function("positionForCharacterIndex", position_for_character_index)
     .function("isModified", WRAP_OVERLOAD(&TextBuffer::is_modified, bool (TextBuffer::*)() const))
+    .function("internBaseText", &TextBuffer::intern_base_text)
     .function("findSync", find_sync)
     .function("findAllSync", find_all_sync)
     .function("findAndMarkAllSync", find_and_mark_all_sync)
@@ -106,4 +135,25 @@ EMSCRIPTEN_BINDINGS(TextBuffer) {
     .field("positions", WRAP_FIELD(TextBuffer::SubsequenceMatch, positions))
     .field("matchIndices", WRAP_FIELD(TextBuffer::SubsequenceMatch, match_indices))
     .field("score", WRAP_FIELD(TextBuffer::SubsequenceMatch, score));
+
+  emscripten::value_object<TextBuffer::MemoryUsage>("TextBufferMemoryUsage")
+    .field("baseTextBytes", &TextBuffer::MemoryUsage::base_text_bytes)
+    .field("snapshotTextBytes", &TextBuffer::MemoryUsage::snapshot_text_bytes)
+    .field("patchNodeBytes", &TextBuffer::MemoryUsage::patch_node_bytes)
+    .field("patchTextBytes", &TextBuffer::MemoryUsage::patch_text_bytes)
+    .field("indexBytes", &TextBuffer::MemoryUsage::index_bytes)
+    .field("layerCount", &TextBuffer::MemoryUsage::layer_count)
+    .field("snapshotLayerCount", &TextBuffer::MemoryUsage::snapshot_layer_count);
+
+  emscripten::value_object<TextBuffer::LineEndingCounts>("LineEndingCounts")
+    .field("lfCount", &TextBuffer::LineEndingCounts::lf_count)
+    .field("crlfCount", &TextBuffer::LineEndingCounts::crlf_count);
+
+  emscripten::value_object<TextBuffer::Statistics>("Statistics")
+    .field("lfCount", &TextBuffer::Statistics::lf_count)
+    .field("crlfCount", &TextBuffer::Statistics::crlf_count)
+    .field("crCount", &TextBuffer::Statistics::cr_count)
+    .field("nulCount", &TextBuffer::Statistics::nul_count)
+    .field("surrogateCount", &TextBuffer::Statistics::surrogate_count)
+    .field("longestLineLength", &TextBuffer::Statistics::longest_line_length);
 }
@@ -56,6 +56,8 @@ void MarkerIndexWrapper::init(Local<Object> exports) {
   Nan::SetTemplate(prototype_template, Nan::New<String>("findEndingAt").ToLocalChecked(), Nan::New<FunctionTemplate>(find_ending_at), None);
   Nan::SetTemplate(prototype_template, Nan::New<String>("findBoundariesAfter").ToLocalChecked(), Nan::New<FunctionTemplate>(find_boundaries_after), None);
   Nan::SetTemplate(prototype_template, Nan::New<String>("dump").ToLocalChecked(), Nan::New<FunctionTemplate>(dump), None);
+  Nan::SetTemplate(prototype_template, Nan::New<String>("getMemoryUsage").ToLocalChecked(), Nan::New<FunctionTemplate>(get_memory_usage), None);
+  Nan::SetTemplate(prototype_template, Nan::New<String>("trimMemory").ToLocalChecked(), Nan::New<FunctionTemplate>(trim_memory), None);
 
   start_string.Reset(Nan::Persistent<String>(Nan::New("start").ToLocalChecked()));
   end_string.Reset(Nan::Persistent<String>(Nan::New("end").ToLocalChecked()));
@@ -381,4 +383,20 @@ void MarkerIndexWrapper::dump(const Nan::FunctionCallbackInfo<Value> &info) {
   info.GetReturnValue().Set(snapshot_to_js(snapshot));
 }
 
+void MarkerIndexWrapper::get_memory_usage(const Nan::FunctionCallbackInfo<Value> &info) {
+  MarkerIndexWrapper *wrapper = Nan::ObjectWrap::Unwrap<MarkerIndexWrapper>(info.This());
+  auto memory_usage = wrapper->marker_index.get_memory_usage();
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("nodeCount").ToLocalChecked(), Nan::New<Number>(memory_usage.node_count));
+  Nan::Set(result, Nan::New("nodeBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.node_bytes));
+  Nan::Set(result, Nan::New("markerIdSetBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.marker_id_set_bytes));
+  Nan::Set(result, Nan::New("hashTableBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.hash_table_bytes));
+  info.GetReturnValue().Set(result);
+}
+
+void MarkerIndexWrapper::trim_memory(const Nan::FunctionCallbackInfo<Value> &info) {
+  MarkerIndexWrapper *wrapper = Nan::ObjectWrap::Unwrap<MarkerIndexWrapper>(info.This());
+  wrapper->marker_index.trim_memory();
+}
+
 MarkerIndexWrapper::MarkerIndexWrapper(unsigned seed) : marker_index{seed} {}
@@ -2,6 +2,7 @@
 #include "patch-wrapper.h"
 #include <memory>
 #include <sstream>
+#include <string>
 #include <vector>
 #include "point-wrapper.h"
 #include "string-conversion.h"
@@ -123,6 +124,7 @@ void PatchWrapper::init(Local<Object> exports) {
   Nan::SetTemplate(prototype_template, Nan::New("spliceOld").ToLocalChecked(), Nan::New<FunctionTemplate>(splice_old), None);
   Nan::SetTemplate(prototype_template, Nan::New("copy").ToLocalChecked(), Nan::New<FunctionTemplate>(copy), None);
   Nan::SetTemplate(prototype_template, Nan::New("invert").ToLocalChecked(), Nan::New<FunctionTemplate>(invert), None);
+  Nan::SetTemplate(prototype_template, Nan::New("transform").ToLocalChecked(), Nan::New<FunctionTemplate>(transform), None);
   Nan::SetTemplate(prototype_template, Nan::New("getChanges").ToLocalChecked(), Nan::New<FunctionTemplate>(get_changes), None);
   Nan::SetTemplate(prototype_template, Nan::New("getChangesInOldRange").ToLocalChecked(),
                           Nan::New<FunctionTemplate>(get_changes_in_old_range), None);
@@ -132,11 +134,16 @@ void PatchWrapper::init(Local<Object> exports) {
                           Nan::New<FunctionTemplate>(change_for_old_position), None);
   Nan::SetTemplate(prototype_template, Nan::New("changeForNewPosition").ToLocalChecked(),
                           Nan::New<FunctionTemplate>(change_for_new_position), None);
+  Nan::SetTemplate(prototype_template, Nan::New("translateOldPositions").ToLocalChecked(),
+                          Nan::New<FunctionTemplate>(translate_old_positions), None);
+  Nan::SetTemplate(prototype_template, Nan::New("translateNewPositions").ToLocalChecked(),
+                          Nan::New<FunctionTemplate>(translate_new_positions), None);
   Nan::SetTemplate(prototype_template, Nan::New("serialize").ToLocalChecked(), Nan::New<FunctionTemplate>(serialize), None);
   Nan::SetTemplate(prototype_template, Nan::New("getDotGraph").ToLocalChecked(), Nan::New<FunctionTemplate>(get_dot_graph), None);
   Nan::SetTemplate(prototype_template, Nan::New("getJSON").ToLocalChecked(), Nan::New<FunctionTemplate>(get_json), None);
   Nan::SetTemplate(prototype_template, Nan::New("rebalance").ToLocalChecked(), Nan::New<FunctionTemplate>(rebalance), None);
   Nan::SetTemplate(prototype_template, Nan::New("getChangeCount").ToLocalChecked(), Nan::New<FunctionTemplate>(get_change_count), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getMemoryUsage").ToLocalChecked(), Nan::New<FunctionTemplate>(get_memory_usage), None);
   Nan::SetTemplate(prototype_template, Nan::New("getBounds").ToLocalChecked(), Nan::New<FunctionTemplate>(get_bounds), None);
   patch_wrapper_constructor_template.Reset(constructor_template_local);
   patch_wrapper_constructor.Reset(Nan::GetFunction(constructor_template_local).ToLocalChecked());
@@ -157,6 +164,7 @@ Local<Value> PatchWrapper::from_patch(Patch &&patch) {
 
 void PatchWrapper::construct(const Nan::FunctionCallbackInfo<Value> &info) {
   bool merges_adjacent_changes = true;
+  bool stores_text = true;
   Local<Object> options;
 
   if (info.Length() > 0 && Nan::To<Object>(info[0]).ToLocal(&options)) {
@@ -164,8 +172,13 @@ void PatchWrapper::construct(const Nan::FunctionCallbackInfo<Value> &info) {
     if (Nan::Get(options, Nan::New("mergeAdjacentChanges").ToLocalChecked()).ToLocal(&js_merge_adjacent_changes)) {
       merges_adjacent_changes = Nan::To<bool>(js_merge_adjacent_changes).FromMaybe(false);
     }
+    Local<Value> js_store_text;
+    if (Nan::Get(options, Nan::New("storeText").ToLocalChecked()).ToLocal(&js_store_text) &&
+        !js_store_text->IsUndefined()) {
+      stores_text = Nan::To<bool>(js_store_text).FromMaybe(true);
+    }
   }
-  PatchWrapper *patch = new PatchWrapper(Patch{merges_adjacent_changes});
+  PatchWrapper *patch = new PatchWrapper(Patch{merges_adjacent_changes, stores_text});
   patch->Wrap(info.This());
 }
 
@@ -236,14 +249,43 @@ void PatchWrapper::invert(const Nan::FunctionCallbackInfo<Value> &info) {
   }
 }
 
+void PatchWrapper::transform(const Nan::FunctionCallbackInfo<Value> &info) {
+  if (!info[0]->IsObject() || !Nan::New(patch_wrapper_constructor_template)->HasInstance(info[0])) {
+    Nan::ThrowTypeError("Patch.transform must be called with a patch");
+    return;
+  }
+
+  Patch::TieBreak tie_break = Patch::InsertBeforeOther;
+  if (info[1]->IsString()) {
+    std::string tie_break_name = *Nan::Utf8String(info[1]);
+    if (tie_break_name == "after") {
+      tie_break = Patch::InsertAfterOther;
+    } else if (tie_break_name != "before") {
+      Nan::ThrowError("Expected the tie break to be 'before' or 'after'");
+      return;
+    }
+  }
+
+  Local<Object> result;
+  if (Nan::NewInstance(Nan::New(patch_wrapper_constructor)).ToLocal(&result)) {
+    Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+    Patch &other_patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info[0].As<Object>())->patch;
+    auto wrapper = new PatchWrapper{patch.transform(other_patch, tie_break)};
+    wrapper->Wrap(result);
+    info.GetReturnValue().Set(result);
+  }
+}
+
 void PatchWrapper::get_changes(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
 
   Local<Array> js_result = Nan::New<Array>();
 
   size_t i = 0;
-  for (auto change : patch.get_changes()) {
-    Nan::Set(js_result, i++, ChangeWrapper::FromChange(change));
+  Patch::ChangeIterator changes;
+  patch.iterate_changes(changes);
+  while (auto change = changes.next()) {
+    Nan::Set(js_result, i++, ChangeWrapper::FromChange(*change));
   }
 
   info.GetReturnValue().Set(js_result);
@@ -259,8 +301,10 @@ void PatchWrapper::get_changes_in_old_range(const Nan::FunctionCallbackInfo<Valu
     Local<Array> js_result = Nan::New<Array>();
 
     size_t i = 0;
-    for (auto change : patch.grab_changes_in_old_range(*start, *end)) {
-      Nan::Set(js_result, i++, ChangeWrapper::FromChange(change));
+    Patch::ChangeIterator changes;
+    patch.grab_changes_in_old_range(changes, *start, *end);
+    while (auto change = changes.next()) {
+      Nan::Set(js_result, i++, ChangeWrapper::FromChange(*change));
     }
 
     info.GetReturnValue().Set(js_result);
@@ -277,8 +321,10 @@ void PatchWrapper::get_changes_in_new_range(const Nan::FunctionCallbackInfo<Valu
     Local<Array> js_result = Nan::New<Array>();
 
     size_t i = 0;
-    for (auto change : patch.grab_changes_in_new_range(*start, *end)) {
-      Nan::Set(js_result, i++, ChangeWrapper::FromChange(change));
+    Patch::ChangeIterator changes;
+    patch.grab_changes_in_new_range(changes, *start, *end);
+    while (auto change = changes.next()) {
+      Nan::Set(js_result, i++, ChangeWrapper::FromChange(*change));
     }
 
     info.GetReturnValue().Set(js_result);
@@ -311,6 +357,50 @@ void PatchWrapper::change_for_new_position(const Nan::FunctionCallbackInfo<Value
   }
 }
 
+// Positions are passed and returned as a Uint32Array of alternating rows and
+// columns, so that many of them can be translated in one call.
+static void translate_positions(const Nan::FunctionCallbackInfo<Value> &info, const Patch &patch,
+                                Patch::TranslationDirection direction) {
+  if (!info[0]->IsUint32Array()) {
+    Nan::ThrowTypeError("Expected a Uint32Array of rows and columns");
+    return;
+  }
+
+  Nan::TypedArrayContents<uint32_t> positions(info[0]);
+  if (positions.length() % 2 != 0) {
+    Nan::ThrowError("Expected a row and a column for every position");
+    return;
+  }
+
+  Patch::ClipDirection clip_direction = Patch::ClipBackward;
+  if (info[1]->IsString()) {
+    std::string clip_direction_name = *Nan::Utf8String(info[1]);
+    if (clip_direction_name == "forward") {
+      clip_direction = Patch::ClipForward;
+    } else if (clip_direction_name != "backward") {
+      Nan::ThrowError("Expected the clip direction to be 'backward' or 'forward'");
+      return;
+    }
+  }
+
+  size_t length = positions.length();
+  auto buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), length * sizeof(uint32_t));
+  auto data = buffer->GetContents().Data();
+  if (length > 0) memcpy(data, *positions, length * sizeof(uint32_t));
+  patch.translate_positions(reinterpret_cast<Point *>(data), length / 2, direction, clip_direction);
+  info.GetReturnValue().Set(v8::Uint32Array::New(buffer, 0, length));
+}
+
+void PatchWrapper::translate_old_positions(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  translate_positions(info, patch, Patch::OldToNew);
+}
+
+void PatchWrapper::translate_new_positions(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  translate_positions(info, patch, Patch::NewToOld);
+}
+
 void PatchWrapper::serialize(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
 
@@ -330,11 +420,10 @@ void PatchWrapper::deserialize(const Nan::FunctionCallbackInfo<Value> &info) {
   Local<Object> result;
   if (Nan::NewInstance(Nan::New(patch_wrapper_constructor)).ToLocal(&result)) {
     if (info[0]->IsUint8Array()) {
-      auto *data = node::Buffer::Data(info[0]);
-
-      static vector<uint8_t> input;
-      input.assign(data, data + node::Buffer::Length(info[0]));
-      Deserializer deserializer(input);
+      Deserializer deserializer(
+        reinterpret_cast<const uint8_t *>(node::Buffer::Data(info[0])),
+        node::Buffer::Length(info[0])
+      );
       PatchWrapper *wrapper = new PatchWrapper(Patch{deserializer});
       wrapper->Wrap(result);
       info.GetReturnValue().Set(result);
@@ -351,8 +440,7 @@ void PatchWrapper::compose(const Nan::FunctionCallbackInfo<Value> &info) {
       return;
     }
 
-    Patch combination;
-    bool left_to_right = true;
+    std::vector<const Patch *> patches;
     for (uint32_t i = 0, n = js_patches->Length(); i < n; i++) {
       if (!Nan::Get(js_patches, i).ToLocalChecked()->IsObject()) {
         Nan::ThrowTypeError("Patch.compose must be called with an array of patches");
@@ -365,15 +453,16 @@ void PatchWrapper::compose(const Nan::FunctionCallbackInfo<Value> &info) {
         return;
       }
 
-      Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(js_patch)->patch;
-      if (!combination.combine(patch, left_to_right)) {
-        Nan::ThrowTypeError(InvalidSpliceMessage);
-        return;
-      }
-      left_to_right = !left_to_right;
+      patches.push_back(&Nan::ObjectWrap::Unwrap<PatchWrapper>(js_patch)->patch);
+    }
+
+    auto combination = Patch::compose_all(patches);
+    if (!combination) {
+      Nan::ThrowTypeError(InvalidSpliceMessage);
+      return;
     }
 
-    (new PatchWrapper{move(combination)})->Wrap(result);
+    (new PatchWrapper{move(*combination)})->Wrap(result);
     info.GetReturnValue().Set(result);
   }
 }
@@ -396,6 +485,17 @@ void PatchWrapper::get_change_count(const Nan::FunctionCallbackInfo<Value> &info
   info.GetReturnValue().Set(Nan::New<Number>(change_count));
 }
 
+void PatchWrapper::get_memory_usage(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  auto memory_usage = patch.get_memory_usage();
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("nodeCount").ToLocalChecked(), Nan::New<Number>(memory_usage.node_count));
+  Nan::Set(result, Nan::New("nodeBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.node_bytes));
+  Nan::Set(result, Nan::New("textBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.text_bytes));
+  Nan::Set(result, Nan::New("stackBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.stack_bytes));
+  info.GetReturnValue().Set(result);
+}
+
 void PatchWrapper::get_bounds(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
   auto bounds = patch.get_bounds();
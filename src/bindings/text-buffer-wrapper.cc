@@ -1,6 +1,9 @@
 #include "text-buffer-wrapper.h"
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <stdio.h>
 #include "number-conversion.h"
 #include "point-wrapper.h"
@@ -14,6 +17,9 @@
 #include "text-diff.h"
 #include "noop.h"
 #include <sys/stat.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
 
 using namespace v8;
 using std::move;
@@ -49,6 +55,15 @@ static size_t get_file_size(FILE *file) {
   return static_cast<size_t>(result.QuadPart);
 }
 
+static uint64_t get_file_modification_time(FILE *file) {
+  FILETIME write_time;
+  if (!GetFileTime((HANDLE)_get_osfhandle(fileno(file)), NULL, NULL, &write_time)) return 0;
+  ULARGE_INTEGER result;
+  result.LowPart = write_time.dwLowDateTime;
+  result.HighPart = write_time.dwHighDateTime;
+  return result.QuadPart;
+}
+
 static FILE *open_file(const string &name, const char *flags) {
   wchar_t wide_flags[6] = {0, 0, 0, 0, 0, 0};
   size_t flag_count = strlen(flags);
@@ -56,6 +71,32 @@ static FILE *open_file(const string &name, const char *flags) {
   return _wfopen(ToUTF16(name).c_str(), wide_flags);
 }
 
+static int remove_file(const string &name) {
+  return _wremove(ToUTF16(name).c_str());
+}
+
+static string FromUTF16(wstring input) {
+  string result;
+  int length = WideCharToMultiByte(CP_UTF8, 0, input.c_str(), input.length(), NULL, 0, NULL, NULL);
+  if (length > 0) {
+    result.resize(length);
+    WideCharToMultiByte(CP_UTF8, 0, input.c_str(), input.length(), &result[0], length, NULL, NULL);
+  }
+  return result;
+}
+
+static FILE *create_temporary_file(const string &directory, string *name) {
+  wchar_t wide_name[MAX_PATH];
+  if (!GetTempFileNameW(ToUTF16(directory).c_str(), L"sst", 0, wide_name)) return nullptr;
+  FILE *file = _wfopen(wide_name, L"wb");
+  if (!file) {
+    _wremove(wide_name);
+    return nullptr;
+  }
+  *name = FromUTF16(wide_name);
+  return file;
+}
+
 #else
 
 static size_t get_file_size(FILE *file) {
@@ -64,13 +105,46 @@ static size_t get_file_size(FILE *file) {
   return file_stats.st_size;
 }
 
+// Nanoseconds, so that a rewrite within the same second changes the result.
+static uint64_t get_file_modification_time(FILE *file) {
+  struct stat file_stats;
+  if (fstat(fileno(file), &file_stats) != 0) return 0;
+#ifdef __APPLE__
+  const struct timespec &time = file_stats.st_mtimespec;
+#else
+  const struct timespec &time = file_stats.st_mtim;
+#endif
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
 static FILE *open_file(const std::string &name, const char *flags) {
   return fopen(name.c_str(), flags);
 }
 
+static int remove_file(const std::string &name) {
+  return remove(name.c_str());
+}
+
+static FILE *create_temporary_file(const std::string &directory, std::string *name) {
+  std::string template_name = directory + "/superstring-XXXXXX";
+  int descriptor = mkstemp(&template_name[0]);
+  if (descriptor == -1) return nullptr;
+  FILE *file = fdopen(descriptor, "wb");
+  if (!file) {
+    close(descriptor);
+    remove(template_name.c_str());
+    return nullptr;
+  }
+  *name = move(template_name);
+  return file;
+}
+
 #endif
 
 static size_t CHUNK_SIZE = 10 * 1024;
+static size_t PROGRESSIVE_LOAD_BATCH_SIZE = 1024 * 1024;
+static const char *LoadingBufferMessage = "Cannot edit a buffer while it is loading";
+static const char *UnavailableBaseTextMessage = "The spilled base text could not be reloaded";
 
 class RegexWrapper : public Nan::ObjectWrap {
  public:
@@ -188,6 +262,19 @@ public:
 
 Nan::Persistent<Function> SubsequenceMatchWrapper::constructor;
 
+// Methods that read characters reload a spilled base text first, so that a
+// text that can't be reloaded is reported instead of being read as stand-in
+// characters.
+template <void (*method)(const Nan::FunctionCallbackInfo<Value> &)>
+static void reloading_base_text(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  if (!text_buffer.reload_base_text()) {
+    Nan::ThrowError(UnavailableBaseTextMessage);
+    return;
+  }
+  method(info);
+}
+
 void TextBufferWrapper::init(Local<Object> exports) {
   Local<FunctionTemplate> constructor_template = Nan::New<FunctionTemplate>(construct);
   constructor_template->SetClassName(Nan::New<String>("TextBuffer").ToLocalChecked());
@@ -197,35 +284,51 @@ void TextBufferWrapper::init(Local<Object> exports) {
   Nan::SetTemplate(prototype_template, Nan::New("getLength").ToLocalChecked(), Nan::New<FunctionTemplate>(get_length), None);
   Nan::SetTemplate(prototype_template, Nan::New("getExtent").ToLocalChecked(), Nan::New<FunctionTemplate>(get_extent), None);
   Nan::SetTemplate(prototype_template, Nan::New("getLineCount").ToLocalChecked(), Nan::New<FunctionTemplate>(get_line_count), None);
-  Nan::SetTemplate(prototype_template, Nan::New("hasAstral").ToLocalChecked(), Nan::New<FunctionTemplate>(has_astral), None);
-  Nan::SetTemplate(prototype_template, Nan::New("getCharacterAtPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(get_character_at_position), None);
-  Nan::SetTemplate(prototype_template, Nan::New("getTextInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(get_text_in_range), None);
-  Nan::SetTemplate(prototype_template, Nan::New("setTextInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(set_text_in_range), None);
-  Nan::SetTemplate(prototype_template, Nan::New("getText").ToLocalChecked(), Nan::New<FunctionTemplate>(get_text), None);
-  Nan::SetTemplate(prototype_template, Nan::New("setText").ToLocalChecked(), Nan::New<FunctionTemplate>(set_text), None);
-  Nan::SetTemplate(prototype_template, Nan::New("lineForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_for_row), None);
-  Nan::SetTemplate(prototype_template, Nan::New("lineLengthForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_length_for_row), None);
-  Nan::SetTemplate(prototype_template, Nan::New("lineEndingForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_ending_for_row), None);
-  Nan::SetTemplate(prototype_template, Nan::New("getLines").ToLocalChecked(), Nan::New<FunctionTemplate>(get_lines), None);
-  Nan::SetTemplate(prototype_template, Nan::New("characterIndexForPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(character_index_for_position), None);
-  Nan::SetTemplate(prototype_template, Nan::New("positionForCharacterIndex").ToLocalChecked(), Nan::New<FunctionTemplate>(position_for_character_index), None);
-  Nan::SetTemplate(prototype_template, Nan::New("isModified").ToLocalChecked(), Nan::New<FunctionTemplate>(is_modified), None);
-  Nan::SetTemplate(prototype_template, Nan::New("load").ToLocalChecked(), Nan::New<FunctionTemplate>(load), None);
-  Nan::SetTemplate(prototype_template, Nan::New("baseTextMatchesFile").ToLocalChecked(), Nan::New<FunctionTemplate>(base_text_matches_file), None);
-  Nan::SetTemplate(prototype_template, Nan::New("save").ToLocalChecked(), Nan::New<FunctionTemplate>(save), None);
-  Nan::SetTemplate(prototype_template, Nan::New("loadSync").ToLocalChecked(), Nan::New<FunctionTemplate>(load_sync), None);
-  Nan::SetTemplate(prototype_template, Nan::New("serializeChanges").ToLocalChecked(), Nan::New<FunctionTemplate>(serialize_changes), None);
-  Nan::SetTemplate(prototype_template, Nan::New("deserializeChanges").ToLocalChecked(), Nan::New<FunctionTemplate>(deserialize_changes), None);
+  Nan::SetTemplate(prototype_template, Nan::New("hasAstral").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<has_astral>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getStatistics").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<get_statistics>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getMemoryUsage").ToLocalChecked(), Nan::New<FunctionTemplate>(get_memory_usage), None);
+  Nan::SetTemplate(prototype_template, Nan::New("trimMemory").ToLocalChecked(), Nan::New<FunctionTemplate>(trim_memory), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getCharacterAtPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<get_character_at_position>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getTextInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<get_text_in_range>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("setTextInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<set_text_in_range>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("setTextInRanges").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<set_text_in_ranges>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("beginTransaction").ToLocalChecked(), Nan::New<FunctionTemplate>(begin_transaction), None);
+  Nan::SetTemplate(prototype_template, Nan::New("commitTransaction").ToLocalChecked(), Nan::New<FunctionTemplate>(commit_transaction), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getText").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<get_text>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("setText").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<set_text>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("lineForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<line_for_row>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("lineLengthForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<line_length_for_row>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("lineEndingForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<line_ending_for_row>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getLineEndingCounts").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<get_line_ending_counts>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("hasMixedLineEndings").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<has_mixed_line_endings>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("normalizeLineEndings").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<normalize_line_endings>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getLines").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<get_lines>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("characterIndexForPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<character_index_for_position>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("positionForCharacterIndex").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<position_for_character_index>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("isModified").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<is_modified>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("load").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<load>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("loadProgressively").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<load_progressively>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("isLoading").ToLocalChecked(), Nan::New<FunctionTemplate>(is_loading), None);
+  Nan::SetTemplate(prototype_template, Nan::New("baseTextMatchesFile").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<base_text_matches_file>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("save").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<save>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("loadSync").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<load_sync>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("serializeChanges").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<serialize_changes>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("deserializeChanges").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<deserialize_changes>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("serializeJournalEntry").ToLocalChecked(), Nan::New<FunctionTemplate>(serialize_journal_entry), None);
+  Nan::SetTemplate(prototype_template, Nan::New("shouldCompactJournal").ToLocalChecked(), Nan::New<FunctionTemplate>(should_compact_journal), None);
   Nan::SetTemplate(prototype_template, Nan::New("reset").ToLocalChecked(), Nan::New<FunctionTemplate>(reset), None);
-  Nan::SetTemplate(prototype_template, Nan::New("baseTextDigest").ToLocalChecked(), Nan::New<FunctionTemplate>(base_text_digest), None);
-  Nan::SetTemplate(prototype_template, Nan::New("find").ToLocalChecked(), Nan::New<FunctionTemplate>(find), None);
-  Nan::SetTemplate(prototype_template, Nan::New("findSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_sync), None);
-  Nan::SetTemplate(prototype_template, Nan::New("findAll").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all), None);
-  Nan::SetTemplate(prototype_template, Nan::New("findAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all_sync), None);
-  Nan::SetTemplate(prototype_template, Nan::New("findAndMarkAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_and_mark_all_sync), None);
-  Nan::SetTemplate(prototype_template, Nan::New("findWordsWithSubsequenceInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(find_words_with_subsequence_in_range), None);
-  Nan::SetTemplate(prototype_template, Nan::New("getDotGraph").ToLocalChecked(), Nan::New<FunctionTemplate>(dot_graph), None);
-  Nan::SetTemplate(prototype_template, Nan::New("getSnapshot").ToLocalChecked(), Nan::New<FunctionTemplate>(get_snapshot), None);
+  Nan::SetTemplate(prototype_template, Nan::New("baseTextDigest").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<base_text_digest>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("internBaseText").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<intern_base_text>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("spillBaseText").ToLocalChecked(), Nan::New<FunctionTemplate>(spill_base_text), None);
+  Nan::SetTemplate(prototype_template, Nan::New("isBaseTextSpilled").ToLocalChecked(), Nan::New<FunctionTemplate>(is_base_text_spilled), None);
+  Nan::SetTemplate(prototype_template, Nan::New("find").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<find>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findSync").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<find_sync>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findAll").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<find_all>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<find_all_sync>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findAndMarkAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<find_and_mark_all_sync>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findWordsWithSubsequenceInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<find_words_with_subsequence_in_range>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getDotGraph").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<dot_graph>), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getSnapshot").ToLocalChecked(), Nan::New<FunctionTemplate>(reloading_base_text<get_snapshot>), None);
   RegexWrapper::init();
   SubsequenceMatchWrapper::init();
   Nan::Set(exports, Nan::New("TextBuffer").ToLocalChecked(), Nan::GetFunction(constructor_template).ToLocalChecked());
@@ -262,6 +365,39 @@ void TextBufferWrapper::has_astral(const Nan::FunctionCallbackInfo<Value> &info)
   info.GetReturnValue().Set(Nan::New(text_buffer.has_astral()));
 }
 
+void TextBufferWrapper::get_statistics(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto statistics = text_buffer.statistics();
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("lfCount").ToLocalChecked(), Nan::New<Integer>(statistics.lf_count));
+  Nan::Set(result, Nan::New("crlfCount").ToLocalChecked(), Nan::New<Integer>(statistics.crlf_count));
+  Nan::Set(result, Nan::New("crCount").ToLocalChecked(), Nan::New<Integer>(statistics.cr_count));
+  Nan::Set(result, Nan::New("nulCount").ToLocalChecked(), Nan::New<Integer>(statistics.nul_count));
+  Nan::Set(result, Nan::New("surrogateCount").ToLocalChecked(), Nan::New<Integer>(statistics.surrogate_count));
+  Nan::Set(result, Nan::New("longestLineLength").ToLocalChecked(), Nan::New<Integer>(statistics.longest_line_length));
+  info.GetReturnValue().Set(result);
+}
+
+void TextBufferWrapper::get_memory_usage(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto memory_usage = text_buffer.get_memory_usage();
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("baseTextBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.base_text_bytes));
+  Nan::Set(result, Nan::New("snapshotTextBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.snapshot_text_bytes));
+  Nan::Set(result, Nan::New("patchNodeBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.patch_node_bytes));
+  Nan::Set(result, Nan::New("patchTextBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.patch_text_bytes));
+  Nan::Set(result, Nan::New("indexBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.index_bytes));
+  Nan::Set(result, Nan::New("layerCount").ToLocalChecked(), Nan::New<Integer>(memory_usage.layer_count));
+  Nan::Set(result, Nan::New("snapshotLayerCount").ToLocalChecked(), Nan::New<Integer>(memory_usage.snapshot_layer_count));
+  info.GetReturnValue().Set(result);
+}
+
+void TextBufferWrapper::trim_memory(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  uint32_t level = Nan::To<uint32_t>(info[0]).FromMaybe(0);
+  text_buffer.trim_memory(level > 0 ? TextBuffer::TrimCaches : TextBuffer::TrimContainers);
+}
+
 void TextBufferWrapper::get_character_at_position(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto point = PointWrapper::point_from_js(info[0]);
@@ -292,6 +428,11 @@ void TextBufferWrapper::set_text_in_range(const Nan::FunctionCallbackInfo<Value>
   auto text_buffer_wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This());
   text_buffer_wrapper->cancel_queued_workers();
   auto &text_buffer = text_buffer_wrapper->text_buffer;
+  if (text_buffer.is_loading()) {
+    Nan::ThrowError(LoadingBufferMessage);
+    return;
+  }
+
   auto range = RangeWrapper::range_from_js(info[0]);
   auto text = string_conversion::string_from_js(info[1]);
   if (range && text) {
@@ -299,10 +440,25 @@ void TextBufferWrapper::set_text_in_range(const Nan::FunctionCallbackInfo<Value>
   }
 }
 
+void TextBufferWrapper::begin_transaction(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  text_buffer.begin_transaction();
+}
+
+void TextBufferWrapper::commit_transaction(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  text_buffer.commit_transaction();
+}
+
 void TextBufferWrapper::set_text(const Nan::FunctionCallbackInfo<Value> &info) {
   auto text_buffer_wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This());
   text_buffer_wrapper->cancel_queued_workers();
   auto &text_buffer = text_buffer_wrapper->text_buffer;
+  if (text_buffer.is_loading()) {
+    Nan::ThrowError(LoadingBufferMessage);
+    return;
+  }
+
   auto text = string_conversion::string_from_js(info[0]);
   if (text) {
     text_buffer.set_text(move(*text));
@@ -348,6 +504,34 @@ void TextBufferWrapper::line_ending_for_row(const Nan::FunctionCallbackInfo<Valu
   }
 }
 
+void TextBufferWrapper::get_line_ending_counts(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto maybe_start_row = Nan::To<uint32_t>(info[0]);
+  auto maybe_end_row = Nan::To<uint32_t>(info[1]);
+  if (maybe_start_row.IsJust() && maybe_end_row.IsJust()) {
+    auto counts = text_buffer.line_ending_counts(maybe_start_row.FromJust(), maybe_end_row.FromJust());
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("lfCount").ToLocalChecked(), Nan::New<Integer>(counts.lf_count));
+    Nan::Set(result, Nan::New("crlfCount").ToLocalChecked(), Nan::New<Integer>(counts.crlf_count));
+    info.GetReturnValue().Set(result);
+  }
+}
+
+void TextBufferWrapper::has_mixed_line_endings(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  info.GetReturnValue().Set(Nan::New<Boolean>(text_buffer.has_mixed_line_endings()));
+}
+
+void TextBufferWrapper::normalize_line_endings(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto text_buffer_wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This());
+  text_buffer_wrapper->cancel_queued_workers();
+  auto &text_buffer = text_buffer_wrapper->text_buffer;
+  auto line_ending = string_conversion::string_from_js(info[0]);
+  if (line_ending) {
+    text_buffer.normalize_line_endings(*line_ending);
+  }
+}
+
 void TextBufferWrapper::get_lines(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto result = Nan::New<Array>();
@@ -392,6 +576,45 @@ static Local<Value> encode_ranges(const vector<Range> &ranges) {
   return result;
 }
 
+void TextBufferWrapper::set_text_in_ranges(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto text_buffer_wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This());
+  text_buffer_wrapper->cancel_queued_workers();
+  auto &text_buffer = text_buffer_wrapper->text_buffer;
+  if (text_buffer.is_loading()) {
+    Nan::ThrowError(LoadingBufferMessage);
+    return;
+  }
+
+  if (!info[0]->IsArray() || !info[1]->IsArray()) {
+    Nan::ThrowTypeError("Expected an array of ranges and an array of strings");
+    return;
+  }
+
+  auto js_ranges = info[0].As<Array>();
+  auto js_texts = info[1].As<Array>();
+  if (js_ranges->Length() != js_texts->Length()) {
+    Nan::ThrowError("Expected the same number of ranges and strings");
+    return;
+  }
+
+  vector<pair<Range, u16string>> changes;
+  changes.reserve(js_ranges->Length());
+  for (uint32_t i = 0, n = js_ranges->Length(); i < n; i++) {
+    auto range = RangeWrapper::range_from_js(Nan::Get(js_ranges, i).ToLocalChecked());
+    auto text = string_conversion::string_from_js(Nan::Get(js_texts, i).ToLocalChecked());
+    if (!range || !text) return;
+    changes.push_back({*range, move(*text)});
+  }
+
+  auto new_ranges = text_buffer.set_text_in_ranges(move(changes));
+  if (!new_ranges) {
+    Nan::ThrowError("Ranges must be sorted and must not overlap");
+    return;
+  }
+
+  info.GetReturnValue().Set(encode_ranges(*new_ranges));
+}
+
 template <bool single_result>
 class TextBufferSearcher : public Nan::AsyncWorker {
   const TextBuffer::Snapshot *snapshot;
@@ -717,6 +940,7 @@ static u16string load_file(
     [&callback, file_size](size_t bytes_read) {
       size_t percent_done = file_size > 0 ? 100 * bytes_read / file_size : 100;
       callback(percent_done);
+      return true;
     }
   )) {
     *error = Error{errno, "read"};
@@ -733,7 +957,7 @@ class Loader {
   TextBuffer::Snapshot *snapshot;
   string file_name;
   string encoding_name;
-  optional<Text> loaded_text;
+  std::shared_ptr<Text> loaded_text;
   optional<Error> error;
   Patch patch;
   bool force;
@@ -761,7 +985,7 @@ class Loader {
     progress_callback{progress_callback},
     buffer{buffer},
     snapshot{snapshot},
-    loaded_text{move(text)},
+    loaded_text{std::make_shared<Text>(move(text))},
     force{force},
     compute_patch{compute_patch},
     cancelled{false} {}
@@ -772,8 +996,8 @@ class Loader {
 
   template <typename Callback>
   void Execute(const Callback &callback) {
-    if (!loaded_text) loaded_text = Text{load_file(file_name, encoding_name, &error, callback)};
-    if (!error && compute_patch) patch = text_diff(snapshot->base_text(), *loaded_text);
+    if (!loaded_text) loaded_text = std::make_shared<Text>(load_file(file_name, encoding_name, &error, callback));
+    if (!error && compute_patch) patch = text_diff(snapshot->shared_base_text(), loaded_text);
   }
 
   pair<Local<Value>, Local<Value>> Finish(Nan::AsyncResource* caller_async_resource = nullptr) {
@@ -820,7 +1044,7 @@ class Loader {
     }
 
     if (has_changed) {
-      buffer->reset(move(*loaded_text));
+      buffer->reset(move(loaded_text));
     } else {
       buffer->flush_changes();
     }
@@ -982,6 +1206,201 @@ void TextBufferWrapper::load(const Nan::FunctionCallbackInfo<Value> &info) {
   Nan::AsyncQueueWorker(worker);
 }
 
+// Decodes a file on a background thread and hands the text to the buffer in
+// batches. The first batch is sent as soon as it contains the requested number
+// of rows, so that the beginning of a large file can be displayed right away.
+class ProgressiveLoadWorker : public Nan::AsyncProgressWorkerBase<size_t> {
+  Nan::Callback *progress_callback;
+  TextBufferWrapper *wrapper;
+  TextBuffer *buffer;
+  string file_name;
+  string encoding_name;
+  uint32_t initial_row_count;
+  bool force;
+  bool started;
+  std::atomic<bool> cancelled;
+  optional<Error> error;
+  std::mutex batches_mutex;
+  vector<u16string> batches;
+
+ public:
+  ProgressiveLoadWorker(Nan::Callback *completion_callback, Nan::Callback *progress_callback,
+                        TextBufferWrapper *wrapper, string &&file_name, string &&encoding_name,
+                        uint32_t initial_row_count, bool force) :
+    AsyncProgressWorkerBase(completion_callback, "TextBuffer.loadProgressively"),
+    progress_callback{progress_callback},
+    wrapper{wrapper},
+    buffer{&wrapper->text_buffer},
+    file_name{move(file_name)},
+    encoding_name{move(encoding_name)},
+    initial_row_count{initial_row_count},
+    force{force},
+    started{false},
+    cancelled{false} {}
+
+  ~ProgressiveLoadWorker() {
+    if (progress_callback) delete progress_callback;
+  }
+
+  void Execute(const Nan::AsyncProgressWorkerBase<size_t>::ExecutionProgress &progress) {
+    auto conversion = transcoding_from(encoding_name.c_str());
+    if (!conversion) {
+      error = Error{INVALID_ENCODING, nullptr};
+      return;
+    }
+
+    FILE *file = open_file(file_name, "rb");
+    if (!file) {
+      error = Error{errno, "open"};
+      return;
+    }
+
+    size_t file_size = get_file_size(file);
+    if (file_size == static_cast<size_t>(-1)) {
+      error = Error{errno, "stat"};
+      fclose(file);
+      return;
+    }
+
+    u16string decoded_text;
+    vector<char> input_buffer(CHUNK_SIZE);
+    size_t scanned_size = 0;
+    uint32_t row_count = 0;
+    bool sent_first_batch = false;
+
+    if (!conversion->decode(
+      decoded_text,
+      file,
+      input_buffer,
+      [&](size_t bytes_read) {
+        // The progress callback can cancel the load, so stop decoding early.
+        if (cancelled) return false;
+
+        if (!sent_first_batch) {
+          row_count += std::count(decoded_text.begin() + scanned_size, decoded_text.end(), u'\n');
+          scanned_size = decoded_text.size();
+          if (row_count < initial_row_count) return true;
+          sent_first_batch = true;
+        } else if (decoded_text.size() < PROGRESSIVE_LOAD_BATCH_SIZE) {
+          return true;
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(batches_mutex);
+          batches.push_back(move(decoded_text));
+        }
+        decoded_text.clear();
+
+        size_t percent_done = file_size > 0 ? 100 * bytes_read / file_size : 100;
+        progress.Send(&percent_done, 1);
+        return true;
+      }
+    )) {
+      error = Error{errno, "read"};
+    }
+
+    fclose(file);
+    if (cancelled) return;
+    std::lock_guard<std::mutex> lock(batches_mutex);
+    batches.push_back(move(decoded_text));
+  }
+
+  void AppendBatches() {
+    vector<u16string> pending_batches;
+    {
+      std::lock_guard<std::mutex> lock(batches_mutex);
+      pending_batches.swap(batches);
+    }
+
+    for (u16string &batch : pending_batches) {
+      if (cancelled) return;
+      if (started) {
+        buffer->append_loaded_text(Text{move(batch)});
+      } else if ((force || !buffer->is_modified()) && buffer->begin_loading(Text{move(batch)})) {
+        started = true;
+      } else {
+        cancelled = true;
+      }
+    }
+  }
+
+  void HandleProgressCallback(const size_t *percent_done, size_t count) {
+    AppendBatches();
+    if (!cancelled && percent_done && progress_callback) {
+      Nan::HandleScope scope;
+      Local<Value> argv[] = {Nan::New<Number>(static_cast<uint32_t>(*percent_done))};
+      auto progress_result = progress_callback->Call(1, argv, async_resource);
+      if (!progress_result.IsEmpty() && progress_result.ToLocalChecked()->IsFalse()) cancelled = true;
+    }
+  }
+
+  // A load that was cancelled or failed part of the way through leaves only
+  // a prefix of the file, so the buffer's previous contents are restored and
+  // the load is reported as not having happened.
+  void HandleOKCallback() {
+    if (!error) AppendBatches();
+
+    bool loaded = started && !cancelled && !error;
+    if (loaded) {
+      buffer->finish_loading();
+    } else if (started) {
+      buffer->cancel_loading();
+    }
+    wrapper->has_progressive_load = false;
+
+    Local<Value> js_error = Nan::Null();
+    if (error) js_error = error_to_js(*error, encoding_name, file_name);
+    Local<Value> argv[] = {js_error, Nan::New(loaded)};
+    callback->Call(2, argv, async_resource);
+  }
+};
+
+// Only one progressive load can run at a time, because each one replaces the
+// buffer's contents with its own file as it is decoded.
+void TextBufferWrapper::load_progressively(const Nan::FunctionCallbackInfo<Value> &info) {
+  TextBufferWrapper *wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This());
+  if (wrapper->has_progressive_load || wrapper->text_buffer.is_loading()) {
+    Nan::ThrowError("The buffer is already loading");
+    return;
+  }
+
+  bool force = false;
+  if (info[2]->IsTrue()) force = true;
+
+  Local<String> js_file_path;
+  if (!Nan::To<String>(info[3]).ToLocal(&js_file_path)) return;
+  string file_path = *Nan::Utf8String(js_file_path);
+
+  Local<String> js_encoding_name;
+  if (!Nan::To<String>(info[4]).ToLocal(&js_encoding_name)) return;
+  string encoding_name = *Nan::Utf8String(js_encoding_name);
+
+  uint32_t initial_row_count = Nan::To<uint32_t>(info[5]).FromMaybe(0);
+
+  Nan::Callback *completion_callback = new Nan::Callback(info[0].As<Function>());
+
+  Nan::Callback *progress_callback = nullptr;
+  if (info[1]->IsFunction()) {
+    progress_callback = new Nan::Callback(info[1].As<Function>());
+  }
+
+  wrapper->has_progressive_load = true;
+  Nan::AsyncQueueWorker(new ProgressiveLoadWorker(
+    completion_callback,
+    progress_callback,
+    wrapper,
+    move(file_path),
+    move(encoding_name),
+    initial_row_count,
+    force
+  ));
+}
+
+void TextBufferWrapper::is_loading(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  info.GetReturnValue().Set(Nan::New(text_buffer.is_loading()));
+}
+
 class BaseTextComparisonWorker : public Nan::AsyncWorker {
   TextBuffer::Snapshot *snapshot;
   string file_name;
@@ -1141,14 +1560,32 @@ void TextBufferWrapper::serialize_changes(const Nan::FunctionCallbackInfo<Value>
 void TextBufferWrapper::deserialize_changes(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   if (info[0]->IsUint8Array()) {
-    auto *data = node::Buffer::Data(info[0]);
-    static vector<uint8_t> input;
-    input.assign(data, data + node::Buffer::Length(info[0]));
-    Deserializer deserializer(input);
+    Deserializer deserializer(
+      reinterpret_cast<const uint8_t *>(node::Buffer::Data(info[0])),
+      node::Buffer::Length(info[0])
+    );
     text_buffer.deserialize_changes(deserializer);
   }
 }
 
+void TextBufferWrapper::serialize_journal_entry(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+
+  static vector<uint8_t> output;
+  output.clear();
+  Serializer serializer(output);
+  if (!text_buffer.serialize_journal_entry(serializer)) return;
+  Local<Object> result;
+  if (Nan::CopyBuffer(reinterpret_cast<char *>(output.data()), output.size()).ToLocal(&result)) {
+    info.GetReturnValue().Set(result);
+  }
+}
+
+void TextBufferWrapper::should_compact_journal(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  info.GetReturnValue().Set(Nan::New<Boolean>(text_buffer.should_compact_journal()));
+}
+
 void TextBufferWrapper::reset(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto text = string_conversion::string_from_js(info[0]);
@@ -1171,6 +1608,69 @@ void TextBufferWrapper::base_text_digest(const Nan::FunctionCallbackInfo<Value>
   }
 }
 
+void TextBufferWrapper::intern_base_text(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  info.GetReturnValue().Set(Nan::New(text_buffer.intern_base_text()));
+}
+
+// Removes a spilled base text's file once the buffer no longer needs it.
+struct SpilledTextFile {
+  string path;
+  explicit SpilledTextFile(string &&path) : path{move(path)} {}
+  SpilledTextFile(const SpilledTextFile &) = delete;
+  ~SpilledTextFile() { remove_file(path); }
+};
+
+void TextBufferWrapper::spill_base_text(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+
+  Local<String> js_directory_path;
+  if (!Nan::To<String>(info[0]).ToLocal(&js_directory_path)) return;
+  string directory_path = *Nan::Utf8String(js_directory_path);
+
+  if (text_buffer.is_base_text_spilled() || text_buffer.is_loading()) {
+    info.GetReturnValue().Set(Nan::False());
+    return;
+  }
+
+  string file_path;
+  FILE *file = create_temporary_file(directory_path, &file_path);
+  if (!file) {
+    info.GetReturnValue().Set(Nan::False());
+    return;
+  }
+
+  auto spilled_file = std::make_shared<SpilledTextFile>(move(file_path));
+  const u16string &content = text_buffer.base_text().content;
+  bool written = fwrite(content.data(), sizeof(char16_t), content.size(), file) == content.size();
+  if (fclose(file) != 0) written = false;
+
+  // The buffer checks the reloaded text against the one it spilled, and
+  // methods that read characters reload it first and report any failure.
+  uint32_t size = content.size();
+  bool spilled = written && text_buffer.spill_base_text([spilled_file, size]() -> optional<Text> {
+    FILE *file = open_file(spilled_file->path, "rb");
+    if (!file) return optional<Text>{};
+
+    // Read one character past the expected size to detect a file that has
+    // changed length since it was written.
+    u16string content(size + 1, 0);
+    size_t read_count = fread(&content[0], sizeof(char16_t), size + 1, file);
+    fclose(file);
+    if (read_count != size) return optional<Text>{};
+
+    content.resize(size);
+    return optional<Text>{Text{move(content)}};
+  });
+
+  info.GetReturnValue().Set(Nan::New(spilled));
+}
+
+void TextBufferWrapper::is_base_text_spilled(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  info.GetReturnValue().Set(Nan::New(text_buffer.is_base_text_spilled()));
+}
+
 void TextBufferWrapper::get_snapshot(const Nan::FunctionCallbackInfo<Value> &info) {
   Nan::HandleScope scope;
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
@@ -1189,3 +1689,237 @@ void TextBufferWrapper::cancel_queued_workers() {
   }
   outstanding_workers.clear();
 }
+
+void SparseTextBufferWrapper::init(Local<Object> exports) {
+  Local<FunctionTemplate> constructor_template = Nan::New<FunctionTemplate>(construct);
+  constructor_template->SetClassName(Nan::New<String>("SparseTextBuffer").ToLocalChecked());
+  constructor_template->InstanceTemplate()->SetInternalFieldCount(1);
+  const auto &prototype_template = constructor_template->PrototypeTemplate();
+  Nan::SetTemplate(prototype_template, Nan::New("getLength").ToLocalChecked(), Nan::New<FunctionTemplate>(get_length), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getExtent").ToLocalChecked(), Nan::New<FunctionTemplate>(get_extent), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getLineCount").ToLocalChecked(), Nan::New<FunctionTemplate>(get_line_count), None);
+  Nan::SetTemplate(prototype_template, Nan::New("lineForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_for_row), None);
+  Nan::SetTemplate(prototype_template, Nan::New("lineLengthForRow").ToLocalChecked(), Nan::New<FunctionTemplate>(line_length_for_row), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getTextInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(get_text_in_range), None);
+  Nan::SetTemplate(prototype_template, Nan::New("characterIndexForPosition").ToLocalChecked(), Nan::New<FunctionTemplate>(character_index_for_position), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_sync), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all_sync), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getMemoryUsage").ToLocalChecked(), Nan::New<FunctionTemplate>(get_memory_usage), None);
+  Nan::SetTemplate(prototype_template, Nan::New("saveIndex").ToLocalChecked(), Nan::New<FunctionTemplate>(save_index), None);
+  Nan::SetTemplate(prototype_template, Nan::New("loadIndex").ToLocalChecked(), Nan::New<FunctionTemplate>(load_index), None);
+  Nan::Set(exports, Nan::New("SparseTextBuffer").ToLocalChecked(), Nan::GetFunction(constructor_template).ToLocalChecked());
+}
+
+SparseTextBufferWrapper::SparseTextBufferWrapper(FILE *file, EncodingConversion &&conversion,
+                                                 const string &file_path, const string &encoding_name) :
+  sparse_text_buffer{file, move(conversion)},
+  file_path{file_path},
+  encoding_name{encoding_name},
+  modification_time{get_file_modification_time(file)} {}
+
+void SparseTextBufferWrapper::construct(const Nan::FunctionCallbackInfo<Value> &info) {
+  if (!info[0]->IsString() || !info[1]->IsString()) {
+    Nan::ThrowError("Invalid arguments");
+    return;
+  }
+
+  string file_path = *Nan::Utf8String(info[0]);
+  string encoding_name = *Nan::Utf8String(info[1]);
+
+  auto conversion = transcoding_from(encoding_name.c_str());
+  if (!conversion) {
+    Nan::ThrowError(error_to_js(Error{INVALID_ENCODING, nullptr}, encoding_name, file_path));
+    return;
+  }
+
+  FILE *file = open_file(file_path, "rb");
+  if (!file) {
+    Nan::ThrowError(error_to_js(Error{errno, "open"}, encoding_name, file_path));
+    return;
+  }
+
+  SparseTextBufferWrapper *wrapper = new SparseTextBufferWrapper(file, move(*conversion), file_path, encoding_name);
+  wrapper->Wrap(info.This());
+}
+
+void SparseTextBufferWrapper::get_length(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  info.GetReturnValue().Set(Nan::New<Number>(sparse_text_buffer.size()));
+}
+
+void SparseTextBufferWrapper::get_extent(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  info.GetReturnValue().Set(PointWrapper::from_point(sparse_text_buffer.extent()));
+}
+
+void SparseTextBufferWrapper::get_line_count(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  info.GetReturnValue().Set(Nan::New(sparse_text_buffer.extent().row + 1));
+}
+
+void SparseTextBufferWrapper::line_for_row(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  auto maybe_row = Nan::To<uint32_t>(info[0]);
+  if (maybe_row.IsJust()) {
+    auto result = sparse_text_buffer.line_for_row(maybe_row.FromJust());
+    if (result) {
+      info.GetReturnValue().Set(string_conversion::string_to_js(*result));
+    }
+  }
+}
+
+void SparseTextBufferWrapper::line_length_for_row(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  auto maybe_row = Nan::To<uint32_t>(info[0]);
+  if (maybe_row.IsJust()) {
+    auto result = sparse_text_buffer.line_length_for_row(maybe_row.FromJust());
+    if (result) {
+      info.GetReturnValue().Set(Nan::New<Number>(*result));
+    }
+  }
+}
+
+void SparseTextBufferWrapper::get_text_in_range(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  auto range = RangeWrapper::range_from_js(info[0]);
+  if (range) {
+    info.GetReturnValue().Set(string_conversion::string_to_js(sparse_text_buffer.text_in_range(*range)));
+  }
+}
+
+void SparseTextBufferWrapper::character_index_for_position(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  auto position = PointWrapper::point_from_js(info[0]);
+  if (position) {
+    info.GetReturnValue().Set(
+      Nan::New<Number>(sparse_text_buffer.clip_position(*position).offset)
+    );
+  }
+}
+
+void SparseTextBufferWrapper::find_sync(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  const Regex *regex = RegexWrapper::regex_from_js(info[0]);
+  if (regex) {
+    optional<Range> search_range;
+    if (info[1]->IsObject()) {
+      search_range = RangeWrapper::range_from_js(info[1]);
+      if (!search_range) return;
+    }
+
+    auto match = sparse_text_buffer.find(
+      *regex,
+      search_range ? *search_range : Range::all_inclusive()
+    );
+    vector<Range> matches;
+    if (match) matches.push_back(*match);
+
+    info.GetReturnValue().Set(encode_ranges(matches));
+  }
+}
+
+void SparseTextBufferWrapper::find_all_sync(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  const Regex *regex = RegexWrapper::regex_from_js(info[0]);
+  if (regex) {
+    optional<Range> search_range;
+    if (info[1]->IsObject()) {
+      search_range = RangeWrapper::range_from_js(info[1]);
+      if (!search_range) return;
+    }
+
+    vector<Range> matches = sparse_text_buffer.find_all(
+      *regex,
+      search_range ? *search_range : Range::all_inclusive()
+    );
+
+    info.GetReturnValue().Set(encode_ranges(matches));
+  }
+}
+
+void SparseTextBufferWrapper::get_memory_usage(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &sparse_text_buffer = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This())->sparse_text_buffer;
+  auto memory_usage = sparse_text_buffer.get_memory_usage();
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("indexBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.index_bytes));
+  Nan::Set(result, Nan::New("cachedTextBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.cached_text_bytes));
+  Nan::Set(result, Nan::New("readBufferBytes").ToLocalChecked(), Nan::New<Number>(memory_usage.read_buffer_bytes));
+  Nan::Set(result, Nan::New("indexedChunkCount").ToLocalChecked(), Nan::New<Integer>(memory_usage.indexed_chunk_count));
+  Nan::Set(result, Nan::New("cachedChunkCount").ToLocalChecked(), Nan::New<Integer>(memory_usage.cached_chunk_count));
+  info.GetReturnValue().Set(result);
+}
+
+static void serialize_string(Serializer &output, const string &value) {
+  output.append<uint32_t>(value.size());
+  for (char character : value) output.append<uint8_t>(character);
+}
+
+static bool deserialize_matching_string(Deserializer &input, const string &expected_value) {
+  if (input.read<uint32_t>() != expected_value.size()) return false;
+  for (char character : expected_value) {
+    if (input.read<uint8_t>() != static_cast<uint8_t>(character)) return false;
+  }
+  return true;
+}
+
+// The index sidecar starts with the modification time, encoding and path of
+// the file it describes, followed by the buffer's own serialized index.
+void SparseTextBufferWrapper::save_index(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto wrapper = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This());
+  if (!info[0]->IsString()) {
+    Nan::ThrowError("Invalid arguments");
+    return;
+  }
+
+  string index_path = *Nan::Utf8String(info[0]);
+  vector<uint8_t> index;
+  Serializer serializer(index);
+  serializer.append<uint64_t>(wrapper->modification_time);
+  serialize_string(serializer, wrapper->encoding_name);
+  serialize_string(serializer, wrapper->file_path);
+  wrapper->sparse_text_buffer.serialize_index(serializer);
+
+  FILE *file = open_file(index_path, "wb");
+  if (!file) {
+    Nan::ThrowError(error_to_js(Error{errno, "open"}, wrapper->encoding_name, index_path));
+    return;
+  }
+
+  bool written = fwrite(index.data(), 1, index.size(), file) == index.size();
+  int write_error = errno;
+  fclose(file);
+  if (!written) {
+    Nan::ThrowError(error_to_js(Error{write_error, "write"}, wrapper->encoding_name, index_path));
+  }
+}
+
+void SparseTextBufferWrapper::load_index(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto wrapper = Nan::ObjectWrap::Unwrap<SparseTextBufferWrapper>(info.This());
+  if (!info[0]->IsString()) {
+    Nan::ThrowError("Invalid arguments");
+    return;
+  }
+
+  string index_path = *Nan::Utf8String(info[0]);
+  FILE *file = open_file(index_path, "rb");
+  if (!file) {
+    info.GetReturnValue().Set(Nan::False());
+    return;
+  }
+
+  vector<uint8_t> index;
+  size_t file_size = get_file_size(file);
+  if (file_size != static_cast<size_t>(-1)) {
+    index.resize(file_size);
+    index.resize(fread(index.data(), 1, file_size, file));
+  }
+  fclose(file);
+
+  Deserializer deserializer(index);
+  bool loaded =
+    deserializer.read<uint64_t>() == wrapper->modification_time &&
+    deserialize_matching_string(deserializer, wrapper->encoding_name) &&
+    deserialize_matching_string(deserializer, wrapper->file_path) &&
+    wrapper->sparse_text_buffer.deserialize_index(deserializer);
+  info.GetReturnValue().Set(Nan::New(loaded));
+}
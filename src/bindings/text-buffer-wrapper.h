@@ -2,6 +2,7 @@
 #define SUPERSTRING_TEXT_BUFFER_WRAPPER_H
 
 #include "nan.h"
+#include "sparse-text-buffer.h"
 #include "text-buffer.h"
 #include <unordered_set>
 
@@ -15,6 +16,7 @@ public:
   static void init(v8::Local<v8::Object> exports);
   TextBuffer text_buffer;
   std::unordered_set<CancellableWorker *> outstanding_workers;
+  bool has_progressive_load = false;
 
 private:
   static void construct(const Nan::FunctionCallbackInfo<v8::Value> &info);
@@ -22,14 +24,23 @@ private:
   static void get_extent(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_line_count(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void has_astral(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_statistics(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_memory_usage(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void trim_memory(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_text(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_character_at_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_text_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void set_text(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void set_text_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void set_text_in_ranges(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void begin_transaction(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void commit_transaction(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void line_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void line_length_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void line_ending_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_line_ending_counts(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void has_mixed_line_endings(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void normalize_line_endings(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_lines(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void character_index_for_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void position_for_character_index(const Nan::FunctionCallbackInfo<v8::Value> &info);
@@ -41,18 +52,52 @@ private:
   static void find_words_with_subsequence_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void is_modified(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void load(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void load_progressively(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void is_loading(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void base_text_matches_file(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void save(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void load_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void save_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void serialize_changes(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void deserialize_changes(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void serialize_journal_entry(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void should_compact_journal(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void reset(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void base_text_digest(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void intern_base_text(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void spill_base_text(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void is_base_text_spilled(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_snapshot(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void dot_graph(const Nan::FunctionCallbackInfo<v8::Value> &info);
 
   void cancel_queued_workers();
 };
 
+class SparseTextBufferWrapper : public Nan::ObjectWrap {
+public:
+  static void init(v8::Local<v8::Object> exports);
+
+private:
+  SparseTextBufferWrapper(FILE *file, EncodingConversion &&conversion,
+                          const std::string &file_path, const std::string &encoding_name);
+  static void construct(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_length(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_extent(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_line_count(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void line_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void line_length_for_row(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_text_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void character_index_for_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void find_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void find_all_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_memory_usage(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void save_index(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void load_index(const Nan::FunctionCallbackInfo<v8::Value> &info);
+
+  SparseTextBuffer sparse_text_buffer;
+  std::string file_path;
+  std::string encoding_name;
+  uint64_t modification_time;
+};
+
 #endif // SUPERSTRING_TEXT_BUFFER_WRAPPER_H
@@ -37,6 +37,10 @@ void TextReader::construct(const Nan::FunctionCallbackInfo<Value> &info) {
   Local<Object> js_text_buffer;
   if (!Nan::To<Object>(info[0]).ToLocal(&js_text_buffer)) return;
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(js_text_buffer)->text_buffer;
+  if (!text_buffer.reload_base_text()) {
+    Nan::ThrowError("The spilled base text could not be reloaded");
+    return;
+  }
   auto snapshot = text_buffer.create_snapshot();
 
   Local<String> js_encoding_name;
@@ -139,9 +139,10 @@ int EncodingConversion::convert(
   return Error;
 }
 
+// Decodes the stream until it ends or the progress callback returns false.
 bool EncodingConversion::decode(u16string &string, FILE *stream,
                                 vector<char> &input_vector,
-                                function<void(size_t)> progress_callback) {
+                                function<bool(size_t)> progress_callback) {
   char *input_buffer = input_vector.data();
   size_t bytes_left_over = 0;
   size_t total_bytes_read = 0;
@@ -161,7 +162,7 @@ bool EncodingConversion::decode(u16string &string, FILE *stream,
     );
 
     total_bytes_read += bytes_appended;
-    progress_callback(total_bytes_read);
+    if (!progress_callback(total_bytes_read)) break;
 
     if (bytes_appended < bytes_to_append) {
       std::copy(input_buffer + bytes_appended, input_buffer + bytes_to_append, input_buffer);
@@ -22,7 +22,7 @@ class EncodingConversion {
   size_t encode(const std::u16string &, size_t *start_offset, size_t end_offset,
                 char *buffer, size_t buffer_size, bool is_last = false);
   bool decode(std::u16string &, FILE *stream, std::vector<char> &buffer,
-              std::function<void(size_t)> progress_callback);
+              std::function<bool(size_t)> progress_callback);
   size_t decode(std::u16string &, const char *buffer, size_t buffer_size,
                 bool is_last = false);
 
@@ -60,6 +60,14 @@ public:
   size_t size() const {
     return contents.size();
   }
+
+  size_t capacity() const {
+    return contents.capacity();
+  }
+
+  void shrink_to_fit() {
+    contents.shrink_to_fit();
+  }
 };
 
 #endif // SUPERSTRING_FLAT_SET_H
@@ -0,0 +1,116 @@
+#include "line-offsets.h"
+#include <algorithm>
+
+LineOffsets::LineOffsets() :
+  data_{&inline_offset},
+  size_{0},
+  capacity_{1},
+  inline_offset{0} {}
+
+LineOffsets::LineOffsets(std::initializer_list<uint32_t> offsets) : LineOffsets() {
+  assign(offsets);
+}
+
+LineOffsets::LineOffsets(const std::vector<uint32_t> &offsets) : LineOffsets() {
+  insert(end(), offsets.data(), offsets.data() + offsets.size());
+}
+
+LineOffsets::LineOffsets(const LineOffsets &other) : LineOffsets() {
+  insert(end(), other.begin(), other.end());
+}
+
+LineOffsets::LineOffsets(LineOffsets &&other) : LineOffsets() {
+  *this = std::move(other);
+}
+
+LineOffsets::~LineOffsets() {
+  if (!is_inline()) delete[] data_;
+}
+
+LineOffsets &LineOffsets::operator=(const LineOffsets &other) {
+  if (this != &other) {
+    size_ = 0;
+    insert(end(), other.begin(), other.end());
+  }
+  return *this;
+}
+
+LineOffsets &LineOffsets::operator=(LineOffsets &&other) {
+  if (this == &other) return *this;
+  if (!is_inline()) delete[] data_;
+
+  if (other.is_inline()) {
+    data_ = &inline_offset;
+    inline_offset = other.inline_offset;
+  } else {
+    data_ = other.data_;
+  }
+  size_ = other.size_;
+  capacity_ = other.capacity_;
+
+  other.data_ = &other.inline_offset;
+  other.size_ = 0;
+  other.capacity_ = 1;
+  return *this;
+}
+
+bool LineOffsets::is_inline() const {
+  return data_ == &inline_offset;
+}
+
+void LineOffsets::reallocate(uint32_t capacity) {
+  uint32_t *data = capacity > 1 ? new uint32_t[capacity] : &inline_offset;
+  if (data != data_) {
+    std::copy(data_, data_ + size_, data);
+    if (!is_inline()) delete[] data_;
+    data_ = data;
+  }
+  capacity_ = capacity;
+}
+
+void LineOffsets::push_back(uint32_t offset) {
+  if (size_ == capacity_) reallocate(capacity_ * 2);
+  data_[size_++] = offset;
+}
+
+void LineOffsets::insert(const_iterator position, const_iterator first, const_iterator last) {
+  size_t index = position - data_;
+  size_t count = last - first;
+  if (count == 0) return;
+
+  // The inserted range may point into this container, in which case it has
+  // to be copied before anything is moved.
+  if (first >= data_ && first < data_ + size_) {
+    std::vector<uint32_t> inserted(first, last);
+    insert(data_ + index, inserted.data(), inserted.data() + count);
+    return;
+  }
+
+  reserve(size_ + count);
+  std::copy_backward(data_ + index, data_ + size_, data_ + size_ + count);
+  std::copy(first, last, data_ + index);
+  size_ += count;
+}
+
+void LineOffsets::assign(std::initializer_list<uint32_t> offsets) {
+  size_ = 0;
+  insert(end(), offsets.begin(), offsets.end());
+}
+
+void LineOffsets::resize(size_t size) {
+  reserve(size);
+  if (size > size_) std::fill(data_ + size_, data_ + size, 0);
+  size_ = size;
+}
+
+void LineOffsets::reserve(size_t capacity) {
+  if (capacity > capacity_) reallocate(std::max<size_t>(capacity, capacity_ * 2));
+}
+
+void LineOffsets::shrink_to_fit() {
+  if (capacity_ > size_) reallocate(std::max<uint32_t>(size_, 1));
+}
+
+void LineOffsets::clear() {
+  size_ = 0;
+}
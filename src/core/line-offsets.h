@@ -0,0 +1,58 @@
+#ifndef SUPERSTRING_LINE_OFFSETS_H_
+#define SUPERSTRING_LINE_OFFSETS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// The offsets at which the lines of a `Text` start. Every text has at least
+// one line, so the first offset is stored inline, and text without newlines
+// needs no heap allocation. Otherwise this behaves like a vector.
+class LineOffsets {
+  uint32_t *data_;
+  uint32_t size_;
+  uint32_t capacity_;
+  uint32_t inline_offset;
+
+  bool is_inline() const;
+  void reallocate(uint32_t capacity);
+
+ public:
+  using value_type = uint32_t;
+  using iterator = uint32_t *;
+  using const_iterator = const uint32_t *;
+
+  LineOffsets();
+  LineOffsets(std::initializer_list<uint32_t>);
+  LineOffsets(const std::vector<uint32_t> &);
+  LineOffsets(const LineOffsets &);
+  LineOffsets(LineOffsets &&);
+  ~LineOffsets();
+  LineOffsets &operator=(const LineOffsets &);
+  LineOffsets &operator=(LineOffsets &&);
+
+  inline size_t size() const { return size_; }
+  inline size_t capacity() const { return capacity_; }
+  inline bool empty() const { return size_ == 0; }
+  inline uint32_t &operator[](size_t index) { return data_[index]; }
+  inline const uint32_t &operator[](size_t index) const { return data_[index]; }
+  inline uint32_t &back() { return data_[size_ - 1]; }
+  inline const uint32_t &back() const { return data_[size_ - 1]; }
+  inline iterator begin() { return data_; }
+  inline iterator end() { return data_ + size_; }
+  inline const_iterator begin() const { return data_; }
+  inline const_iterator end() const { return data_ + size_; }
+  inline const_iterator cbegin() const { return data_; }
+  inline const_iterator cend() const { return data_ + size_; }
+
+  void push_back(uint32_t);
+  void insert(const_iterator position, const_iterator first, const_iterator last);
+  void assign(std::initializer_list<uint32_t>);
+  void resize(size_t);
+  void reserve(size_t);
+  void shrink_to_fit();
+  void clear();
+};
+
+#endif // SUPERSTRING_LINE_OFFSETS_H_
@@ -711,6 +711,65 @@ unordered_map<MarkerIndex::MarkerId, Range> MarkerIndex::dump() {
   return iterator.dump();
 }
 
+template <typename Key, typename Value>
+static size_t get_hash_table_memory_usage(const unordered_map<Key, Value> &map) {
+  // This is an estimate: the standard library doesn't expose the size of its
+  // bucket array and node allocations, but they are typically one pointer per
+  // bucket and one heap-allocated node per entry.
+  return map.bucket_count() * sizeof(void *) +
+    map.size() * (sizeof(std::pair<const Key, Value>) + sizeof(void *));
+}
+
+MarkerIndex::MemoryUsage MarkerIndex::get_memory_usage() const {
+  MemoryUsage result{};
+  result.marker_id_set_bytes = exclusive_marker_ids.capacity() * sizeof(MarkerId);
+  result.hash_table_bytes =
+    get_hash_table_memory_usage(start_nodes_by_id) +
+    get_hash_table_memory_usage(end_nodes_by_id) +
+    get_hash_table_memory_usage(node_position_cache);
+
+  std::vector<const Node *> nodes_to_visit;
+  if (root) nodes_to_visit.push_back(root);
+  while (!nodes_to_visit.empty()) {
+    const Node *node = nodes_to_visit.back();
+    nodes_to_visit.pop_back();
+    if (node->left) nodes_to_visit.push_back(node->left);
+    if (node->right) nodes_to_visit.push_back(node->right);
+
+    result.node_count++;
+    result.node_bytes += sizeof(Node);
+    result.marker_id_set_bytes += (
+      node->left_marker_ids.capacity() +
+      node->right_marker_ids.capacity() +
+      node->start_marker_ids.capacity() +
+      node->end_marker_ids.capacity()
+    ) * sizeof(MarkerId);
+  }
+
+  return result;
+}
+
+void MarkerIndex::trim_memory() {
+  node_position_cache.clear();
+  node_position_cache.rehash(0);
+  start_nodes_by_id.rehash(0);
+  end_nodes_by_id.rehash(0);
+  exclusive_marker_ids.shrink_to_fit();
+
+  std::vector<Node *> nodes_to_visit;
+  if (root) nodes_to_visit.push_back(root);
+  while (!nodes_to_visit.empty()) {
+    Node *node = nodes_to_visit.back();
+    nodes_to_visit.pop_back();
+    if (node->left) nodes_to_visit.push_back(node->left);
+    if (node->right) nodes_to_visit.push_back(node->right);
+    node->left_marker_ids.shrink_to_fit();
+    node->right_marker_ids.shrink_to_fit();
+    node->start_marker_ids.shrink_to_fit();
+    node->end_marker_ids.shrink_to_fit();
+  }
+}
+
 Point MarkerIndex::get_node_position(const Node *node) const {
   auto cache_entry = node_position_cache.find(node);
   if (cache_entry == node_position_cache.end()) {
@@ -30,6 +30,13 @@ public:
     std::vector<Boundary> boundaries;
   };
 
+  struct MemoryUsage {
+    size_t node_count;
+    size_t node_bytes;
+    size_t marker_id_set_bytes;
+    size_t hash_table_bytes;
+  };
+
   MarkerIndex(unsigned seed = 0u);
   ~MarkerIndex();
   int generate_random_number();
@@ -53,6 +60,8 @@ public:
   BoundaryQueryResult find_boundaries_after(Point start, size_t max_count);
 
   std::unordered_map<MarkerId, Range> dump();
+  MemoryUsage get_memory_usage() const;
+  void trim_memory();
 
 private:
   friend class Iterator;
@@ -1,16 +1,61 @@
 #ifndef SUPERSTRING_OPTIONAL_H
 #define SUPERSTRING_OPTIONAL_H
 
+#include <new>
 #include <utility>
 
+// The value is only constructed when present, so an empty optional never
+// allocates, even when a default-constructed `T` would.
 template <typename T> class optional {
-  T value;
+  union {
+    T value;
+  };
   bool is_some;
 
 public:
   optional(T &&value) : value(std::move(value)), is_some(true) {}
   optional(const T &value) : value(value), is_some(true) {}
-  optional() : value(T()), is_some(false) {}
+  optional() : is_some(false) {}
+
+  optional(optional &&other) : is_some(other.is_some) {
+    if (is_some) new (&value) T(std::move(other.value));
+  }
+
+  optional(const optional &other) : is_some(other.is_some) {
+    if (is_some) new (&value) T(other.value);
+  }
+
+  ~optional() {
+    if (is_some) value.~T();
+  }
+
+  optional &operator=(optional &&other) {
+    if (is_some && other.is_some) {
+      value = std::move(other.value);
+    } else if (other.is_some) {
+      new (&value) T(std::move(other.value));
+      is_some = true;
+    } else if (is_some) {
+      value.~T();
+      is_some = false;
+    }
+    return *this;
+  }
+
+  optional &operator=(const optional &other) {
+    if (this != &other) {
+      if (is_some && other.is_some) {
+        value = other.value;
+      } else if (other.is_some) {
+        new (&value) T(other.value);
+        is_some = true;
+      } else if (is_some) {
+        value.~T();
+        is_some = false;
+      }
+    }
+    return *this;
+  }
 
   T &operator*() { return value; }
   const T &operator*() const { return value; }
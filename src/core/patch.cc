@@ -2,22 +2,145 @@
 #include "optional.h"
 #include "text.h"
 #include "text-slice.h"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <cmath>
 #include <memory>
+#include <new>
 #include <stdio.h>
 #include <sstream>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 using std::function;
 using std::move;
 using std::vector;
-using std::unique_ptr;
 using std::ostream;
 using std::endl;
 using Change = Patch::Change;
 
-static const uint32_t SERIALIZATION_VERSION = 1;
+// Version 1 stored every number as a 4-byte integer and every character as
+// two bytes. Version 2 uses varints and `Text::serialize_compact`, and
+// records whether the patch stores text. Both versions can be read, and
+// version 1 patches always store text.
+static const uint32_t LEGACY_SERIALIZATION_VERSION = 1;
+static const uint32_t SERIALIZATION_VERSION = 2;
+static const size_t MAX_NODE_SLAB_SIZE = 256;
+static const uint32_t MAX_MERGED_CHANGE_COUNT_RATIO = 16;
+static const size_t COMPOSITION_RUN_CHANGE_COUNT = 4096;
+
+enum NodeFlags : uint32_t { HasOldText = 1, HasNewText = 2 };
+enum PatchFlags : uint32_t { StoresText = 1 };
+
+// A change's text is either owned by its node or shared with other patches
+// and buffers. Shared texts are immutable, so sharing them lets a patch refer
+// to a large deletion or a reloaded file without copying it. Nodes that need
+// to modify a shared text call `make_mutable` to take a private copy first.
+struct Patch::NodeText {
+  enum Kind : uint8_t { None, Owned, Shared };
+
+  union {
+    Text owned;
+    std::shared_ptr<const Text> shared;
+  };
+  Kind kind;
+
+  NodeText() : kind{None} {}
+
+  NodeText(Text &&text) : owned(move(text)), kind{Owned} {}
+
+  NodeText(optional<Text> &&text) : kind{text ? Owned : None} {
+    if (text) new (&owned) Text(move(*text));
+  }
+
+  NodeText(std::shared_ptr<const Text> text) : kind{text ? Shared : None} {
+    if (text) new (&shared) std::shared_ptr<const Text>(move(text));
+  }
+
+  NodeText(NodeText &&other) : kind{None} {
+    *this = move(other);
+  }
+
+  NodeText(const NodeText &other) : kind{None} {
+    *this = other;
+  }
+
+  ~NodeText() {
+    reset();
+  }
+
+  NodeText &operator=(NodeText &&other) {
+    if (this != &other) {
+      reset();
+      if (other.kind == Owned) new (&owned) Text(move(other.owned));
+      if (other.kind == Shared) new (&shared) std::shared_ptr<const Text>(move(other.shared));
+      kind = other.kind;
+    }
+    return *this;
+  }
+
+  NodeText &operator=(const NodeText &other) {
+    if (this != &other) {
+      reset();
+      if (other.kind == Owned) new (&owned) Text(other.owned);
+      if (other.kind == Shared) new (&shared) std::shared_ptr<const Text>(other.shared);
+      kind = other.kind;
+    }
+    return *this;
+  }
+
+  void reset() {
+    if (kind == Owned) owned.~Text();
+    if (kind == Shared) shared.~shared_ptr();
+    kind = None;
+  }
+
+  explicit operator bool() const {
+    return kind != None;
+  }
+
+  const Text &operator*() const {
+    return kind == Owned ? owned : *shared;
+  }
+
+  const Text *operator->() const {
+    return &**this;
+  }
+
+  // Changes expose their texts as mutable pointers, but they are only read.
+  Text *get() const {
+    return kind == None ? nullptr : const_cast<Text *>(&**this);
+  }
+
+  Text &make_mutable() {
+    if (kind == Shared) {
+      Text copy{*shared};
+      shared.~shared_ptr();
+      new (&owned) Text(move(copy));
+      kind = Owned;
+    }
+    return owned;
+  }
+
+  void shrink_to_fit() {
+    if (kind == Owned) owned.shrink_to_fit();
+  }
+
+  size_t owned_memory_usage() const {
+    return kind == Owned ? owned.memory_usage() : 0;
+  }
+};
+
+// In a patch that stores text, each node's texts are placed right after the
+// node in its slab, so that patches that only track coordinates don't pay
+// for them.
+struct Patch::NodeTexts {
+  NodeText old_text;
+  NodeText new_text;
+};
 
 struct Patch::Node {
   Node *left;
@@ -29,22 +152,23 @@ struct Patch::Node {
   Point old_distance_from_left_ancestor;
   Point new_distance_from_left_ancestor;
 
-  unique_ptr<Text> old_text;
-  unique_ptr<Text> new_text;
   uint32_t old_text_size_;
 
   uint32_t old_subtree_text_size;
   uint32_t new_subtree_text_size;
 
+  bool has_texts;
+
   Node(
+    bool has_texts,
     Node *left,
     Node *right,
     Point old_extent,
     Point new_extent,
     Point old_distance_from_left_ancestor,
     Point new_distance_from_left_ancestor,
-    unique_ptr<Text> &&old_text,
-    unique_ptr<Text> &&new_text,
+    NodeText &&old_text,
+    NodeText &&new_text,
     uint32_t old_text_size
   ) :
     left{left},
@@ -53,33 +177,65 @@ struct Patch::Node {
     new_extent{new_extent},
     old_distance_from_left_ancestor{old_distance_from_left_ancestor},
     new_distance_from_left_ancestor{new_distance_from_left_ancestor},
-    old_text{std::move(old_text)},
-    new_text{std::move(new_text)},
-    old_text_size_{old_text_size} {
+    has_texts{has_texts} {
+    if (has_texts) {
+      old_text_size_ = old_text ? 0 : old_text_size;
+      new (texts()) NodeTexts{std::move(old_text), std::move(new_text)};
+    } else {
+      old_text_size_ = old_text ? old_text->size() : old_text_size;
+    }
     compute_subtree_text_sizes();
   }
 
-  Node(Deserializer &input) :
-    left{nullptr},
-    right{nullptr},
-    old_extent{input},
-    new_extent{input},
-    old_distance_from_left_ancestor{input},
-    new_distance_from_left_ancestor{input} {
+  ~Node() {
+    if (has_texts) texts()->~NodeTexts();
+  }
 
-    if (input.read<uint32_t>()) {
-      old_text = unique_ptr<Text>{new Text{input}};
-      old_text_size_ = 0;
-    } else {
-      old_text = nullptr;
-      old_text_size_ = input.read<uint32_t>();
-    }
+  static Node *deserialize(Deserializer &input, uint32_t version, Patch &patch) {
+    Point old_extent, new_extent, old_distance_from_left_ancestor, new_distance_from_left_ancestor;
+    optional<Text> old_text, new_text;
+    uint32_t old_text_size = 0;
 
-    if (input.read<uint32_t>()) {
-      new_text = unique_ptr<Text>{new Text{input}};
+    if (version == LEGACY_SERIALIZATION_VERSION) {
+      old_extent = Point{input};
+      new_extent = Point{input};
+      old_distance_from_left_ancestor = Point{input};
+      new_distance_from_left_ancestor = Point{input};
+      if (input.read<uint32_t>()) {
+        old_text = Text{input};
+      } else {
+        old_text_size = input.read<uint32_t>();
+      }
+      if (input.read<uint32_t>()) {
+        new_text = Text{input};
+      }
     } else {
-      new_text = nullptr;
+      old_extent = Point::deserialize_compact(input);
+      new_extent = Point::deserialize_compact(input);
+      old_distance_from_left_ancestor = Point::deserialize_compact(input);
+      new_distance_from_left_ancestor = Point::deserialize_compact(input);
+      uint32_t flags = input.read_varint<uint32_t>();
+      if (flags & HasOldText) {
+        old_text = Text::deserialize_compact(input);
+      } else {
+        old_text_size = input.read_varint<uint32_t>();
+      }
+      if (flags & HasNewText) {
+        new_text = Text::deserialize_compact(input);
+      }
     }
+
+    return patch.new_node(
+      nullptr,
+      nullptr,
+      old_extent,
+      new_extent,
+      old_distance_from_left_ancestor,
+      new_distance_from_left_ancestor,
+      move(old_text),
+      move(new_text),
+      old_text_size
+    );
   }
 
   void compute_subtree_text_sizes() {
@@ -89,17 +245,29 @@ struct Patch::Node {
       new_text_size() + left_subtree_new_text_size() + right_subtree_new_text_size();
   }
 
-  void set_old_text(optional<Text> &&text, uint32_t old_text_size) {
-    if (text) {
-      old_text = unique_ptr<Text>{new Text{move(*text)}};
-      old_text_size_ = 0;
+  NodeTexts *texts() {
+    return has_texts ? reinterpret_cast<NodeTexts *>(this + 1) : nullptr;
+  }
+
+  const NodeTexts *texts() const {
+    return has_texts ? reinterpret_cast<const NodeTexts *>(this + 1) : nullptr;
+  }
+
+  void set_old_text(NodeText &&text, uint32_t old_text_size) {
+    if (has_texts) {
+      old_text_size_ = text ? 0 : old_text_size;
+      texts()->old_text = move(text);
     } else {
-      old_text = nullptr;
-      old_text_size_ = old_text_size;
+      old_text_size_ = text ? text->size() : old_text_size;
     }
   }
 
+  Text *get_old_text() const {
+    return has_texts ? texts()->old_text.get() : nullptr;
+  }
+
   uint32_t old_text_size() const {
+    const Text *old_text = get_old_text();
     return old_text ? old_text->size() : old_text_size_;
   }
 
@@ -111,18 +279,24 @@ struct Patch::Node {
     return right ? right->old_subtree_text_size : 0;
   }
 
-  void set_new_text(optional<Text> &&text) {
-    if (text) {
-      new_text = unique_ptr<Text>{new Text{move(*text)}};
-    } else {
-      new_text = nullptr;
-    }
+  void set_new_text(NodeText &&text) {
+    if (has_texts) texts()->new_text = move(text);
+  }
+
+  Text *get_new_text() const {
+    return has_texts ? texts()->new_text.get() : nullptr;
   }
 
   uint32_t new_text_size() const {
+    const Text *new_text = get_new_text();
     return new_text ? new_text->size() : 0;
   }
 
+  bool is_noop() const {
+    const Text *old_text = get_old_text(), *new_text = get_new_text();
+    return old_text && new_text && *old_text == *new_text;
+  }
+
   uint32_t left_subtree_new_text_size() const {
     return left ? left->new_subtree_text_size : 0;
   }
@@ -144,58 +318,56 @@ struct Patch::Node {
     }
   }
 
-  Node *copy() {
-    auto result = new Node{
+  Node *copy(Patch &patch) {
+    auto result = patch.new_node(
       left,
       right,
       old_extent,
       new_extent,
       old_distance_from_left_ancestor,
       new_distance_from_left_ancestor,
-      old_text ? unique_ptr<Text>(new Text(*old_text)) : nullptr,
-      new_text ? unique_ptr<Text>(new Text(*new_text)) : nullptr,
-      old_text_size_,
-    };
+      has_texts ? NodeText{texts()->old_text} : NodeText{},
+      has_texts ? NodeText{texts()->new_text} : NodeText{},
+      old_text_size_
+    );
     result->old_subtree_text_size = old_subtree_text_size;
     result->new_subtree_text_size = new_subtree_text_size;
     return result;
   }
 
-  Node *invert() {
-    auto result = new Node{
+  Node *invert(Patch &patch) {
+    auto result = patch.new_node(
       left,
       right,
       new_extent,
       old_extent,
       new_distance_from_left_ancestor,
       old_distance_from_left_ancestor,
-      new_text ? unique_ptr<Text>(new Text(*new_text)) : nullptr,
-      old_text ? unique_ptr<Text>(new Text(*old_text)) : nullptr,
-      new_text ? new_text->size() : 0
-    };
+      has_texts ? NodeText{texts()->new_text} : NodeText{},
+      has_texts ? NodeText{texts()->old_text} : NodeText{},
+      new_text_size()
+    );
     result->old_subtree_text_size = new_subtree_text_size;
     result->new_subtree_text_size = old_subtree_text_size;
     return result;
   }
 
   void serialize(Serializer &output) const {
-    old_extent.serialize(output);
-    new_extent.serialize(output);
-    old_distance_from_left_ancestor.serialize(output);
-    new_distance_from_left_ancestor.serialize(output);
+    old_extent.serialize_compact(output);
+    new_extent.serialize_compact(output);
+    old_distance_from_left_ancestor.serialize_compact(output);
+    new_distance_from_left_ancestor.serialize_compact(output);
+    const Text *old_text = get_old_text(), *new_text = get_new_text();
+    uint32_t flags = 0;
+    if (old_text) flags |= HasOldText;
+    if (new_text) flags |= HasNewText;
+    output.append_varint(flags);
     if (old_text) {
-      output.append<uint32_t>(1);
-      old_text->serialize(output);
+      old_text->serialize_compact(output);
     } else {
-      output.append<uint32_t>(0);
-      output.append<uint32_t>(old_text_size_);
-    }
-    if (new_text) {
-      output.append<uint32_t>(1);
-      new_text->serialize(output);
-    } else {
-      output.append<uint32_t>(0);
+      output.append_varint(old_text_size_);
     }
+    if (new_text) new_text->serialize_compact(output);
   }
 
   void write_dot_graph(std::stringstream &result, Point left_ancestor_old_end, Point left_ancestor_new_end) {
@@ -210,6 +382,7 @@ struct Patch::Node {
       << "old range: " << node_old_start << " - " << node_old_end << ", " << endl
       << "new text: ";
 
+    const Text *old_text = get_old_text(), *new_text = get_new_text();
     if (new_text) {
       result << "\\\"" << *new_text << "\\\"" << endl;
     } else {
@@ -315,64 +488,79 @@ struct Patch::NewCoordinates {
 
 // Construction and destruction
 
-Patch::Patch(bool merges_adjacent_changes)
-  : root{nullptr}, change_count{0}, merges_adjacent_changes{merges_adjacent_changes} {}
+Patch::Patch(bool merges_adjacent_changes, bool stores_text)
+  : root{nullptr}, change_count{0}, merges_adjacent_changes{merges_adjacent_changes},
+    stores_text{stores_text}, node_capacity{0} {}
 
 Patch::Patch(Patch &&other)
   : root{nullptr}, change_count{other.change_count},
-    merges_adjacent_changes{other.merges_adjacent_changes} {
+    merges_adjacent_changes{other.merges_adjacent_changes}, stores_text{true},
+    node_capacity{0} {
   *this = move(other);
 }
 
-Patch::Patch(Node *root, uint32_t change_count, bool merges_adjacent_changes)
-  : root{root}, change_count{change_count},
-    merges_adjacent_changes{merges_adjacent_changes} {}
-
 enum Transition : uint32_t { None, Left, Right, Up };
 
 Patch::Patch(Deserializer &input) :
   root{nullptr},
   change_count{0},
-  merges_adjacent_changes{true} {
-  uint32_t serialization_version = input.read<uint32_t>();
-  if (serialization_version != SERIALIZATION_VERSION) return;
+  merges_adjacent_changes{true},
+  stores_text{true},
+  node_capacity{0} {
+  uint32_t version = input.read<uint32_t>();
+  if (version != SERIALIZATION_VERSION && version != LEGACY_SERIALIZATION_VERSION) return;
+  bool is_legacy = version == LEGACY_SERIALIZATION_VERSION;
+  if (!is_legacy) stores_text = input.read_varint<uint32_t>() & StoresText;
+  auto read_transition = [&input, is_legacy]() -> uint32_t {
+    return is_legacy ? input.read<uint32_t>() : input.read<uint8_t>();
+  };
 
-  change_count = input.read<uint32_t>();
-  if (change_count == 0) return;
+  uint32_t count = is_legacy ? input.read<uint32_t>() : input.read_varint<uint32_t>();
+  if (count == 0) return;
 
-  node_stack.reserve(change_count);
-  root = new Node(input);
+  change_count = count;
+  node_stack.reserve(count);
+  root = Node::deserialize(input, version, *this);
   Node *node = root, *next_node = nullptr;
 
-  for (uint32_t i = 1; i < change_count;) {
-    switch (input.read<uint32_t>()) {
+  for (uint32_t i = 1; i < count;) {
+    switch (read_transition()) {
     case Left:
-      next_node = new Node(input);
+      next_node = Node::deserialize(input, version, *this);
       node->left = next_node;
       node_stack.push_back(node);
       node = next_node;
       i++;
       break;
     case Right:
-      next_node = new Node(input);
+      next_node = Node::deserialize(input, version, *this);
       node->right = next_node;
       node_stack.push_back(node);
       node = next_node;
       i++;
       break;
     case Up:
+      if (node_stack.empty()) {
+        delete_node(&root);
+        change_count = 0;
+        return;
+      }
       node->compute_subtree_text_sizes();
       node = node_stack.back();
       node_stack.pop_back();
       break;
     default:
-      delete root;
+      delete_node(&root);
+      change_count = 0;
       return;
     }
   }
 
+  // The serialization climbs back to the root after the last node. Consume
+  // those transitions too, so that any data following the patch can be read.
   node->compute_subtree_text_sizes();
   for (auto iter = node_stack.rbegin(); iter != node_stack.rend(); ++iter) {
+    read_transition();
     (*iter)->compute_subtree_text_sizes();
   }
 }
@@ -382,17 +570,62 @@ Patch &Patch::operator=(Patch &&other) {
   std::swap(left_ancestor_stack, other.left_ancestor_stack);
   std::swap(node_stack, other.node_stack);
   std::swap(change_count, other.change_count);
+  std::swap(free_nodes, other.free_nodes);
+  std::swap(node_slabs, other.node_slabs);
+  std::swap(node_capacity, other.node_capacity);
+  std::swap(stores_text, other.stores_text);
   merges_adjacent_changes = other.merges_adjacent_changes;
   return *this;
 }
 
 Patch::~Patch() {
   if (root) delete_node(&root);
+  release_node_slabs();
+}
+
+// Nodes are carved out of slabs owned by the patch, and deleted nodes are
+// kept on a free list for reuse, so that a burst of small edits doesn't hit
+// the general-purpose allocator for every change. Each slab is as large as
+// all of the previous ones combined, up to a limit.
+template <typename... Args>
+Patch::Node *Patch::new_node(Args &&... args) {
+  if (free_nodes.empty()) {
+    size_t slab_size = std::min(std::max<size_t>(node_capacity, 1), MAX_NODE_SLAB_SIZE);
+    char *slab = static_cast<char *>(::operator new(slab_size * node_size()));
+    node_slabs.push_back(slab);
+    node_capacity += slab_size;
+    for (size_t i = slab_size; i > 0; i--) {
+      free_nodes.push_back(reinterpret_cast<Node *>(slab + (i - 1) * node_size()));
+    }
+  }
+
+  Node *result = free_nodes.back();
+  free_nodes.pop_back();
+  return new (result) Node{stores_text, std::forward<Args>(args)...};
+}
+
+size_t Patch::node_size() const {
+  return stores_text ? sizeof(Node) + sizeof(NodeTexts) : sizeof(Node);
+}
+
+void Patch::free_node(Node *node) {
+  node->~Node();
+  free_nodes.push_back(node);
+}
+
+void Patch::release_node_slabs() {
+  for (void *slab : node_slabs) ::operator delete(slab);
+  node_slabs.clear();
+  free_nodes.clear();
+  node_capacity = 0;
 }
 
 void Patch::serialize(Serializer &output) {
   output.append(SERIALIZATION_VERSION);
-  output.append(change_count);
+  uint32_t flags = 0;
+  if (stores_text) flags |= StoresText;
+  output.append_varint(flags);
+  output.append_varint(change_count);
 
   if (!root) return;
   root->serialize(output);
@@ -403,19 +636,19 @@ void Patch::serialize(Serializer &output) {
 
   while (node) {
     if (node->left && previous_node_child_index < 0) {
-      output.append<uint32_t>(Left);
+      output.append<uint8_t>(Left);
       node->left->serialize(output);
       node_stack.push_back(node);
       node = node->left;
       previous_node_child_index = -1;
     } else if (node->right && previous_node_child_index < 1) {
-      output.append<uint32_t>(Right);
+      output.append<uint8_t>(Right);
       node->right->serialize(output);
       node_stack.push_back(node);
       node = node->right;
       previous_node_child_index = -1;
     } else if (!node_stack.empty()) {
-      output.append<uint32_t>(Up);
+      output.append<uint8_t>(Up);
       Node *parent = node_stack.back();
       node_stack.pop_back();
       previous_node_child_index = (node == parent->left) ? 0 : 1;
@@ -427,51 +660,342 @@ void Patch::serialize(Serializer &output) {
 }
 
 Patch Patch::copy() {
-  Node *new_root = nullptr;
+  Patch result{merges_adjacent_changes, stores_text};
   if (root) {
-    new_root = root->copy();
+    result.root = root->copy(result);
     node_stack.clear();
-    node_stack.push_back(new_root);
+    node_stack.push_back(result.root);
 
     while (!node_stack.empty()) {
       Node *node = node_stack.back();
       node_stack.pop_back();
       if (node->left) {
-        node->left = node->left->copy();
+        node->left = node->left->copy(result);
         node_stack.push_back(node->left);
       }
       if (node->right) {
-        node->right = node->right->copy();
+        node->right = node->right->copy(result);
         node_stack.push_back(node->right);
       }
     }
   }
 
-  return Patch{new_root, change_count, merges_adjacent_changes};
+  result.change_count = change_count;
+  return result;
 }
 
 Patch Patch::invert() {
-  Node *inverted_root = nullptr;
+  Patch result{merges_adjacent_changes, stores_text};
   if (root) {
-    inverted_root = root->invert();
+    result.root = root->invert(result);
     node_stack.clear();
-    node_stack.push_back(inverted_root);
+    node_stack.push_back(result.root);
 
     while (!node_stack.empty()) {
       Node *node = node_stack.back();
       node_stack.pop_back();
       if (node->left) {
-        node->left = node->left->invert();
+        node->left = node->left->invert(result);
         node_stack.push_back(node->left);
       }
       if (node->right) {
-        node->right = node->right->invert();
+        node->right = node->right->invert(result);
         node_stack.push_back(node->right);
       }
     }
   }
 
-  return Patch{inverted_root, change_count, merges_adjacent_changes};
+  result.change_count = change_count;
+  return result;
+}
+
+// A change that is about to be added to a tree, along with its position.
+// Changes that are taken unchanged from an existing tree refer to their node
+// until the tree is rebuilt, so that their texts can be moved, not copied.
+struct Patch::PendingChange {
+  Point old_start;
+  Point old_end;
+  Point new_start;
+  Point new_end;
+  Node *node;
+  NodeText old_text;
+  NodeText new_text;
+  uint32_t old_text_size_;
+
+  const Text *get_old_text() const {
+    return node ? node->get_old_text() : old_text.get();
+  }
+
+  const Text *get_new_text() const {
+    return node ? node->get_new_text() : new_text.get();
+  }
+
+  uint32_t old_text_size() const {
+    if (node) return node->old_text_size();
+    return old_text ? old_text->size() : old_text_size_;
+  }
+};
+
+// The texts that a patch shares with others, by address, so that changes
+// copied out of the patch can keep sharing them.
+struct Patch::SharedTexts {
+  std::unordered_map<const Text *, std::shared_ptr<const Text>> texts;
+
+  SharedTexts(const Patch &patch) {
+    vector<const Node *> nodes_to_visit;
+    if (patch.root) nodes_to_visit.push_back(patch.root);
+    while (!nodes_to_visit.empty()) {
+      const Node *node = nodes_to_visit.back();
+      nodes_to_visit.pop_back();
+      if (node->left) nodes_to_visit.push_back(node->left);
+      if (node->right) nodes_to_visit.push_back(node->right);
+      const NodeTexts *node_texts = node->texts();
+      if (!node_texts) continue;
+      if (node_texts->old_text.kind == NodeText::Shared) texts[node_texts->old_text.shared.get()] = node_texts->old_text.shared;
+      if (node_texts->new_text.kind == NodeText::Shared) texts[node_texts->new_text.shared.get()] = node_texts->new_text.shared;
+    }
+  }
+
+  NodeText get(const Text *text) const {
+    if (!text) return NodeText{};
+    auto iter = texts.find(text);
+    if (iter != texts.end()) return NodeText{iter->second};
+    return NodeText{Text{*text}};
+  }
+};
+
+// Builds a balanced tree from the given changes, which must be sorted and must
+// not overlap. This takes linear time, whereas splicing each change in turn
+// would splay the tree every time.
+Patch Patch::from_sorted_changes(vector<SortedChange> &&changes,
+                                 bool merges_adjacent_changes, bool stores_text) {
+  Patch result{merges_adjacent_changes, stores_text};
+
+  size_t count = 0;
+  for (size_t i = 0; i < changes.size(); i++) {
+    SortedChange &change = changes[i];
+    if (change.old_extent.is_zero() && change.new_extent.is_zero()) continue;
+
+    if (count > 0) {
+      SortedChange &previous_change = changes[count - 1];
+      Point previous_new_end = previous_change.new_start.traverse(previous_change.new_extent);
+      assert(change.new_start >= previous_new_end);
+
+      if (merges_adjacent_changes && change.new_start == previous_new_end) {
+        if (previous_change.old_text && change.old_text) {
+          previous_change.old_text->append(*change.old_text);
+        } else {
+          previous_change.old_text_size =
+            (previous_change.old_text ? previous_change.old_text->size() : previous_change.old_text_size) +
+            (change.old_text ? change.old_text->size() : change.old_text_size);
+          previous_change.old_text = optional<Text>{};
+        }
+        if (previous_change.new_text && change.new_text) {
+          previous_change.new_text->append(*change.new_text);
+        } else {
+          previous_change.new_text = optional<Text>{};
+        }
+        previous_change.old_extent = previous_change.old_extent.traverse(change.old_extent);
+        previous_change.new_extent = previous_change.new_extent.traverse(change.new_extent);
+        continue;
+      }
+    }
+
+    if (count != i) changes[count] = move(change);
+    count++;
+  }
+  changes.erase(changes.begin() + count, changes.end());
+
+  vector<PendingChange> pending_changes;
+  pending_changes.reserve(count);
+  Point old_end, new_end;
+  for (SortedChange &change : changes) {
+    Point old_start = old_end.traverse(change.new_start.traversal(new_end));
+    old_end = old_start.traverse(change.old_extent);
+    new_end = change.new_start.traverse(change.new_extent);
+    pending_changes.push_back({
+      old_start,
+      old_end,
+      change.new_start,
+      new_end,
+      nullptr,
+      move(change.old_text),
+      move(change.new_text),
+      change.old_text_size
+    });
+  }
+
+  result.build_tree(pending_changes);
+  return result;
+}
+
+// Replaces the tree with a balanced one containing the given changes, which
+// must be sorted and must not overlap.
+void Patch::build_tree(vector<PendingChange> &changes) {
+  for (PendingChange &change : changes) {
+    if (change.node) {
+      change.old_text_size_ = change.node->old_text_size_;
+      if (NodeTexts *texts = change.node->texts()) {
+        change.old_text = move(texts->old_text);
+        change.new_text = move(texts->new_text);
+      }
+      change.node = nullptr;
+    }
+  }
+
+  if (root) delete_node(&root);
+  root = build_subtree(changes, 0, changes.size(), Point(), Point());
+  change_count = changes.size();
+}
+
+Patch::Node *Patch::build_subtree(vector<PendingChange> &changes,
+                                  size_t start, size_t end,
+                                  Point left_ancestor_old_end,
+                                  Point left_ancestor_new_end) {
+  if (start == end) return nullptr;
+
+  size_t middle = start + (end - start) / 2;
+  PendingChange &change = changes[middle];
+  uint32_t old_text_size = change.old_text ? 0 : change.old_text_size_;
+  Node *node = new_node(
+    nullptr,
+    nullptr,
+    change.old_end.traversal(change.old_start),
+    change.new_end.traversal(change.new_start),
+    change.old_start.traversal(left_ancestor_old_end),
+    change.new_start.traversal(left_ancestor_new_end),
+    move(change.old_text),
+    move(change.new_text),
+    old_text_size
+  );
+
+  node->left = build_subtree(
+    changes, start, middle,
+    left_ancestor_old_end, left_ancestor_new_end
+  );
+  node->right = build_subtree(
+    changes, middle + 1, end,
+    change.old_end, change.new_end
+  );
+  node->compute_subtree_text_sizes();
+  return node;
+}
+
+// Rebases this patch over another patch with the same old text, returning
+// a patch that applies to the other patch's new text. Old text that both
+// patches replace is only deleted once, and each patch's inserted text keeps
+// its place relative to the old text, so transforming two patches over each
+// other with opposite tie breaks yields patches that produce the same text.
+Patch Patch::transform(const Patch &other, TieBreak tie_break) const {
+  vector<Change> changes = get_changes();
+  vector<Change> other_changes = other.get_changes();
+  vector<SortedChange> transformed_changes;
+
+  // The ends of the last transformed change, for positioning the next one.
+  Point transformed_old_end, transformed_new_end;
+  auto add_change = [&](Point old_start, Point old_extent, Point new_extent,
+                        optional<Text> &&old_text, optional<Text> &&new_text,
+                        uint32_t old_text_size) {
+    Point new_start = transformed_new_end.traverse(old_start.traversal(transformed_old_end));
+    transformed_old_end = old_start.traverse(old_extent);
+    transformed_new_end = new_start.traverse(new_extent);
+    transformed_changes.push_back({
+      new_start, old_extent, new_extent, move(old_text), move(new_text), old_text_size
+    });
+  };
+
+  // The ends of the other patch's last change before the current change,
+  // for translating old positions into the other patch's new text.
+  size_t other_index = 0;
+  Point other_old_end, other_new_end;
+
+  for (const Change &change : changes) {
+    Point start = change.old_start;
+    Point end = change.old_end;
+    Point new_extent = change.new_end.traversal(change.new_start);
+
+    while (other_index < other_changes.size() && other_changes[other_index].old_end < start) {
+      other_old_end = other_changes[other_index].old_end;
+      other_new_end = other_changes[other_index].new_end;
+      other_index++;
+    }
+
+    // The new text goes after the other patch's text for changes that start
+    // earlier, and before or after it for changes that start at the same
+    // position, depending on the tie break.
+    Point insertion_old_end = other_old_end;
+    Point insertion_new_end = other_new_end;
+    for (size_t i = other_index; i < other_changes.size(); i++) {
+      const Change &other_change = other_changes[i];
+      if (other_change.old_start > start) break;
+      if (other_change.old_start == start && tie_break == InsertBeforeOther) break;
+      insertion_old_end = other_change.old_end;
+      insertion_new_end = other_change.new_end;
+    }
+    Point insertion_position = insertion_new_end.traverse(
+      Point::max(start, insertion_old_end).traversal(insertion_old_end)
+    );
+
+    bool inserted = false;
+    auto add_insertion = [&]() {
+      inserted = true;
+      if (new_extent.is_zero() && (!change.new_text || change.new_text->empty())) return;
+      add_change(
+        insertion_position, Point(), new_extent,
+        change.old_text ? optional<Text>{Text{}} : optional<Text>{},
+        change.new_text ? optional<Text>{Text{*change.new_text}} : optional<Text>{},
+        0
+      );
+    };
+
+    // The old text that the other patch left in place is deleted in pieces
+    // separated by the other patch's changes.
+    Point deleted_start = start;
+    Point deleted_old_end = other_old_end;
+    Point deleted_new_end = other_new_end;
+    for (size_t i = other_index;; i++) {
+      bool is_last = i == other_changes.size() || other_changes[i].old_start >= end;
+      Point deleted_end = is_last ? end : other_changes[i].old_start;
+
+      if (deleted_end > deleted_start) {
+        Point position = deleted_new_end.traverse(deleted_start.traversal(deleted_old_end));
+        Point deletion_extent = deleted_end.traversal(deleted_start);
+        optional<Text> old_text;
+        if (change.old_text) {
+          old_text = Text{TextSlice(*change.old_text).slice({
+            deleted_start.traversal(start),
+            deleted_end.traversal(start)
+          })};
+        }
+        uint32_t old_text_size = deleted_start == start && deleted_end == end ? change.old_text_size : 0;
+
+        if (!inserted && position == insertion_position) {
+          inserted = true;
+          add_change(
+            position, deletion_extent, new_extent, move(old_text),
+            change.new_text ? optional<Text>{Text{*change.new_text}} : optional<Text>{},
+            old_text_size
+          );
+        } else {
+          if (!inserted) add_insertion();
+          add_change(
+            position, deletion_extent, Point(), move(old_text),
+            change.new_text ? optional<Text>{Text{}} : optional<Text>{},
+            old_text_size
+          );
+        }
+      }
+
+      if (is_last) break;
+      deleted_start = Point::max(deleted_start, other_changes[i].old_end);
+      deleted_old_end = other_changes[i].old_end;
+      deleted_new_end = other_changes[i].new_end;
+    }
+
+    if (!inserted) add_insertion();
+  }
+
+  return from_sorted_changes(move(transformed_changes), merges_adjacent_changes, stores_text);
 }
 
 // Mutations
@@ -480,8 +1004,33 @@ bool Patch::splice(Point new_splice_start,
                    Point new_deletion_extent, Point new_insertion_extent,
                    optional<Text> &&deleted_text, optional<Text> &&inserted_text,
                    uint32_t deleted_text_size) {
+  return splice_texts(new_splice_start, new_deletion_extent, new_insertion_extent,
+                      NodeText{move(deleted_text)}, NodeText{move(inserted_text)},
+                      deleted_text_size);
+}
+
+bool Patch::splice(Point new_splice_start,
+                   Point new_deletion_extent, Point new_insertion_extent,
+                   std::shared_ptr<const Text> deleted_text,
+                   std::shared_ptr<const Text> inserted_text,
+                   uint32_t deleted_text_size) {
+  return splice_texts(new_splice_start, new_deletion_extent, new_insertion_extent,
+                      NodeText{move(deleted_text)}, NodeText{move(inserted_text)},
+                      deleted_text_size);
+}
+
+bool Patch::splice_texts(Point new_splice_start,
+                         Point new_deletion_extent, Point new_insertion_extent,
+                         NodeText &&deleted_text, NodeText &&inserted_text,
+                         uint32_t deleted_text_size) {
   if (new_deletion_extent.is_zero() && new_insertion_extent.is_zero()) return true;
 
+  if (!stores_text) {
+    if (deleted_text) deleted_text_size = deleted_text->size();
+    deleted_text.reset();
+    inserted_text.reset();
+  }
+
   if (!root) {
     root = build_node(nullptr, nullptr, new_splice_start, new_splice_start,
                      new_deletion_extent, new_insertion_extent,
@@ -497,7 +1046,7 @@ bool Patch::splice(Point new_splice_start,
 
   auto old_text_result = compute_old_text(move(deleted_text), new_splice_start, new_deletion_end);
   if (!old_text_result.second) return false;
-  optional<Text> old_text = move(old_text_result.first);
+  NodeText old_text = move(old_text_result.first);
 
   uint32_t old_text_size = 0;
   if (!old_text) {
@@ -536,9 +1085,9 @@ bool Patch::splice(Point new_splice_start,
       Point new_extent_prefix = new_splice_start.traversal(lower_bound_new_start);
       Point new_extent_suffix = upper_bound_new_end.traversal(new_deletion_end);
 
-      if (inserted_text && lower_bound->new_text && upper_bound->new_text) {
-        TextSlice new_text_prefix = TextSlice(*lower_bound->new_text).prefix(new_extent_prefix);
-        TextSlice new_text_suffix = TextSlice(*upper_bound->new_text).suffix(
+      if (inserted_text && lower_bound->get_new_text() && upper_bound->get_new_text()) {
+        TextSlice new_text_prefix = TextSlice(*lower_bound->get_new_text()).prefix(new_extent_prefix);
+        TextSlice new_text_suffix = TextSlice(*upper_bound->get_new_text()).suffix(
           new_deletion_end.traversal(upper_bound_new_start)
         );
         if (!new_text_suffix.is_valid()) return false;
@@ -546,7 +1095,7 @@ bool Patch::splice(Point new_splice_start,
           Text::concat(new_text_prefix, *inserted_text, new_text_suffix)
         );
       } else {
-        upper_bound->set_new_text(optional<Text>{});
+        upper_bound->set_new_text(NodeText{});
       }
 
       upper_bound->set_old_text(move(old_text), old_text_size);
@@ -573,14 +1122,14 @@ bool Patch::splice(Point new_splice_start,
       Point new_extent_suffix =
         upper_bound_new_end.traversal(new_deletion_end);
 
-      if (inserted_text && upper_bound->new_text) {
-        TextSlice new_text_suffix = TextSlice(*upper_bound->new_text).suffix(
+      if (inserted_text && upper_bound->get_new_text()) {
+        TextSlice new_text_suffix = TextSlice(*upper_bound->get_new_text()).suffix(
           new_deletion_end.traversal(upper_bound_new_start)
         );
         if (!new_text_suffix.is_valid()) return false;
         upper_bound->set_new_text(Text::concat(*inserted_text, new_text_suffix));
       } else {
-        upper_bound->set_new_text(optional<Text>{});
+        upper_bound->set_new_text(NodeText{});
       }
 
       upper_bound->set_old_text(move(old_text), old_text_size);
@@ -607,11 +1156,11 @@ bool Patch::splice(Point new_splice_start,
           old_deletion_end.traversal(lower_bound_old_start);
       lower_bound->new_extent =
           new_extent_prefix.traverse(new_insertion_extent);
-      if (inserted_text && lower_bound->new_text) {
-        TextSlice new_text_prefix = TextSlice(*lower_bound->new_text).prefix(new_extent_prefix);
+      if (inserted_text && lower_bound->get_new_text()) {
+        TextSlice new_text_prefix = TextSlice(*lower_bound->get_new_text()).prefix(new_extent_prefix);
         lower_bound->set_new_text(Text::concat(new_text_prefix, *inserted_text));
       } else {
-        lower_bound->set_new_text(optional<Text>{});
+        lower_bound->set_new_text(NodeText{});
       }
 
       lower_bound->set_old_text(move(old_text), old_text_size);
@@ -674,14 +1223,14 @@ bool Patch::splice(Point new_splice_start,
       (merges_adjacent_changes && new_splice_start == lower_bound_new_end);
 
     if (overlaps_lower_bound) {
-      if (inserted_text && lower_bound->new_text) {
-        TextSlice new_text_prefix = TextSlice(*lower_bound->new_text).prefix(
+      if (inserted_text && lower_bound->get_new_text()) {
+        TextSlice new_text_prefix = TextSlice(*lower_bound->get_new_text()).prefix(
           new_splice_start.traversal(lower_bound_new_start)
         );
         if (!new_text_prefix.is_valid()) return false;
         lower_bound->set_new_text(Text::concat(new_text_prefix, *inserted_text));
       } else {
-        lower_bound->set_new_text(optional<Text>{});
+        lower_bound->set_new_text(NodeText{});
       }
 
       lower_bound->set_old_text(move(old_text), old_text_size);
@@ -721,14 +1270,14 @@ bool Patch::splice(Point new_splice_start,
     }
 
     if (overlaps_upper_bound) {
-      if (inserted_text && upper_bound->new_text) {
-        TextSlice new_text_suffix = TextSlice(*upper_bound->new_text).suffix(
+      if (inserted_text && upper_bound->get_new_text()) {
+        TextSlice new_text_suffix = TextSlice(*upper_bound->get_new_text()).suffix(
           new_deletion_end.traversal(upper_bound_new_start)
         );
         if (!new_text_suffix.is_valid()) return false;
         upper_bound->set_new_text(Text::concat(*inserted_text, new_text_suffix));
       } else {
-        upper_bound->set_new_text(optional<Text>{});
+        upper_bound->set_new_text(NodeText{});
       }
 
       upper_bound->set_old_text(move(old_text), old_text_size);
@@ -847,21 +1396,23 @@ void Patch::splice_old(Point old_splice_start, Point old_deletion_extent,
 
         upper_bound->old_extent =
             lower_bound->old_extent.traverse(upper_bound->old_extent);
-        if (lower_bound->old_text && upper_bound->old_text) {
-          lower_bound->old_text->append(*upper_bound->old_text);
-          std::swap(upper_bound->old_text, lower_bound->old_text);
+        NodeTexts *lower_bound_texts = lower_bound->texts();
+        NodeTexts *upper_bound_texts = upper_bound->texts();
+        if (lower_bound->get_old_text() && upper_bound->get_old_text()) {
+          lower_bound_texts->old_text.make_mutable().append(*upper_bound_texts->old_text);
+          std::swap(upper_bound_texts->old_text, lower_bound_texts->old_text);
         } else {
-          upper_bound->old_text = nullptr;
+          if (upper_bound_texts) upper_bound_texts->old_text.reset();
           upper_bound->old_text_size_ += lower_bound->old_text_size_;
         }
 
         upper_bound->new_extent =
             lower_bound->new_extent.traverse(upper_bound->new_extent);
-        if (lower_bound->new_text && upper_bound->new_text) {
-          lower_bound->new_text->append(*upper_bound->new_text);
-          std::swap(upper_bound->new_text, lower_bound->new_text);
-        } else {
-          upper_bound->new_text = nullptr;
+        if (lower_bound->get_new_text() && upper_bound->get_new_text()) {
+          lower_bound_texts->new_text.make_mutable().append(*upper_bound_texts->new_text);
+          std::swap(upper_bound_texts->new_text, lower_bound_texts->new_text);
+        } else if (upper_bound_texts) {
+          upper_bound_texts->new_text.reset();
         }
 
         upper_bound->left = lower_bound->left;
@@ -879,30 +1430,443 @@ void Patch::splice_old(Point old_splice_start, Point old_deletion_extent,
 }
 
 bool Patch::combine(const Patch &other, bool left_to_right) {
+  SharedTexts shared_texts{other};
+
+  // Merging visits every change in both patches, whereas splicing only
+  // visits the changes in this patch that the other patch's changes affect.
+  if (change_count <= other.change_count * MAX_MERGED_CHANGE_COUNT_RATIO &&
+      merge(other, left_to_right, shared_texts)) return true;
+
   auto changes = other.get_changes();
   if (left_to_right) {
     for (auto iter = changes.begin(), end = changes.end(); iter != end; ++iter) {
-      if (!splice(iter->new_start, iter->old_end.traversal(iter->old_start),
-                  iter->new_end.traversal(iter->new_start),
-                  iter->old_text ? *iter->old_text : optional<Text>{},
-                  iter->new_text ? *iter->new_text : optional<Text>{},
-                  iter->old_text_size)) return false;
+      if (!splice_texts(iter->new_start, iter->old_end.traversal(iter->old_start),
+                        iter->new_end.traversal(iter->new_start),
+                        shared_texts.get(iter->old_text),
+                        shared_texts.get(iter->new_text),
+                        iter->old_text_size)) return false;
       remove_noop_change();
     }
   } else {
     for (auto iter = changes.rbegin(), end = changes.rend(); iter != end;
          ++iter) {
-      if (!splice(iter->old_start, iter->old_end.traversal(iter->old_start),
-                  iter->new_end.traversal(iter->new_start),
-                  iter->old_text ? *iter->old_text : optional<Text>{},
-                  iter->new_text ? *iter->new_text : optional<Text>{},
-                  iter->old_text_size)) return false;
+      if (!splice_texts(iter->old_start, iter->old_end.traversal(iter->old_start),
+                        iter->new_end.traversal(iter->new_start),
+                        shared_texts.get(iter->old_text),
+                        shared_texts.get(iter->new_text),
+                        iter->old_text_size)) return false;
       remove_noop_change();
     }
   }
   return true;
 }
 
+// Runs `task` for each index below `task_count`, spread across up to
+// `thread_count` threads including the calling one.
+template <typename Task>
+static void run_tasks(size_t task_count, size_t thread_count, const Task &task) {
+  std::atomic<size_t> next_index{0};
+  auto run = [&next_index, &task, task_count]() {
+    for (size_t i = next_index++; i < task_count; i = next_index++) task(i);
+  };
+
+  vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(thread_count, task_count); i++) threads.emplace_back(run);
+  run();
+  for (std::thread &thread : threads) thread.join();
+}
+
+// Composes the patches in order, as if combining each one into the
+// composition of the ones before it, which is what `Patch.compose` does. The
+// patches are split into contiguous runs of about
+// `COMPOSITION_RUN_CHANGE_COUNT` changes, and each run is composed by
+// combining its patches one at a time, which splices a small patch into a
+// large one cheaply. The compositions of the runs are then combined in a
+// balanced tree, where each combination merges two patches of similar size in
+// linear time. The runs, and the combinations at each level of the tree, are
+// spread across `thread_count` threads, or one thread per core if no count is
+// given. The grouping depends only on the patches, so the result is the same
+// for any thread count, and for small patches it is the same as combining
+// every patch in turn. Returns nothing if any two consecutive patches are
+// inconsistent.
+optional<Patch> Patch::compose_all(const vector<const Patch *> &patches, unsigned thread_count) {
+  if (thread_count == 0) thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+#ifdef __EMSCRIPTEN__
+  thread_count = 1;
+#endif
+
+  vector<size_t> run_starts{0};
+  size_t run_change_count = 0;
+  for (size_t i = 0; i < patches.size(); i++) {
+    if (run_change_count >= COMPOSITION_RUN_CHANGE_COUNT) {
+      run_starts.push_back(i);
+      run_change_count = 0;
+    }
+    run_change_count += patches[i]->change_count;
+  }
+  run_starts.push_back(patches.size());
+
+  size_t run_count = run_starts.size() - 1;
+  vector<Patch> compositions;
+  compositions.reserve(run_count);
+  for (size_t i = 0; i < run_count; i++) compositions.push_back(Patch{});
+
+  std::atomic<bool> failed{false};
+  run_tasks(run_count, thread_count, [&patches, &run_starts, &compositions, &failed](size_t run) {
+    bool left_to_right = true;
+    for (size_t i = run_starts[run]; i < run_starts[run + 1] && !failed; i++) {
+      if (!compositions[run].combine(*patches[i], left_to_right)) failed = true;
+      left_to_right = !left_to_right;
+    }
+  });
+  if (failed) return optional<Patch>{};
+
+  while (compositions.size() > 1) {
+    size_t pair_count = compositions.size() / 2;
+    run_tasks(pair_count, thread_count, [&compositions, &failed](size_t pair) {
+      if (!failed && !compositions[2 * pair].combine(compositions[2 * pair + 1])) failed = true;
+    });
+    if (failed) return optional<Patch>{};
+
+    size_t combined_count = 0;
+    for (size_t i = 0; i < compositions.size(); i += 2) {
+      compositions[combined_count++] = move(compositions[i]);
+    }
+    compositions.erase(compositions.begin() + combined_count, compositions.end());
+  }
+
+  return move(compositions.front());
+}
+
+optional<Patch> Patch::compose_all(vector<Patch> &&patches, unsigned thread_count) {
+  vector<const Patch *> patch_pointers;
+  patch_pointers.reserve(patches.size());
+  for (const Patch &patch : patches) patch_pointers.push_back(&patch);
+  auto result = compose_all(patch_pointers, thread_count);
+  patches.clear();
+  return result;
+}
+
+// Combines the patches in linear time by walking the changes of both in
+// order, producing exactly the changes that `combine` would produce by
+// splicing in the other patch's changes one at a time. Returns false without
+// modifying this patch if it can't guarantee that, because this patch
+// doesn't merge adjacent changes or contains adjacent or no-op changes, or
+// because the patches' texts are inconsistent.
+bool Patch::merge(const Patch &other, bool left_to_right, const SharedTexts &shared_texts) {
+  if (!merges_adjacent_changes) return false;
+
+  vector<PendingChange> changes;
+  changes.reserve(change_count);
+  node_stack.clear();
+  left_ancestor_stack.clear();
+  PositionStackEntry left_ancestor_info;
+  Node *node = root;
+  while (node || !node_stack.empty()) {
+    while (node) {
+      node_stack.push_back(node);
+      left_ancestor_stack.push_back(left_ancestor_info);
+      node = node->left;
+    }
+
+    node = node_stack.back();
+    node_stack.pop_back();
+    left_ancestor_info = left_ancestor_stack.back();
+    left_ancestor_stack.pop_back();
+
+    Point old_start = left_ancestor_info.old_end.traverse(node->old_distance_from_left_ancestor);
+    Point new_start = left_ancestor_info.new_end.traverse(node->new_distance_from_left_ancestor);
+    Point old_end = old_start.traverse(node->old_extent);
+    Point new_end = new_start.traverse(node->new_extent);
+    if (!changes.empty() && changes.back().new_end == new_start) return false;
+    if (node->is_noop()) return false;
+    changes.push_back({old_start, old_end, new_start, new_end, node, NodeText{}, NodeText{}, 0});
+
+    left_ancestor_info.old_end = old_end;
+    left_ancestor_info.new_end = new_end;
+    node = node->right;
+  }
+
+  vector<Change> other_changes = other.get_changes();
+  vector<PendingChange> result, overlapping_changes;
+  result.reserve(changes.size() + other_changes.size());
+  PendingChange spliced_change;
+
+  // Without texts, splicing can't tell that a change undoes itself.
+  auto is_noop = [this](const PendingChange &change) {
+    if (change.old_start == change.old_end && change.new_start == change.new_end) return true;
+    return stores_text && change.old_text && change.new_text && *change.old_text == *change.new_text;
+  };
+
+  if (left_to_right) {
+    // The other patch's changes are spliced at their new positions. This
+    // patch's changes that follow them are shifted accordingly.
+    size_t i = 0;
+    Point spliced_old_end, spliced_new_end;
+    auto shift = [&spliced_old_end, &spliced_new_end](Point position) {
+      return spliced_new_end.traverse(position.traversal(spliced_old_end));
+    };
+
+    for (const Change &change : other_changes) {
+      if (change.old_start == change.old_end && change.new_start == change.new_end) continue;
+
+      Point splice_start = change.new_start;
+      Point splice_end = splice_start.traverse(change.old_end.traversal(change.old_start));
+
+      while (i < changes.size() && shift(changes[i].new_end) < splice_start) {
+        changes[i].new_start = shift(changes[i].new_start);
+        changes[i].new_end = shift(changes[i].new_end);
+        result.push_back(move(changes[i++]));
+      }
+
+      overlapping_changes.clear();
+      if (!result.empty() && result.back().new_end >= splice_start) {
+        overlapping_changes.push_back(move(result.back()));
+        result.pop_back();
+      }
+      while (i < changes.size() && shift(changes[i].new_start) <= splice_end) {
+        changes[i].new_start = shift(changes[i].new_start);
+        changes[i].new_end = shift(changes[i].new_end);
+        overlapping_changes.push_back(move(changes[i++]));
+      }
+
+      if (!splice_pending_changes(overlapping_changes, result.empty() ? nullptr : &result.back(),
+                                  change, splice_start, shared_texts, spliced_change)) return false;
+      if (!is_noop(spliced_change)) result.push_back(move(spliced_change));
+
+      spliced_old_end = change.old_end;
+      spliced_new_end = change.new_end;
+    }
+
+    for (; i < changes.size(); i++) {
+      changes[i].new_start = shift(changes[i].new_start);
+      changes[i].new_end = shift(changes[i].new_end);
+      result.push_back(move(changes[i]));
+    }
+  } else {
+    // The other patch's changes are spliced at their old positions, from
+    // last to first, so this patch's changes that precede them are where
+    // they were. The result is collected in reverse.
+    size_t i = changes.size();
+    for (auto iter = other_changes.rbegin(), end = other_changes.rend(); iter != end; ++iter) {
+      const Change &change = *iter;
+      if (change.old_start == change.old_end && change.new_start == change.new_end) continue;
+
+      Point splice_start = change.old_start;
+      Point splice_end = change.old_end;
+
+      while (i > 0 && changes[i - 1].new_start > splice_end) {
+        result.push_back(move(changes[--i]));
+      }
+
+      overlapping_changes.clear();
+      size_t overlapping_start = i;
+      while (overlapping_start > 0 && changes[overlapping_start - 1].new_end >= splice_start) {
+        overlapping_start--;
+      }
+      for (size_t j = overlapping_start; j < i; j++) {
+        overlapping_changes.push_back(move(changes[j]));
+      }
+      i = overlapping_start;
+      if (!result.empty() && result.back().new_start <= splice_end) {
+        overlapping_changes.push_back(move(result.back()));
+        result.pop_back();
+      }
+
+      if (!splice_pending_changes(overlapping_changes, i > 0 ? &changes[i - 1] : nullptr,
+                                  change, splice_start, shared_texts, spliced_change)) return false;
+      if (!is_noop(spliced_change)) {
+        result.push_back(move(spliced_change));
+      } else if (!result.empty()) {
+        // The following change was positioned relative to the text that
+        // was spliced, which now matches the old text.
+        PendingChange &next_change = result.back();
+        Point new_extent = next_change.new_end.traversal(next_change.new_start);
+        next_change.new_start =
+          spliced_change.new_end.traverse(next_change.old_start.traversal(spliced_change.old_end));
+        next_change.new_end = next_change.new_start.traverse(new_extent);
+      }
+    }
+
+    while (i > 0) result.push_back(move(changes[--i]));
+    std::reverse(result.begin(), result.end());
+  }
+
+  // Only the old positions are final, because the new positions of changes
+  // that were passed over depend on the changes that were spliced later.
+  Point old_end, new_end;
+  for (PendingChange &change : result) {
+    Point new_extent = change.new_end.traversal(change.new_start);
+    change.new_start = new_end.traverse(change.old_start.traversal(old_end));
+    change.new_end = change.new_start.traverse(new_extent);
+    old_end = change.old_end;
+    new_end = change.new_end;
+  }
+
+  build_tree(result);
+  return true;
+}
+
+// Computes the change that `splice_texts` would produce when splicing the
+// given change at the given position into a patch whose changes touching
+// that range are `overlapping_changes`, and whose last change before them is
+// `previous_change`. Returns false if `splice_texts` would fail or if the
+// texts are inconsistent.
+bool Patch::splice_pending_changes(const vector<PendingChange> &overlapping_changes,
+                                   const PendingChange *previous_change,
+                                   const Change &change, Point new_splice_start,
+                                   const SharedTexts &shared_texts,
+                                   PendingChange &result) {
+  Point new_deletion_end = new_splice_start.traverse(change.old_end.traversal(change.old_start));
+  Point new_insertion_extent = change.new_end.traversal(change.new_start);
+
+  const PendingChange *lower_bound = nullptr, *upper_bound = nullptr;
+  if (!overlapping_changes.empty()) {
+    const PendingChange &first_change = overlapping_changes.front();
+    const PendingChange &last_change = overlapping_changes.back();
+    if (first_change.new_start <= new_splice_start) lower_bound = &first_change;
+    if (last_change.new_end >= new_deletion_end && last_change.new_end > new_splice_start) {
+      upper_bound = &last_change;
+    }
+  }
+
+  result.node = nullptr;
+  result.old_text = NodeText{};
+  result.new_text = NodeText{};
+  result.old_text_size_ = 0;
+
+  if (change.old_text) {
+    if (overlapping_changes.empty()) {
+      result.old_text = shared_texts.get(change.old_text);
+    } else {
+      Text old_text;
+      TextSlice deleted_text_slice = TextSlice(*change.old_text);
+      Point deleted_text_slice_start = new_splice_start;
+      bool has_old_text = true;
+      for (const PendingChange &overlapping_change : overlapping_changes) {
+        const Text *overlapping_old_text = overlapping_change.get_old_text();
+        if (!overlapping_old_text) {
+          has_old_text = false;
+          break;
+        }
+
+        if (overlapping_change.new_start > deleted_text_slice_start) {
+          auto split_result = deleted_text_slice.split(
+            overlapping_change.new_start.traversal(deleted_text_slice_start)
+          );
+          if (!split_result.first.is_valid()) return false;
+          deleted_text_slice_start = overlapping_change.new_start;
+          deleted_text_slice = split_result.second;
+          old_text.append(split_result.first);
+        }
+
+        old_text.append(*overlapping_old_text);
+        deleted_text_slice = deleted_text_slice.suffix(Point::min(
+          deleted_text_slice.extent(),
+          overlapping_change.new_end.traversal(deleted_text_slice_start)
+        ));
+        deleted_text_slice_start = overlapping_change.new_end;
+        if (!deleted_text_slice.is_valid()) return false;
+      }
+
+      if (has_old_text) {
+        old_text.append(deleted_text_slice);
+        result.old_text = move(old_text);
+      }
+    }
+  }
+
+  if (!result.old_text) {
+    result.old_text_size_ = change.old_text_size;
+    for (const PendingChange &overlapping_change : overlapping_changes) {
+      const Text *overlapping_new_text = overlapping_change.get_new_text();
+      if (!overlapping_new_text) {
+        result.old_text_size_ = 0;
+        break;
+      }
+
+      TextSlice overlapping_slice = TextSlice(*overlapping_new_text);
+      if (new_deletion_end < overlapping_change.new_end) {
+        overlapping_slice = overlapping_slice.prefix(
+          new_deletion_end.traversal(overlapping_change.new_start)
+        );
+      }
+      if (new_splice_start > overlapping_change.new_start) {
+        overlapping_slice = overlapping_slice.suffix(
+          new_splice_start.traversal(overlapping_change.new_start)
+        );
+      }
+      if (!overlapping_slice.is_valid()) return false;
+
+      result.old_text_size_ -= overlapping_slice.size();
+      result.old_text_size_ += overlapping_change.old_text_size();
+    }
+  }
+
+  if (change.new_text) {
+    if (lower_bound || upper_bound) {
+      const Text *lower_bound_new_text = lower_bound ? lower_bound->get_new_text() : nullptr;
+      const Text *upper_bound_new_text = upper_bound ? upper_bound->get_new_text() : nullptr;
+      if ((!lower_bound || lower_bound_new_text) && (!upper_bound || upper_bound_new_text)) {
+        Text new_text;
+        if (lower_bound) {
+          TextSlice new_text_prefix = TextSlice(*lower_bound_new_text).prefix(
+            new_splice_start.traversal(lower_bound->new_start)
+          );
+          if (!new_text_prefix.is_valid()) return false;
+          new_text.append(new_text_prefix);
+        }
+        new_text.append(*change.new_text);
+        if (upper_bound) {
+          TextSlice new_text_suffix = TextSlice(*upper_bound_new_text).suffix(
+            new_deletion_end.traversal(upper_bound->new_start)
+          );
+          if (!new_text_suffix.is_valid()) return false;
+          new_text.append(new_text_suffix);
+        }
+        result.new_text = move(new_text);
+      }
+    } else {
+      result.new_text = shared_texts.get(change.new_text);
+    }
+  }
+
+  if (lower_bound) {
+    result.old_start = lower_bound->old_start;
+    result.new_start = lower_bound->new_start;
+  } else if (previous_change) {
+    result.old_start = previous_change->old_end.traverse(
+      new_splice_start.traversal(previous_change->new_end)
+    );
+    result.new_start = new_splice_start;
+  } else {
+    result.old_start = new_splice_start;
+    result.new_start = new_splice_start;
+  }
+
+  if (upper_bound) {
+    result.old_end = upper_bound->old_end;
+  } else {
+    const PendingChange *last_change =
+      overlapping_changes.empty() ? previous_change : &overlapping_changes.back();
+    if (last_change) {
+      result.old_end = last_change->old_end.traverse(
+        new_deletion_end.traversal(last_change->new_end)
+      );
+    } else {
+      result.old_end = new_deletion_end;
+    }
+  }
+
+  Point new_extent_prefix = lower_bound ? new_splice_start.traversal(lower_bound->new_start) : Point();
+  Point new_extent_suffix = upper_bound ? upper_bound->new_end.traversal(new_deletion_end) : Point();
+  result.new_end = result.new_start
+    .traverse(new_extent_prefix)
+    .traverse(new_insertion_extent)
+    .traverse(new_extent_suffix);
+  return true;
+}
+
 void Patch::clear() {
   if (root) delete_node(&root);
 }
@@ -935,6 +1899,65 @@ void Patch::rebalance() {
   }
 }
 
+void Patch::trim_memory() {
+  node_stack.clear();
+  node_stack.shrink_to_fit();
+  left_ancestor_stack.clear();
+  left_ancestor_stack.shrink_to_fit();
+
+  if (!root) {
+    release_node_slabs();
+    free_nodes.shrink_to_fit();
+    node_slabs.shrink_to_fit();
+    return;
+  }
+
+  vector<Node **> node_slots{&root};
+  for (size_t i = 0; i < node_slots.size(); i++) {
+    Node *node = *node_slots[i];
+    if (node->left) node_slots.push_back(&node->left);
+    if (node->right) node_slots.push_back(&node->right);
+    if (NodeTexts *texts = node->texts()) {
+      texts->old_text.shrink_to_fit();
+      texts->new_text.shrink_to_fit();
+    }
+  }
+
+  // Freed nodes stay in their slabs until the patch is empty. When most of
+  // the capacity is unused, move the remaining nodes into new slabs and
+  // release the old ones. Children are moved before their parents, so that
+  // each node's child pointers are up to date when it is moved.
+  if (node_capacity <= 2 * node_slots.size()) return;
+
+  vector<void *> old_node_slabs;
+  old_node_slabs.swap(node_slabs);
+  free_nodes.clear();
+  free_nodes.shrink_to_fit();
+  node_capacity = 0;
+
+  for (size_t i = node_slots.size(); i > 0; i--) {
+    Node *node = *node_slots[i - 1];
+    NodeTexts *texts = node->texts();
+    Node *moved_node = new_node(
+      node->left,
+      node->right,
+      node->old_extent,
+      node->new_extent,
+      node->old_distance_from_left_ancestor,
+      node->new_distance_from_left_ancestor,
+      texts ? move(texts->old_text) : NodeText{},
+      texts ? move(texts->new_text) : NodeText{},
+      node->old_text_size_
+    );
+    moved_node->old_subtree_text_size = node->old_subtree_text_size;
+    moved_node->new_subtree_text_size = node->new_subtree_text_size;
+    node->~Node();
+    *node_slots[i - 1] = moved_node;
+  }
+
+  for (void *slab : old_node_slabs) ::operator delete(slab);
+}
+
 // Non-splaying reads
 
 vector<Change> Patch::get_changes() const {
@@ -947,6 +1970,34 @@ vector<Change> Patch::get_changes() const {
 
 size_t Patch::get_change_count() const { return change_count; }
 
+Patch::MemoryUsage Patch::get_memory_usage() const {
+  MemoryUsage result{};
+  result.stack_bytes =
+    node_stack.capacity() * sizeof(Node *) +
+    left_ancestor_stack.capacity() * sizeof(PositionStackEntry);
+  result.node_bytes =
+    node_capacity * node_size() +
+    free_nodes.capacity() * sizeof(Node *) +
+    node_slabs.capacity() * sizeof(void *);
+
+  vector<const Node *> nodes_to_visit;
+  if (root) nodes_to_visit.push_back(root);
+  while (!nodes_to_visit.empty()) {
+    const Node *node = nodes_to_visit.back();
+    nodes_to_visit.pop_back();
+    if (node->left) nodes_to_visit.push_back(node->left);
+    if (node->right) nodes_to_visit.push_back(node->right);
+
+    result.node_count++;
+    if (const NodeTexts *texts = node->texts()) {
+      result.text_bytes += texts->old_text.owned_memory_usage();
+      result.text_bytes += texts->new_text.owned_memory_usage();
+    }
+  }
+
+  return result;
+}
+
 optional<Change> Patch::get_bounds() const {
   if (!root) return optional<Change>{};
 
@@ -982,6 +2033,18 @@ vector<Change> Patch::get_changes_in_new_range(Point start, Point end) const {
   return get_changes_in_range<NewCoordinates>(start, end, false);
 }
 
+void Patch::iterate_changes(ChangeIterator &iterator) const {
+  iterator.seek<NewCoordinates>(root, Point(), Point(UINT32_MAX, UINT32_MAX), true);
+}
+
+void Patch::iterate_changes_in_old_range(ChangeIterator &iterator, Point start, Point end) const {
+  iterator.seek<OldCoordinates>(root, start, end, false);
+}
+
+void Patch::iterate_changes_in_new_range(ChangeIterator &iterator, Point start, Point end) const {
+  iterator.seek<NewCoordinates>(root, start, end, false);
+}
+
 optional<Change> Patch::get_change_starting_before_old_position(Point target) const {
   return get_change_starting_before_position<OldCoordinates>(target);
 }
@@ -994,6 +2057,59 @@ optional<Change> Patch::get_change_ending_after_new_position(Point target) const
   return get_change_ending_after_position<NewCoordinates>(target);
 }
 
+// Translates the positions in place. Walking them in order lets the changes
+// be visited once, rather than searched for each position, so positions that
+// aren't already sorted are visited through a sorted index.
+void Patch::translate_positions(Point *positions, size_t count,
+                                TranslationDirection direction,
+                                ClipDirection clip_direction) const {
+  if (count == 0 || !root) return;
+
+  vector<size_t> order;
+  if (!std::is_sorted(positions, positions + count)) {
+    order.resize(count);
+    for (size_t i = 0; i < count; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [positions](size_t a, size_t b) {
+      return positions[a] < positions[b];
+    });
+  }
+  auto position_at = [positions, &order](size_t i) -> Point & {
+    return order.empty() ? positions[i] : positions[order[i]];
+  };
+
+  bool from_old = direction == OldToNew;
+  Point first_position = position_at(0);
+  optional<Change> change = from_old ?
+    get_change_starting_before_old_position(first_position) :
+    get_change_starting_before_new_position(first_position);
+
+  ChangeIterator changes;
+  if (from_old) {
+    iterate_changes_in_old_range(changes, first_position, Point(UINT32_MAX, UINT32_MAX));
+  } else {
+    iterate_changes_in_new_range(changes, first_position, Point(UINT32_MAX, UINT32_MAX));
+  }
+  optional<Change> next_change = changes.next();
+
+  for (size_t i = 0; i < count; i++) {
+    Point &position = position_at(i);
+    while (next_change && (from_old ? next_change->old_start : next_change->new_start) <= position) {
+      change = next_change;
+      next_change = changes.next();
+    }
+    if (!change) continue;
+
+    Point start = from_old ? change->new_start : change->old_start;
+    Point end = from_old ? change->new_end : change->old_end;
+    Point source_end = from_old ? change->old_end : change->new_end;
+    if (position >= source_end) {
+      position = end.traverse(position.traversal(source_end));
+    } else {
+      position = clip_direction == ClipBackward ? start : end;
+    }
+  }
+}
+
 Point Patch::new_position_for_new_offset(uint32_t target_offset,
                                          function<uint32_t(Point)> old_offset_for_old_position,
                                          function<Point(uint32_t)> old_position_for_old_offset) const {
@@ -1030,7 +2146,7 @@ Point Patch::new_position_for_new_offset(uint32_t target_offset,
       }
     } else if (node_new_start_offset <= target_offset) {
       return node_new_start
-        .traverse(node->new_text->position_for_offset(target_offset - node_new_start_offset));
+        .traverse(node->get_new_text()->position_for_offset(target_offset - node_new_start_offset));
     } else {
       if (node->left) {
         node = node->left;
@@ -1057,6 +2173,16 @@ vector<Change> Patch::grab_changes_in_new_range(Point start, Point end) {
   return grab_changes_in_range<NewCoordinates>(start, end);
 }
 
+void Patch::grab_changes_in_old_range(ChangeIterator &iterator, Point start, Point end) {
+  if (root) splay_node_starting_before<OldCoordinates>(start);
+  iterator.seek<OldCoordinates>(root, start, end, false);
+}
+
+void Patch::grab_changes_in_new_range(ChangeIterator &iterator, Point start, Point end) {
+  if (root) splay_node_starting_before<NewCoordinates>(start);
+  iterator.seek<NewCoordinates>(root, start, end, false);
+}
+
 optional<Change> Patch::grab_change_starting_before_old_position(Point target) {
   return grab_change_starting_before_position<OldCoordinates>(target);
 }
@@ -1228,12 +2354,10 @@ void Patch::perform_rebalancing_rotations(uint32_t count) {
   }
 }
 
-std::pair<optional<Text>, bool> Patch::compute_old_text(
-  optional<Text> &&deleted_text, Point new_splice_start, Point new_deletion_end
+std::pair<Patch::NodeText, bool> Patch::compute_old_text(
+  NodeText &&deleted_text, Point new_splice_start, Point new_deletion_end
 ) {
-  if (!deleted_text) return {optional<Text>{}, true};
-
-  Text result;
+  if (!deleted_text) return {NodeText{}, true};
 
   auto overlapping_changes = grab_changes_in_range<NewCoordinates>(
     new_splice_start,
@@ -1241,17 +2365,22 @@ std::pair<optional<Text>, bool> Patch::compute_old_text(
     merges_adjacent_changes
   );
 
+  // The deleted text is all from the layer below, so it can be kept as is.
+  if (overlapping_changes.empty()) return {move(deleted_text), true};
+
+  Text result;
+
   TextSlice deleted_text_slice = TextSlice(*deleted_text);
   Point deleted_text_slice_start = new_splice_start;
 
   for (const Change &change : overlapping_changes) {
-    if (!change.old_text) return {optional<Text>{}, true};
+    if (!change.old_text) return {NodeText{}, true};
 
     if (change.new_start > deleted_text_slice_start) {
       auto split_result = deleted_text_slice.split(
         change.new_start.traversal(deleted_text_slice_start)
       );
-      if (!split_result.first.is_valid()) return {optional<Text>{}, false};
+      if (!split_result.first.is_valid()) return {NodeText{}, false};
       deleted_text_slice_start = change.new_start;
       deleted_text_slice = split_result.second;
       result.append(split_result.first);
@@ -1264,11 +2393,11 @@ std::pair<optional<Text>, bool> Patch::compute_old_text(
     ));
     deleted_text_slice_start = change.new_end;
 
-    if (!deleted_text_slice.is_valid()) return {optional<Text>{}, false};
+    if (!deleted_text_slice.is_valid()) return {NodeText{}, false};
   }
 
   result.append(deleted_text_slice);
-  return {result, true};
+  return {move(result), true};
 }
 
 uint32_t Patch::compute_old_text_size(uint32_t deleted_text_size,
@@ -1303,20 +2432,20 @@ Patch::Node *Patch::build_node(Node *left, Node *right,
                        Point old_distance_from_left_ancestor,
                        Point new_distance_from_left_ancestor,
                        Point old_extent, Point new_extent,
-                       optional<Text> &&old_text, optional<Text> &&new_text,
+                       NodeText &&old_text, NodeText &&new_text,
                        uint32_t old_text_size) {
   change_count++;
-  return new Node{
+  return new_node(
     left,
     right,
     old_extent,
     new_extent,
     old_distance_from_left_ancestor,
     new_distance_from_left_ancestor,
-    old_text ? unique_ptr<Text>{new Text(*old_text)} : nullptr,
-    new_text ? unique_ptr<Text>{new Text(*new_text)} : nullptr,
+    move(old_text),
+    move(new_text),
     old_text_size
-  };
+  );
 }
 
 void Patch::delete_node(Node **node_to_delete) {
@@ -1331,7 +2460,7 @@ void Patch::delete_node(Node **node_to_delete) {
         node_stack.push_back(node->left);
       if (node->right)
         node_stack.push_back(node->right);
-      delete node;
+      free_node(node);
       change_count--;
     }
 
@@ -1420,7 +2549,7 @@ Patch::Node *Patch::splay_node_starting_before(Point target) {
 }
 
 void Patch::remove_noop_change() {
-  if (root && root->old_text && root->new_text && *root->old_text == *root->new_text) {
+  if (root && root->is_noop()) {
     splice_old(root->old_distance_from_left_ancestor, Point(), Point());
   }
 }
@@ -1430,12 +2559,32 @@ void Patch::remove_noop_change() {
 template <typename CoordinateSpace>
 vector<Patch::Change> Patch::get_changes_in_range(Point start, Point end, bool inclusive) const {
   vector<Change> result;
+  ChangeIterator iterator;
+  iterator.seek<CoordinateSpace>(root, start, end, inclusive);
+  while (auto change = iterator.next()) {
+    result.push_back(*change);
+  }
+  return result;
+}
 
-  Node *node = root;
-  vector<Node *> node_stack;
-  vector<Patch::PositionStackEntry> left_ancestor_stack{{}};
+Patch::ChangeIterator::ChangeIterator() :
+  node{nullptr}, inclusive{false}, uses_old_coordinates{false} {}
 
-  Node *found_node = nullptr;
+Patch::ChangeIterator::~ChangeIterator() {}
+
+// Descends to the first change that ends after the start of the range,
+// keeping the ancestors that the walk will return to.
+template <typename CoordinateSpace>
+void Patch::ChangeIterator::seek(const Node *root, Point start, Point end, bool inclusive) {
+  this->end = end;
+  this->inclusive = inclusive;
+  uses_old_coordinates = std::is_same<CoordinateSpace, OldCoordinates>::value;
+  node_stack.clear();
+  left_ancestor_stack.clear();
+  left_ancestor_stack.push_back({});
+
+  const Node *node = root;
+  const Node *found_node = nullptr;
   size_t found_node_ancestor_count = 0;
   size_t found_node_left_ancestor_count = 0;
 
@@ -1473,72 +2622,73 @@ vector<Patch::Change> Patch::get_changes_in_range(Point start, Point end, bool i
     }
   }
 
-  node = found_node;
+  this->node = found_node;
   node_stack.resize(found_node_ancestor_count);
   left_ancestor_stack.resize(found_node_left_ancestor_count);
+}
 
-  while (node) {
-    PositionStackEntry &left_ancestor_info = left_ancestor_stack.back();
-    Point old_start = left_ancestor_info.old_end.traverse(
-        node->old_distance_from_left_ancestor);
-    Point new_start = left_ancestor_info.new_end.traverse(
-        node->new_distance_from_left_ancestor);
-    Point node_start = CoordinateSpace::choose(old_start, new_start);
-    if (node_start > end || (!inclusive && node_start == end)) break;
+optional<Change> Patch::ChangeIterator::next() {
+  if (!node) return optional<Change>{};
+
+  PositionStackEntry &left_ancestor_info = left_ancestor_stack.back();
+  Point old_start = left_ancestor_info.old_end.traverse(
+      node->old_distance_from_left_ancestor);
+  Point new_start = left_ancestor_info.new_end.traverse(
+      node->new_distance_from_left_ancestor);
+  Point node_start = uses_old_coordinates ? old_start : new_start;
+  if (node_start > end || (!inclusive && node_start == end)) {
+    node = nullptr;
+    return optional<Change>{};
+  }
 
-    Point old_end = old_start.traverse(node->old_extent);
-    Point new_end = new_start.traverse(node->new_extent);
-    Text *old_text = node->old_text.get();
-    Text *new_text = node->new_text.get();
-    uint32_t old_text_size = node->old_text_size();
-    uint32_t preceding_old_text_size =
-      left_ancestor_info.total_old_text_size + node->left_subtree_old_text_size();
-    uint32_t preceding_new_text_size =
-      left_ancestor_info.total_new_text_size + node->left_subtree_new_text_size();
-    Change change{
-      old_start,
+  Point old_end = old_start.traverse(node->old_extent);
+  Point new_end = new_start.traverse(node->new_extent);
+  uint32_t preceding_old_text_size =
+    left_ancestor_info.total_old_text_size + node->left_subtree_old_text_size();
+  uint32_t preceding_new_text_size =
+    left_ancestor_info.total_new_text_size + node->left_subtree_new_text_size();
+  Change change{
+    old_start,
+    old_end,
+    new_start,
+    new_end,
+    node->get_old_text(),
+    node->get_new_text(),
+    preceding_old_text_size,
+    preceding_new_text_size,
+    node->old_text_size(),
+  };
+
+  if (node->right) {
+    left_ancestor_stack.push_back(PositionStackEntry{
       old_end,
-      new_start,
       new_end,
-      old_text,
-      new_text,
-      preceding_old_text_size,
-      preceding_new_text_size,
-      old_text_size,
-    };
-    result.push_back(change);
+      preceding_old_text_size + node->old_text_size(),
+      preceding_new_text_size + node->new_text_size()
+    });
+    node_stack.push_back(node);
+    node = node->right;
 
-    if (node->right) {
-      left_ancestor_stack.push_back(PositionStackEntry{
-        old_end,
-        new_end,
-        preceding_old_text_size + node->old_text_size(),
-        preceding_new_text_size + node->new_text_size()
-      });
+    while (node->left) {
       node_stack.push_back(node);
-      node = node->right;
+      node = node->left;
+    }
+  } else {
+    while (!node_stack.empty() && node_stack.back()->right == node) {
+      node = node_stack.back();
+      node_stack.pop_back();
+      left_ancestor_stack.pop_back();
+    }
 
-      while (node->left) {
-        node_stack.push_back(node);
-        node = node->left;
-      }
+    if (node_stack.empty()) {
+      node = nullptr;
     } else {
-      while (!node_stack.empty() && node_stack.back()->right == node) {
-        node = node_stack.back();
-        node_stack.pop_back();
-        left_ancestor_stack.pop_back();
-      }
-
-      if (node_stack.empty()) {
-        node = nullptr;
-      } else {
-        node = node_stack.back();
-        node_stack.pop_back();
-      }
+      node = node_stack.back();
+      node_stack.pop_back();
     }
   }
 
-  return result;
+  return change;
 }
 
 template <typename CoordinateSpace>
@@ -1579,8 +2729,8 @@ optional<Patch::Change> Patch::get_change_starting_before_position(Point target)
     return Change{
       old_start, old_start.traverse(found_node->old_extent),
       new_start, new_start.traverse(found_node->new_extent),
-      found_node->old_text.get(),
-      found_node->new_text.get(),
+      found_node->get_old_text(),
+      found_node->get_new_text(),
       found_node_left_ancestor_info.total_old_text_size + found_node->left_subtree_old_text_size(),
       found_node_left_ancestor_info.total_new_text_size + found_node->left_subtree_new_text_size(),
       found_node->old_text_size()
@@ -1629,8 +2779,8 @@ optional<Patch::Change> Patch::get_change_ending_after_position(Point target) co
     return Change{
       old_start, old_start.traverse(found_node->old_extent),
       new_start, new_start.traverse(found_node->new_extent),
-      found_node->old_text.get(),
-      found_node->new_text.get(),
+      found_node->get_old_text(),
+      found_node->get_new_text(),
       found_node_left_ancestor_info.total_old_text_size + found_node->left_subtree_old_text_size(),
       found_node_left_ancestor_info.total_new_text_size + found_node->left_subtree_new_text_size(),
       found_node->old_text_size()
@@ -1672,8 +2822,8 @@ vector<Change> Patch::grab_changes_in_range(Point start, Point end, bool inclusi
 
     Point old_end = old_start.traverse(node->old_extent);
     Point new_end = new_start.traverse(node->new_extent);
-    Text *old_text = node->old_text.get();
-    Text *new_text = node->new_text.get();
+    Text *old_text = node->get_old_text();
+    Text *new_text = node->get_new_text();
     uint32_t old_text_size = node->old_text_size();
     uint32_t preceding_old_text_size =
       left_ancestor_info.total_old_text_size + node->left_subtree_old_text_size();
@@ -1836,8 +2986,8 @@ Change Patch::change_for_root_node() {
   Point new_start = root->new_distance_from_left_ancestor;
   Point old_end = old_start.traverse(root->old_extent);
   Point new_end = new_start.traverse(root->new_extent);
-  Text *old_text = root->old_text.get();
-  Text *new_text = root->new_text.get();
+  Text *old_text = root->get_old_text();
+  Text *new_text = root->get_new_text();
   uint32_t old_text_size = root->old_text_size();
   uint32_t preceding_old_text_size = root->left_subtree_old_text_size();
   uint32_t preceding_new_text_size = root->left_subtree_new_text_size();
@@ -11,6 +11,10 @@
 
 class Patch {
   struct Node;
+  struct NodeText;
+  struct NodeTexts;
+  struct PendingChange;
+  struct SharedTexts;
   struct OldCoordinates;
   struct NewCoordinates;
   struct PositionStackEntry;
@@ -20,6 +24,10 @@ class Patch {
   std::vector<PositionStackEntry> left_ancestor_stack;
   uint32_t change_count;
   bool merges_adjacent_changes;
+  bool stores_text;
+  std::vector<Node *> free_nodes;
+  std::vector<void *> node_slabs;
+  size_t node_capacity;
 
 public:
   struct Change {
@@ -34,8 +42,68 @@ public:
     uint32_t old_text_size;
   };
 
+  // A change to add with `from_sorted_changes`, described like a splice.
+  struct SortedChange {
+    Point new_start;
+    Point old_extent;
+    Point new_extent;
+    optional<Text> old_text;
+    optional<Text> new_text;
+    uint32_t old_text_size;
+  };
+
+  enum TranslationDirection {
+    OldToNew,
+    NewToOld,
+  };
+
+  // Where `translate_positions` moves positions that fall inside a change,
+  // which have no counterpart on the other side of it.
+  enum ClipDirection {
+    ClipBackward,
+    ClipForward,
+  };
+
+  // Which of two patches' insertions at the same old position comes first
+  // when the patches are transformed over each other.
+  enum TieBreak {
+    InsertBeforeOther,
+    InsertAfterOther,
+  };
+
+  // Visits changes in order without collecting them. Position it with one of
+  // the `iterate_changes` or `grab_changes` methods, then call `next` until
+  // it returns nothing. An iterator keeps the capacity of its stacks, so
+  // reusing one for later walks doesn't allocate.
+  class ChangeIterator {
+  public:
+    ChangeIterator();
+    ~ChangeIterator();
+    optional<Change> next();
+
+  private:
+    friend class Patch;
+
+    template <typename CoordinateSpace>
+    void seek(const Node *root, Point start, Point end, bool inclusive);
+
+    const Node *node;
+    Point end;
+    bool inclusive;
+    bool uses_old_coordinates;
+    std::vector<const Node *> node_stack;
+    std::vector<PositionStackEntry> left_ancestor_stack;
+  };
+
+  struct MemoryUsage {
+    size_t node_count;
+    size_t node_bytes;
+    size_t text_bytes;
+    size_t stack_bytes;
+  };
+
   // Construction and destruction
-  Patch(bool merges_adjacent_changes = true);
+  Patch(bool merges_adjacent_changes = true, bool stores_text = true);
   Patch(Patch &&);
   Patch(Deserializer &input);
   Patch &operator=(Patch &&);
@@ -44,6 +112,12 @@ public:
 
   Patch copy();
   Patch invert();
+  Patch transform(const Patch &other, TieBreak = InsertBeforeOther) const;
+  static Patch from_sorted_changes(std::vector<SortedChange> &&,
+                                   bool merges_adjacent_changes = true,
+                                   bool stores_text = true);
+  static optional<Patch> compose_all(const std::vector<const Patch *> &, unsigned thread_count = 0);
+  static optional<Patch> compose_all(std::vector<Patch> &&, unsigned thread_count = 0);
 
   // Mutations
   bool splice(Point new_splice_start,
@@ -51,20 +125,32 @@ public:
               optional<Text> &&deleted_text = optional<Text>{},
               optional<Text> &&inserted_text = optional<Text>{},
               uint32_t deleted_text_size = 0);
+  bool splice(Point new_splice_start,
+              Point new_deletion_extent, Point new_insertion_extent,
+              std::shared_ptr<const Text> deleted_text,
+              std::shared_ptr<const Text> inserted_text,
+              uint32_t deleted_text_size = 0);
   void splice_old(Point start, Point deletion_extent, Point insertion_extent);
   bool combine(const Patch &other, bool left_to_right = true);
   void clear();
   void rebalance();
+  void trim_memory();
 
   // Non-splaying reads
   std::vector<Change> get_changes() const;
   size_t get_change_count() const;
+  MemoryUsage get_memory_usage() const;
   std::vector<Change> get_changes_in_old_range(Point start, Point end) const;
   std::vector<Change> get_changes_in_new_range(Point start, Point end) const;
+  void iterate_changes(ChangeIterator &) const;
+  void iterate_changes_in_old_range(ChangeIterator &, Point start, Point end) const;
+  void iterate_changes_in_new_range(ChangeIterator &, Point start, Point end) const;
   optional<Change> get_change_starting_before_old_position(Point position) const;
   optional<Change> get_change_starting_before_new_position(Point position) const;
   optional<Change> get_change_ending_after_new_position(Point position) const;
   optional<Change> get_bounds() const;
+  void translate_positions(Point *positions, size_t count, TranslationDirection,
+                           ClipDirection = ClipBackward) const;
   Point new_position_for_new_offset(uint32_t new_offset,
                                     std::function<uint32_t(Point)> old_offset_for_old_position,
                                     std::function<Point(uint32_t)> old_position_for_old_offset) const;
@@ -72,6 +158,8 @@ public:
   // Splaying reads
   std::vector<Change> grab_changes_in_old_range(Point start, Point end);
   std::vector<Change> grab_changes_in_new_range(Point start, Point end);
+  void grab_changes_in_old_range(ChangeIterator &, Point start, Point end);
+  void grab_changes_in_new_range(ChangeIterator &, Point start, Point end);
   optional<Change> grab_change_starting_before_old_position(Point position);
   optional<Change> grab_change_starting_before_new_position(Point position);
   optional<Change> grab_change_ending_after_new_position(Point position, bool exclusive = false);
@@ -81,7 +169,16 @@ public:
   std::string get_json() const;
 
 private:
-  Patch(Node *root, uint32_t change_count, bool merges_adjacent_changes);
+  template <typename... Args> Node *new_node(Args &&...);
+  void free_node(Node *);
+  void release_node_slabs();
+  size_t node_size() const;
+
+  void build_tree(std::vector<PendingChange> &);
+  Node *build_subtree(std::vector<PendingChange> &, size_t start, size_t end, Point, Point);
+  bool merge(const Patch &, bool left_to_right, const SharedTexts &);
+  bool splice_pending_changes(const std::vector<PendingChange> &, const PendingChange *,
+                              const Change &, Point, const SharedTexts &, PendingChange &);
 
   template <typename CoordinateSpace>
   std::vector<Change> get_changes_in_range(Point, Point, bool inclusive) const;
@@ -112,7 +209,8 @@ private:
 
   Change change_for_root_node();
 
-  std::pair<optional<Text>, bool> compute_old_text(optional<Text> &&, Point, Point);
+  bool splice_texts(Point, Point, Point, NodeText &&, NodeText &&, uint32_t);
+  std::pair<NodeText, bool> compute_old_text(NodeText &&, Point, Point);
   uint32_t compute_old_text_size(uint32_t, Point, Point);
 
   void splay_node(Node *);
@@ -121,7 +219,7 @@ private:
   void delete_root();
   void perform_rebalancing_rotations(uint32_t);
   Node *build_node(Node *, Node *, Point, Point, Point, Point,
-                  optional<Text> &&, optional<Text> &&, uint32_t old_text_size);
+                  NodeText &&, NodeText &&, uint32_t old_text_size);
   void delete_node(Node **);
   void remove_noop_change();
 };
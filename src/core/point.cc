@@ -62,6 +62,17 @@ void Point::serialize(Serializer &output) const {
   output.append(column);
 }
 
+Point Point::deserialize_compact(Deserializer &input) {
+  uint32_t row = input.read_varint<uint32_t>();
+  uint32_t column = input.read_varint<uint32_t>();
+  return Point(row, column);
+}
+
+void Point::serialize_compact(Serializer &output) const {
+  output.append_varint(row);
+  output.append_varint(column);
+}
+
 bool Point::operator==(const Point &other) const {
   return compare(other) == 0;
 }
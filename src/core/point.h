@@ -11,6 +11,7 @@ struct Point {
   static Point min(const Point &left, const Point &right);
   static Point max(const Point &left, const Point &right);
   static Point max();
+  static Point deserialize_compact(Deserializer &input);
 
   Point();
   Point(unsigned row, unsigned column);
@@ -21,6 +22,7 @@ struct Point {
   Point traverse(const Point &other) const;
   Point traversal(const Point &other) const;
   void serialize(Serializer &output) const;
+  void serialize_compact(Serializer &output) const;
 
   bool operator!=(const Point &other) const;
   bool operator==(const Point &other) const;
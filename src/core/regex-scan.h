@@ -0,0 +1,174 @@
+#ifndef SUPERSTRING_REGEX_SCAN_H_
+#define SUPERSTRING_REGEX_SCAN_H_
+
+#include "point.h"
+#include "range.h"
+#include "regex.h"
+#include "text.h"
+#include "text-buffer.h"
+#include "text-slice.h"
+
+// Searches the text of `source` for matches of `regex`, one chunk at a time.
+// The source must provide `clip_position(Point)`, whose result has a
+// `position` member, and `for_each_chunk_in_range(Point, Point, Callback)`.
+// The callback receives each match's range and returns true to stop scanning.
+template <typename Source, typename Callback>
+void scan_in_range(Source &source, const Regex &regex, Range range, const Callback &callback) {
+  Regex::MatchData match_data(regex);
+  range.start = source.clip_position(range.start).position;
+  range.end = source.clip_position(range.end).position;
+
+  uint32_t minimum_match_row = range.start.row;
+  Range last_match{Point::max(), Point::max()};
+  bool last_match_is_pending = false;
+  bool done = false;
+  Text chunk_continuation;
+  TextSlice slice_to_search;
+  Point chunk_start_position = range.start;
+  Point last_search_end_position = range.start;
+  Point slice_to_search_start_position = range.start;
+
+  source.for_each_chunk_in_range(range.start, range.end, [&](TextSlice chunk) {
+    Point chunk_end_position = chunk_start_position.traverse(chunk.extent());
+    while (last_search_end_position < chunk_end_position) {
+      if (last_search_end_position >= chunk_start_position) {
+        TextSlice remaining_chunk = chunk
+          .suffix(last_search_end_position.traversal(chunk_start_position));
+
+        // When we find a match that ends with a CR at a chunk boundary, we wait to
+        // report the match until we can see the next chunk. If the next chunk starts
+        // with an LF, we decrement the end column because Points within CRLF line
+        // endings are not valid.
+        if (last_match_is_pending) {
+          if (!remaining_chunk.empty() && remaining_chunk.front() == '\n') {
+            chunk_continuation.splice(Point(), Point(), Text{u"\r"});
+            slice_to_search_start_position.column--;
+            last_match.end.column--;
+          }
+
+          last_match_is_pending = false;
+          if (callback(last_match)) {
+            done = true;
+            return true;
+          }
+        }
+
+        if (!chunk_continuation.empty()) {
+          chunk_continuation.append(remaining_chunk.prefix(TextBuffer::MAX_CHUNK_SIZE_TO_COPY));
+          slice_to_search = TextSlice(chunk_continuation);
+        } else {
+          slice_to_search = remaining_chunk;
+        }
+      } else {
+        slice_to_search = TextSlice(chunk_continuation);
+      }
+
+      Point slice_to_search_end_position =
+        slice_to_search_start_position.traverse(slice_to_search.extent());
+
+      int options = 0;
+      if (slice_to_search_start_position.column == 0) options |= Regex::MatchOptions::IsBeginningOfLine;
+      if (slice_to_search_end_position == range.end) {
+        options |= Regex::MatchOptions::IsEndSearch;
+        if (range.end == source.clip_position(Point{range.end.row, UINT32_MAX}).position) {
+          options |= Regex::MatchOptions::IsEndOfLine;
+        }
+      }
+
+      Regex::MatchResult match_result = regex.match(
+        slice_to_search.data(),
+        slice_to_search.size(),
+        match_data,
+        options
+      );
+
+      switch (match_result.type) {
+        case Regex::MatchResult::Error:
+          chunk_continuation.clear();
+          return true;
+
+        case Regex::MatchResult::None:
+          last_search_end_position = slice_to_search_start_position.traverse(slice_to_search.extent());
+          slice_to_search_start_position = last_search_end_position;
+          minimum_match_row = slice_to_search_start_position.row;
+          chunk_continuation.clear();
+          break;
+
+        case Regex::MatchResult::Partial:
+          last_search_end_position = slice_to_search_start_position.traverse(slice_to_search.extent());
+          if (chunk_continuation.empty() || match_result.start_offset > 0) {
+            Point partial_match_position = slice_to_search.position_for_offset(match_result.start_offset,
+              minimum_match_row - slice_to_search_start_position.row
+            );
+            slice_to_search_start_position = slice_to_search_start_position.traverse(partial_match_position);
+            minimum_match_row = slice_to_search_start_position.row;
+            chunk_continuation.assign(slice_to_search.suffix(partial_match_position));
+          }
+          break;
+
+        case Regex::MatchResult::Full:
+          Point match_start_position = slice_to_search.position_for_offset(
+            match_result.start_offset,
+            minimum_match_row - slice_to_search_start_position.row
+          );
+          Point match_end_position = slice_to_search.position_for_offset(
+            match_result.end_offset,
+            minimum_match_row - slice_to_search_start_position.row
+          );
+          last_match = Range{
+            slice_to_search_start_position.traverse(match_start_position),
+            slice_to_search_start_position.traverse(match_end_position)
+          };
+
+          last_search_end_position = last_match.end;
+          if (match_end_position == match_start_position) {
+            last_search_end_position.column++;
+            if (source.clip_position(last_search_end_position).position == last_match.end) {
+              last_search_end_position.column = 0;
+              last_search_end_position.row++;
+            }
+          }
+          minimum_match_row = last_search_end_position.row;
+
+          slice_to_search_start_position = last_search_end_position;
+          if (slice_to_search_start_position >= chunk_start_position) {
+            chunk_continuation.clear();
+          } else {
+            chunk_continuation.assign(slice_to_search.suffix(match_end_position));
+          }
+
+          // If the match ends with a CR at the end of a chunk, continue looking
+          // at the next chunk, in case that chunk starts with an LF.
+          if (match_result.end_offset == slice_to_search.size() && slice_to_search.back() == '\r') {
+            last_match_is_pending = true;
+            continue;
+          }
+
+          if (callback(last_match)) {
+            done = true;
+            return true;
+          }
+      }
+    }
+
+    chunk_start_position = chunk_end_position;
+    return false;
+  });
+
+  if (last_match_is_pending) {
+    callback(last_match);
+  } else if (!done && last_match.end != range.end) {
+    static char16_t EMPTY[] = {0};
+    unsigned options = Regex::MatchOptions::IsEndSearch;
+    if (range.end.column == 0) options |= Regex::MatchOptions::IsBeginningOfLine;
+    if (range.end == source.clip_position(Point{range.end.row, UINT32_MAX}).position) {
+      options |= Regex::MatchOptions::IsEndOfLine;
+    }
+    Regex::MatchResult match_result = regex.match(EMPTY, 0, match_data, options);
+    if (match_result.type == Regex::MatchResult::Partial || match_result.type == Regex::MatchResult::Full) {
+      callback(Range{range.end, range.end});
+    }
+  }
+}
+
+#endif // SUPERSTRING_REGEX_SCAN_H_
@@ -2,7 +2,9 @@
 #define SERIALIZER_H_
 
 #include <vector>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 class Serializer {
   std::vector<uint8_t> &vector;
@@ -11,13 +13,40 @@ class Serializer {
   inline Serializer(std::vector<uint8_t> &output) :
     vector(output) {};
 
+  inline size_t size() const {
+    return vector.size();
+  }
+
+  // Grows the output by the given number of bytes and returns a pointer to
+  // them, so that callers can fill them in without pushing bytes one by one.
+  inline uint8_t *extend(size_t count) {
+    size_t size = vector.size();
+    vector.resize(size + count);
+    return vector.data() + size;
+  }
+
   template <typename T>
   void append(T value) {
+    uint8_t *bytes = extend(sizeof(T));
     for (auto i = 0u; i < sizeof(T); i++) {
-      vector.push_back(value & 0xFF);
+      bytes[i] = value & 0xFF;
       value >>= 8;
     }
   }
+
+  inline void append_bytes(const void *bytes, size_t count) {
+    if (count > 0) memcpy(extend(count), bytes, count);
+  }
+
+  // Writes an unsigned integer in 7-bit groups, least significant first, so
+  // that small values take a single byte.
+  inline void append_varint(uint64_t value) {
+    while (value >= 0x80) {
+      vector.push_back((value & 0x7F) | 0x80);
+      value >>= 7;
+    }
+    vector.push_back(value);
+  }
 };
 
 class Deserializer {
@@ -26,14 +55,23 @@ class Deserializer {
 
  public:
   inline Deserializer(const std::vector<uint8_t> &input) :
-    read_ptr(input.data()),
-    end_ptr(input.data() + input.size()) {};
+    Deserializer(input.data(), input.size()) {};
+
+  // Reads directly from memory owned by the caller, such as a Node buffer or
+  // a mapped file, which must outlive the deserializer.
+  inline Deserializer(const uint8_t *data, size_t size) :
+    read_ptr(data),
+    end_ptr(data + size) {};
+
+  inline size_t remaining() const {
+    return read_ptr < end_ptr ? end_ptr - read_ptr : 0;
+  }
 
   template <typename T>
   T peek() const {
     T value = 0;
     const uint8_t *temp_ptr = read_ptr;
-    if (static_cast<unsigned>(end_ptr - temp_ptr) >= sizeof(T)) {
+    if (remaining() >= sizeof(T)) {
       for (auto i = 0u; i < sizeof(T); i++) {
         value |= static_cast<T>(*(temp_ptr++)) << static_cast<T>(8 * i);
       }
@@ -41,12 +79,37 @@ class Deserializer {
     return value;
   }
 
+  // Returns zero, and consumes the rest of the input, if the input is too
+  // short.
   template <typename T>
   T read() {
     T value = peek<T>();
-    read_ptr += sizeof(T);
+    read_ptr = remaining() >= sizeof(T) ? read_ptr + sizeof(T) : end_ptr;
     return value;
   }
+
+  // Returns a pointer to the next `count` bytes of the input, or null if the
+  // input is too short.
+  inline const uint8_t *read_bytes(size_t count) {
+    if (remaining() < count) {
+      read_ptr = end_ptr;
+      return nullptr;
+    }
+    const uint8_t *result = read_ptr;
+    read_ptr += count;
+    return result;
+  }
+
+  template <typename T>
+  T read_varint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; read_ptr < end_ptr && shift < 64; shift += 7) {
+      uint8_t byte = *(read_ptr++);
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) break;
+    }
+    return static_cast<T>(value);
+  }
 };
 
 #endif // SERIALIZER_H_
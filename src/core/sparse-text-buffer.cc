@@ -0,0 +1,391 @@
+#include "sparse-text-buffer.h"
+#include "regex-scan.h"
+#include <algorithm>
+#include <string>
+
+using std::move;
+using std::shared_ptr;
+using std::u16string;
+using std::vector;
+
+uint32_t SparseTextBuffer::DEFAULT_CHUNK_SIZE = 64 * 1024;
+size_t SparseTextBuffer::DEFAULT_MAX_CACHED_CHUNK_COUNT = 64;
+
+static const uint32_t MIN_CHUNK_SIZE = 16;
+static const uint32_t INDEX_FORMAT_VERSION = 2;
+static const size_t SERIALIZED_CHUNK_SIZE = 2 * sizeof(uint64_t) + 4 * sizeof(uint32_t);
+
+struct SparseTextBuffer::Chunk {
+  uint64_t byte_offset;
+  uint64_t character_offset;
+  uint32_t byte_count;
+  uint32_t character_count;
+  uint32_t start_row;
+  uint32_t newline_count;
+
+  uint32_t end_row() const {
+    return start_row + newline_count;
+  }
+};
+
+static bool seek(FILE *file, uint64_t offset) {
+#ifdef WIN32
+  return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+}
+
+SparseTextBuffer::SparseTextBuffer(FILE *file, EncodingConversion &&conversion,
+                                   uint32_t chunk_size, size_t max_cached_chunk_count) :
+  file{file},
+  conversion{move(conversion)},
+  chunk_size{std::max(chunk_size, MIN_CHUNK_SIZE)},
+  max_cached_chunk_count{std::max(max_cached_chunk_count, size_t(1))},
+  fully_indexed{false} {}
+
+SparseTextBuffer::~SparseTextBuffer() {
+  if (file) fclose(file);
+}
+
+size_t SparseTextBuffer::read_bytes(uint64_t offset, size_t count) {
+  read_buffer.resize(count);
+  if (!seek(file, offset)) return 0;
+  return fread(read_buffer.data(), 1, count, file);
+}
+
+uint64_t SparseTextBuffer::file_size() {
+#ifdef WIN32
+  if (_fseeki64(file, 0, SEEK_END) != 0) return 0;
+  return _ftelli64(file);
+#else
+  if (fseeko(file, 0, SEEK_END) != 0) return 0;
+  return ftello(file);
+#endif
+}
+
+// Digests are stored in index files, so they use FNV-1a rather than
+// `std::hash`, whose results can differ between builds.
+uint64_t SparseTextBuffer::chunk_digest(size_t index) {
+  const Chunk &chunk = chunks[index];
+  size_t bytes_read = read_bytes(chunk.byte_offset, chunk.byte_count);
+  uint64_t result = 14695981039346656037ull;
+  for (size_t i = 0; i < bytes_read; i++) {
+    result ^= static_cast<uint8_t>(read_buffer[i]);
+    result *= 1099511628211ull;
+  }
+  return result;
+}
+
+bool SparseTextBuffer::index_next_chunk() {
+  if (fully_indexed) return false;
+
+  Chunk chunk{0, 0, 0, 0, 0, 0};
+  if (!chunks.empty()) {
+    const Chunk &previous_chunk = chunks.back();
+    chunk.byte_offset = previous_chunk.byte_offset + previous_chunk.byte_count;
+    chunk.character_offset = previous_chunk.character_offset + previous_chunk.character_count;
+    chunk.start_row = previous_chunk.end_row();
+  }
+
+  size_t bytes_read = read_bytes(chunk.byte_offset, chunk_size);
+  if (bytes_read == 0) {
+    fully_indexed = true;
+    return false;
+  }
+
+  bool is_last = bytes_read < chunk_size;
+  u16string content;
+  size_t bytes_decoded = conversion.decode(content, read_buffer.data(), bytes_read, is_last);
+
+  // Never end a chunk between a CR and an LF, so that each chunk's Text can
+  // clip positions within its own line endings. Decode one byte less at a
+  // time until the trailing CR is dropped.
+  if (!is_last && content.size() > 1 && content.back() == '\r') {
+    u16string shortened_content;
+    for (size_t byte_count = bytes_decoded; byte_count > 0; byte_count--) {
+      shortened_content.clear();
+      size_t shortened_bytes_decoded = conversion.decode(
+        shortened_content, read_buffer.data(), byte_count - 1, false
+      );
+      if (shortened_content.size() < content.size()) {
+        content = move(shortened_content);
+        bytes_decoded = shortened_bytes_decoded;
+        break;
+      }
+    }
+  }
+
+  auto text = std::make_shared<const Text>(move(content));
+  chunk.byte_count = bytes_decoded;
+  chunk.character_count = text->size();
+  chunk.newline_count = text->extent().row;
+  chunks.push_back(chunk);
+  if (is_last) fully_indexed = true;
+  cache_chunk_text(chunks.size() - 1, text);
+  return true;
+}
+
+shared_ptr<const Text> SparseTextBuffer::chunk_text(size_t index) {
+  auto entry = cached_chunks_by_index.find(index);
+  if (entry != cached_chunks_by_index.end()) {
+    cached_chunks.splice(cached_chunks.begin(), cached_chunks, entry->second);
+    return entry->second->second;
+  }
+
+  const Chunk &chunk = chunks[index];
+  size_t bytes_read = read_bytes(chunk.byte_offset, chunk.byte_count);
+  bool is_last = fully_indexed && index + 1 == chunks.size();
+  u16string content;
+  content.reserve(chunk.character_count);
+  conversion.decode(content, read_buffer.data(), bytes_read, is_last);
+  auto text = std::make_shared<const Text>(move(content));
+  cache_chunk_text(index, text);
+  return text;
+}
+
+void SparseTextBuffer::cache_chunk_text(size_t index, shared_ptr<const Text> text) {
+  cached_chunks.emplace_front(index, move(text));
+  cached_chunks_by_index[index] = cached_chunks.begin();
+  while (cached_chunks.size() > max_cached_chunk_count) {
+    cached_chunks_by_index.erase(cached_chunks.back().first);
+    cached_chunks.pop_back();
+  }
+}
+
+optional<SparseTextBuffer::Location> SparseTextBuffer::location_for_row(uint32_t row) {
+  while (chunks.empty() || chunks.back().end_row() < row) {
+    if (!index_next_chunk()) break;
+  }
+
+  if (row == 0) return Location{0, Point()};
+
+  // Find the chunk containing the newline that precedes the row.
+  auto chunk = std::lower_bound(chunks.begin(), chunks.end(), row,
+    [](const Chunk &chunk, uint32_t row) { return chunk.end_row() < row; });
+  if (chunk == chunks.end()) return optional<Location>{};
+  return Location{
+    static_cast<size_t>(chunk - chunks.begin()),
+    Point(row - chunk->start_row, 0)
+  };
+}
+
+SparseTextBuffer::Location SparseTextBuffer::locate(Point position, Point *clipped_position) {
+  auto location = location_for_row(position.row);
+  if (!location) return locate(extent(), clipped_position);
+
+  uint32_t column = 0;
+  for (;;) {
+    if (location->chunk_index >= chunks.size() && !index_next_chunk()) break;
+
+    shared_ptr<const Text> text = chunk_text(location->chunk_index);
+    uint32_t length = text->line_length_for_row(location->position.row);
+    bool line_continues_in_next_chunk = location->position.row == text->extent().row;
+
+    if (position.column - column <= length || !line_continues_in_next_chunk) {
+      location->position.column = std::min(position.column - column, length);
+      column += location->position.column;
+      break;
+    }
+
+    if (location->chunk_index + 1 >= chunks.size() && !index_next_chunk()) {
+      location->position.column = length;
+      column += length;
+      break;
+    }
+
+    column += length;
+    location = Location{location->chunk_index + 1, Point()};
+  }
+
+  *clipped_position = Point(position.row, column);
+  return *location;
+}
+
+uint64_t SparseTextBuffer::size() {
+  while (index_next_chunk()) {}
+  if (chunks.empty()) return 0;
+  return chunks.back().character_offset + chunks.back().character_count;
+}
+
+Point SparseTextBuffer::extent() {
+  while (index_next_chunk()) {}
+  if (chunks.empty()) return Point();
+
+  uint32_t last_row = chunks.back().end_row();
+  Location location = *location_for_row(last_row);
+  uint64_t last_row_offset = chunks[location.chunk_index].character_offset +
+    chunk_text(location.chunk_index)->offset_for_position(location.position);
+  return Point(last_row, size() - last_row_offset);
+}
+
+optional<u16string> SparseTextBuffer::line_for_row(uint32_t row) {
+  if (!location_for_row(row)) return optional<u16string>{};
+  return text_in_range({Point(row, 0), Point(row, UINT32_MAX)});
+}
+
+optional<uint32_t> SparseTextBuffer::line_length_for_row(uint32_t row) {
+  if (!location_for_row(row)) return optional<uint32_t>{};
+  return clip_position(Point(row, UINT32_MAX)).position.column;
+}
+
+SparseTextBuffer::ClipResult SparseTextBuffer::clip_position(Point position) {
+  Point clipped_position;
+  Location location = locate(position, &clipped_position);
+  if (location.chunk_index >= chunks.size()) return ClipResult{clipped_position, 0};
+  uint64_t offset = chunks[location.chunk_index].character_offset +
+    chunk_text(location.chunk_index)->offset_for_position(location.position);
+  return ClipResult{clipped_position, offset};
+}
+
+u16string SparseTextBuffer::text_in_range(Range range) {
+  u16string result;
+  range.start = clip_position(range.start).position;
+  range.end = clip_position(range.end).position;
+  for_each_chunk_in_range(range.start, range.end, [&result](TextSlice slice) {
+    result.append(slice.data(), slice.size());
+    return false;
+  });
+  return result;
+}
+
+bool SparseTextBuffer::for_each_chunk_in_range(Point start, Point end,
+                                               const std::function<bool(TextSlice)> &callback) {
+  Point current_position;
+  Location location = locate(start, &current_position);
+
+  while (current_position < end) {
+    if (location.chunk_index >= chunks.size() && !index_next_chunk()) break;
+
+    // Hold a reference to the chunk's text, so that it outlives the callback
+    // even if the callback causes it to be evicted from the cache.
+    shared_ptr<const Text> text = chunk_text(location.chunk_index);
+    Point chunk_end_position = current_position.traverse(text->extent().traversal(location.position));
+    Point slice_end = chunk_end_position <= end ?
+      text->extent() :
+      location.position.traverse(end.traversal(current_position));
+
+    TextSlice slice(text.get(), location.position, slice_end);
+    if (!slice.empty() && callback(slice)) return true;
+
+    current_position = chunk_end_position;
+    location = Location{location.chunk_index + 1, Point()};
+  }
+
+  return false;
+}
+
+optional<Range> SparseTextBuffer::find(const Regex &regex, Range range) {
+  optional<Range> result;
+  scan_in_range(*this, regex, range, [&result](Range match_range) -> bool {
+    result = match_range;
+    return true;
+  });
+  return result;
+}
+
+vector<Range> SparseTextBuffer::find_all(const Regex &regex, Range range) {
+  vector<Range> result;
+  scan_in_range(*this, regex, range, [&result](Range match_range) -> bool {
+    result.push_back(match_range);
+    return false;
+  });
+  return result;
+}
+
+bool SparseTextBuffer::is_fully_indexed() const {
+  return fully_indexed;
+}
+
+// The index is written as a header followed by one fixed-size record per
+// chunk and a trailer. The header identifies the file by its size and by digests of the
+// raw bytes of the first and last indexed chunks.
+void SparseTextBuffer::serialize_index(Serializer &output) {
+  output.append<uint32_t>(INDEX_FORMAT_VERSION);
+  output.append<uint32_t>(chunk_size);
+  output.append<uint64_t>(file_size());
+  output.append<uint8_t>(fully_indexed);
+  output.append<uint64_t>(chunks.size());
+  output.append<uint64_t>(chunks.empty() ? 0 : chunk_digest(0));
+  output.append<uint64_t>(chunks.empty() ? 0 : chunk_digest(chunks.size() - 1));
+  for (const Chunk &chunk : chunks) {
+    output.append<uint64_t>(chunk.byte_offset);
+    output.append<uint64_t>(chunk.character_offset);
+    output.append<uint32_t>(chunk.byte_count);
+    output.append<uint32_t>(chunk.character_count);
+    output.append<uint32_t>(chunk.start_row);
+    output.append<uint32_t>(chunk.newline_count);
+  }
+  output.append<uint32_t>(INDEX_FORMAT_VERSION);
+}
+
+// Replaces the index with one written by `serialize_index`. Returns false,
+// leaving the index unchanged, if the data is malformed or was written for
+// different file contents or a different chunk size.
+bool SparseTextBuffer::deserialize_index(Deserializer &input) {
+  if (input.read<uint32_t>() != INDEX_FORMAT_VERSION) return false;
+  if (input.read<uint32_t>() != chunk_size) return false;
+  uint64_t expected_file_size = input.read<uint64_t>();
+  if (expected_file_size != file_size()) return false;
+  bool is_complete = input.read<uint8_t>();
+  uint64_t chunk_count = input.read<uint64_t>();
+  uint64_t first_chunk_digest = input.read<uint64_t>();
+  uint64_t last_chunk_digest = input.read<uint64_t>();
+  if (chunk_count > expected_file_size) return false;
+  if (chunk_count > input.remaining() / SERIALIZED_CHUNK_SIZE) return false;
+
+  vector<Chunk> new_chunks;
+  new_chunks.reserve(chunk_count);
+  Chunk previous_chunk{0, 0, 0, 0, 0, 0};
+  for (uint64_t i = 0; i < chunk_count; i++) {
+    Chunk chunk;
+    chunk.byte_offset = input.read<uint64_t>();
+    chunk.character_offset = input.read<uint64_t>();
+    chunk.byte_count = input.read<uint32_t>();
+    chunk.character_count = input.read<uint32_t>();
+    chunk.start_row = input.read<uint32_t>();
+    chunk.newline_count = input.read<uint32_t>();
+    if (chunk.byte_count == 0 ||
+        chunk.byte_count > chunk_size ||
+        chunk.character_count > chunk.byte_count ||
+        chunk.byte_offset != previous_chunk.byte_offset + previous_chunk.byte_count ||
+        chunk.character_offset != previous_chunk.character_offset + previous_chunk.character_count ||
+        chunk.start_row != previous_chunk.end_row()) {
+      return false;
+    }
+    new_chunks.push_back(chunk);
+    previous_chunk = chunk;
+  }
+
+  // The version is repeated at the end so that truncated data is rejected.
+  if (input.read<uint32_t>() != INDEX_FORMAT_VERSION) return false;
+
+  uint64_t indexed_byte_count = previous_chunk.byte_offset + previous_chunk.byte_count;
+  if (indexed_byte_count > expected_file_size) return false;
+  if (is_complete && indexed_byte_count != expected_file_size) return false;
+
+  chunks.swap(new_chunks);
+  if (!chunks.empty() && (chunk_digest(0) != first_chunk_digest ||
+                          chunk_digest(chunks.size() - 1) != last_chunk_digest)) {
+    chunks.swap(new_chunks);
+    return false;
+  }
+
+  fully_indexed = is_complete;
+  cached_chunks.clear();
+  cached_chunks_by_index.clear();
+  return true;
+}
+
+SparseTextBuffer::MemoryUsage SparseTextBuffer::get_memory_usage() const {
+  MemoryUsage result{0, 0, 0, 0, 0};
+  result.index_bytes = chunks.capacity() * sizeof(Chunk) +
+    cached_chunks_by_index.bucket_count() * sizeof(void *);
+  for (const auto &entry : cached_chunks) {
+    result.cached_text_bytes += entry.second->memory_usage();
+  }
+  result.read_buffer_bytes = read_buffer.capacity();
+  result.indexed_chunk_count = chunks.size();
+  result.cached_chunk_count = cached_chunks.size();
+  return result;
+}
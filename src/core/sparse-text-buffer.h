@@ -0,0 +1,92 @@
+#ifndef SUPERSTRING_SPARSE_TEXT_BUFFER_H_
+#define SUPERSTRING_SPARSE_TEXT_BUFFER_H_
+
+#include <stdio.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "encoding-conversion.h"
+#include "optional.h"
+#include "point.h"
+#include "range.h"
+#include "regex.h"
+#include "serializer.h"
+#include "text.h"
+#include "text-slice.h"
+
+// A read-only view of a file that may be too large to hold in memory. The
+// file is decoded in fixed-size chunks. The index records where each chunk
+// starts, in bytes, characters and rows, and is only extended as far as a
+// query needs. A bounded number of decoded chunks is kept in an LRU cache.
+//
+// The buffer takes ownership of the file, which must not change while the
+// buffer is open. Chunks are decoded independently, so the encoding must not
+// carry state from one chunk to the next.
+class SparseTextBuffer {
+  struct Chunk;
+
+  struct Location {
+    size_t chunk_index;
+    Point position;
+  };
+
+  FILE *file;
+  EncodingConversion conversion;
+  uint32_t chunk_size;
+  size_t max_cached_chunk_count;
+  bool fully_indexed;
+  std::vector<Chunk> chunks;
+  std::vector<char> read_buffer;
+  std::list<std::pair<size_t, std::shared_ptr<const Text>>> cached_chunks;
+  std::unordered_map<size_t, std::list<std::pair<size_t, std::shared_ptr<const Text>>>::iterator> cached_chunks_by_index;
+
+  size_t read_bytes(uint64_t offset, size_t count);
+  uint64_t file_size();
+  uint64_t chunk_digest(size_t index);
+  bool index_next_chunk();
+  std::shared_ptr<const Text> chunk_text(size_t index);
+  void cache_chunk_text(size_t index, std::shared_ptr<const Text>);
+  optional<Location> location_for_row(uint32_t row);
+  Location locate(Point position, Point *clipped_position);
+
+ public:
+  static uint32_t DEFAULT_CHUNK_SIZE;
+  static size_t DEFAULT_MAX_CACHED_CHUNK_COUNT;
+
+  struct ClipResult {
+    Point position;
+    uint64_t offset;
+  };
+
+  struct MemoryUsage {
+    size_t index_bytes;
+    size_t cached_text_bytes;
+    size_t read_buffer_bytes;
+    uint32_t indexed_chunk_count;
+    uint32_t cached_chunk_count;
+  };
+
+  SparseTextBuffer(FILE *file, EncodingConversion &&conversion,
+                   uint32_t chunk_size = DEFAULT_CHUNK_SIZE,
+                   size_t max_cached_chunk_count = DEFAULT_MAX_CACHED_CHUNK_COUNT);
+  ~SparseTextBuffer();
+
+  uint64_t size();
+  Point extent();
+  optional<std::u16string> line_for_row(uint32_t row);
+  optional<uint32_t> line_length_for_row(uint32_t row);
+  ClipResult clip_position(Point);
+  std::u16string text_in_range(Range range);
+  bool for_each_chunk_in_range(Point start, Point end, const std::function<bool(TextSlice)> &);
+  optional<Range> find(const Regex &, Range range = Range::all_inclusive());
+  std::vector<Range> find_all(const Regex &, Range range = Range::all_inclusive());
+  bool is_fully_indexed() const;
+  void serialize_index(Serializer &);
+  bool deserialize_index(Deserializer &);
+  MemoryUsage get_memory_usage() const;
+};
+
+#endif // SUPERSTRING_SPARSE_TEXT_BUFFER_H_
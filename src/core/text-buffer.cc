@@ -1,9 +1,13 @@
 #include "text-slice.h"
 #include "text-buffer.h"
 #include "regex.h"
+#include "regex-scan.h"
 #include <algorithm>
 #include <cassert>
 #include <cwctype>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
@@ -11,6 +15,7 @@
 using std::equal;
 using std::move;
 using std::pair;
+using std::shared_ptr;
 using std::string;
 using std::u16string;
 using std::vector;
@@ -25,7 +30,10 @@ static Text EMPTY_TEXT;
 struct TextBuffer::Layer {
   Layer *previous_layer;
   Patch patch;
-  optional<Text> text;
+  mutable shared_ptr<Text> text;
+  mutable std::function<optional<Text>()> reload_text;
+  mutable LineOffsets spilled_line_offsets;
+  size_t spilled_digest;
   bool uses_patch;
 
   Point extent_;
@@ -34,10 +42,11 @@ struct TextBuffer::Layer {
 
   Layer(Text &&text) :
     previous_layer{nullptr},
-    text{move(text)},
+    text{std::make_shared<Text>(move(text))},
     uses_patch{false},
     extent_{this->text->extent()},
     size_{this->text->size()},
+    spilled_digest{0},
     snapshot_count{0} {}
 
   Layer(Layer *previous_layer) :
@@ -46,8 +55,44 @@ struct TextBuffer::Layer {
     uses_patch{true},
     extent_{previous_layer->extent()},
     size_{previous_layer->size()},
+    spilled_digest{0},
     snapshot_count{0} {}
 
+  bool has_text() const {
+    return text || reload_text;
+  }
+
+  bool is_spilled() const {
+    return static_cast<bool>(reload_text);
+  }
+
+  // Replaces spilled text with the reloaded characters, unless they differ
+  // from the ones that were spilled.
+  bool reload_spilled_text() const {
+    optional<Text> reloaded_text = reload_text();
+    if (!reloaded_text || reloaded_text->size() != size_ || reloaded_text->extent() != extent_ ||
+        reloaded_text->digest() != spilled_digest) return false;
+    text = std::make_shared<Text>(move(*reloaded_text));
+    reload_text = nullptr;
+    spilled_line_offsets = LineOffsets();
+    return true;
+  }
+
+  Text &get_text() const {
+    if (!text && !reload_spilled_text()) {
+      // The spilled characters can't be reloaded, so the layer stays spilled.
+      // Until a later reload succeeds, its characters read as replacement
+      // characters laid out in the same rows, so that the positions stored in
+      // the layers above still refer to valid offsets.
+      u16string content(size_, 0xfffd);
+      for (size_t row = 1; row < spilled_line_offsets.size(); row++) {
+        content[spilled_line_offsets[row] - 1] = '\n';
+      }
+      text = std::make_shared<Text>(move(content));
+    }
+    return *text;
+  }
+
   static inline Point previous_column(Point position) {
     return Point(position.row, position.column - 1);
   }
@@ -62,7 +107,7 @@ struct TextBuffer::Layer {
   }
 
   uint16_t character_at(Point position) const {
-    if (!uses_patch) return text->at(position);
+    if (!uses_patch) return get_text().at(position);
 
     auto change = patch.get_change_starting_before_new_position(position);
     if (!change) return previous_layer->character_at(position);
@@ -76,7 +121,7 @@ struct TextBuffer::Layer {
   }
 
   ClipResult clip_position(Point position, bool splay = false) {
-    if (!uses_patch) return text->clip_position(position);
+    if (!uses_patch) return get_text().clip_position(position);
     if (snapshot_count > 0) splay = false;
 
     auto preceding_change = splay ?
@@ -153,7 +198,7 @@ struct TextBuffer::Layer {
     Point current_position = start;
 
     if (!uses_patch) {
-      TextSlice slice = TextSlice(*text).slice({current_position, goal_position});
+      TextSlice slice = TextSlice(get_text()).slice({current_position, goal_position});
       return !slice.empty() && callback(slice);
     }
 
@@ -177,22 +222,25 @@ struct TextBuffer::Layer {
       base_position = change->old_end.traverse(current_position.traversal(change->new_end));
     }
 
-    auto changes = splay ?
-      patch.grab_changes_in_new_range(current_position, goal_position) :
-      patch.get_changes_in_new_range(current_position, goal_position);
-    for (const auto &change : changes) {
-      if (base_position < change.old_start) {
-        if (previous_layer->for_each_chunk_in_range(base_position, change.old_start, callback)) {
+    Patch::ChangeIterator changes;
+    if (splay) {
+      patch.grab_changes_in_new_range(changes, current_position, goal_position);
+    } else {
+      patch.iterate_changes_in_new_range(changes, current_position, goal_position);
+    }
+    while (auto change = changes.next()) {
+      if (base_position < change->old_start) {
+        if (previous_layer->for_each_chunk_in_range(base_position, change->old_start, callback)) {
           return true;
         }
       }
 
-      TextSlice slice = TextSlice(*change.new_text)
-        .prefix(Point::min(change.new_end, goal_position).traversal(change.new_start));
+      TextSlice slice = TextSlice(*change->new_text)
+        .prefix(Point::min(change->new_end, goal_position).traversal(change->new_start));
       if (!slice.empty() && callback(slice)) return true;
 
-      base_position = change.old_end;
-      current_position = change.new_end;
+      base_position = change->old_end;
+      current_position = change->new_end;
     }
 
     if (current_position < goal_position) {
@@ -207,8 +255,8 @@ struct TextBuffer::Layer {
   }
 
   Point position_for_offset(uint32_t goal_offset) const {
-    if (text) {
-      return text->position_for_offset(goal_offset);
+    if (has_text()) {
+      return get_text().position_for_offset(goal_offset);
     } else {
       return patch.new_position_for_new_offset(
         goal_offset,
@@ -265,163 +313,24 @@ struct TextBuffer::Layer {
 
   }
 
-  template <typename Callback>
-  void scan_in_range(const Regex &regex, Range range, const Callback &callback, bool splay = false) {
-    Regex::MatchData match_data(regex);
-    range.start = clip_position(range.start).position;
-    range.end = clip_position(range.end).position;
-
-    uint32_t minimum_match_row = range.start.row;
-    Range last_match{Point::max(), Point::max()};
-    bool last_match_is_pending = false;
-    bool done = false;
-    Text chunk_continuation;
-    TextSlice slice_to_search;
-    Point chunk_start_position = range.start;
-    Point last_search_end_position = range.start;
-    Point slice_to_search_start_position = range.start;
-
-    for_each_chunk_in_range(range.start, range.end, [&](TextSlice chunk) {
-      Point chunk_end_position = chunk_start_position.traverse(chunk.extent());
-      while (last_search_end_position < chunk_end_position) {
-        if (last_search_end_position >= chunk_start_position) {
-          TextSlice remaining_chunk = chunk
-            .suffix(last_search_end_position.traversal(chunk_start_position));
-
-          // When we find a match that ends with a CR at a chunk boundary, we wait to
-          // report the match until we can see the next chunk. If the next chunk starts
-          // with an LF, we decrement the end column because Points within CRLF line
-          // endings are not valid.
-          if (last_match_is_pending) {
-            if (!remaining_chunk.empty() && remaining_chunk.front() == '\n') {
-              chunk_continuation.splice(Point(), Point(), Text{u"\r"});
-              slice_to_search_start_position.column--;
-              last_match.end.column--;
-            }
+  struct ScanSource {
+    Layer &layer;
+    bool splay;
 
-            last_match_is_pending = false;
-            if (callback(last_match)) {
-              done = true;
-              return true;
-            }
-          }
-
-          if (!chunk_continuation.empty()) {
-            chunk_continuation.append(remaining_chunk.prefix(MAX_CHUNK_SIZE_TO_COPY));
-            slice_to_search = TextSlice(chunk_continuation);
-          } else {
-            slice_to_search = remaining_chunk;
-          }
-        } else {
-          slice_to_search = TextSlice(chunk_continuation);
-        }
-
-        Point slice_to_search_end_position =
-          slice_to_search_start_position.traverse(slice_to_search.extent());
-
-        int options = 0;
-        if (slice_to_search_start_position.column == 0) options |= MatchOptions::IsBeginningOfLine;
-        if (slice_to_search_end_position == range.end) {
-          options |= MatchOptions::IsEndSearch;
-          if (range.end == clip_position(Point{range.end.row, UINT32_MAX}).position) {
-            options |= MatchOptions::IsEndOfLine;
-          }
-        }
-
-        MatchResult match_result = regex.match(
-          slice_to_search.data(),
-          slice_to_search.size(),
-          match_data,
-          options
-        );
-
-        switch (match_result.type) {
-          case MatchResult::Error:
-            chunk_continuation.clear();
-            return true;
-
-          case MatchResult::None:
-            last_search_end_position = slice_to_search_start_position.traverse(slice_to_search.extent());
-            slice_to_search_start_position = last_search_end_position;
-            minimum_match_row = slice_to_search_start_position.row;
-            chunk_continuation.clear();
-            break;
-
-          case MatchResult::Partial:
-            last_search_end_position = slice_to_search_start_position.traverse(slice_to_search.extent());
-            if (chunk_continuation.empty() || match_result.start_offset > 0) {
-              Point partial_match_position = slice_to_search.position_for_offset(match_result.start_offset,
-                minimum_match_row - slice_to_search_start_position.row
-              );
-              slice_to_search_start_position = slice_to_search_start_position.traverse(partial_match_position);
-              minimum_match_row = slice_to_search_start_position.row;
-              chunk_continuation.assign(slice_to_search.suffix(partial_match_position));
-            }
-            break;
-
-          case MatchResult::Full:
-            Point match_start_position = slice_to_search.position_for_offset(
-              match_result.start_offset,
-              minimum_match_row - slice_to_search_start_position.row
-            );
-            Point match_end_position = slice_to_search.position_for_offset(
-              match_result.end_offset,
-              minimum_match_row - slice_to_search_start_position.row
-            );
-            last_match = Range{
-              slice_to_search_start_position.traverse(match_start_position),
-              slice_to_search_start_position.traverse(match_end_position)
-            };
-
-            last_search_end_position = last_match.end;
-            if (match_end_position == match_start_position) {
-              last_search_end_position.column++;
-              if (clip_position(last_search_end_position).position == last_match.end) {
-                last_search_end_position.column = 0;
-                last_search_end_position.row++;
-              }
-            }
-            minimum_match_row = last_search_end_position.row;
-
-            slice_to_search_start_position = last_search_end_position;
-            if (slice_to_search_start_position >= chunk_start_position) {
-              chunk_continuation.clear();
-            } else {
-              chunk_continuation.assign(slice_to_search.suffix(match_end_position));
-            }
-
-            // If the match ends with a CR at the end of a chunk, continue looking
-            // at the next chunk, in case that chunk starts with an LF.
-            if (match_result.end_offset == slice_to_search.size() && slice_to_search.back() == '\r') {
-              last_match_is_pending = true;
-              continue;
-            }
-
-            if (callback(last_match)) {
-              done = true;
-              return true;
-            }
-        }
-      }
-
-      chunk_start_position = chunk_end_position;
-      return false;
-    }, splay);
+    ClipResult clip_position(Point position) {
+      return layer.clip_position(position);
+    }
 
-    if (last_match_is_pending) {
-      callback(last_match);
-    } else if (!done && last_match.end != range.end) {
-      static char16_t EMPTY[] = {0};
-      unsigned options = MatchOptions::IsEndSearch;
-      if (range.end.column == 0) options |= MatchOptions::IsBeginningOfLine;
-      if (range.end == clip_position(Point{range.end.row, UINT32_MAX}).position) {
-        options |= MatchOptions::IsEndOfLine;
-      }
-      MatchResult match_result = regex.match(EMPTY, 0, match_data, options);
-      if (match_result.type == MatchResult::Partial || match_result.type == MatchResult::Full) {
-        callback(Range{range.end, range.end});
-      }
+    template <typename Callback>
+    bool for_each_chunk_in_range(Point start, Point end, const Callback &callback) {
+      return layer.for_each_chunk_in_range(start, end, callback, splay);
     }
+  };
+
+  template <typename Callback>
+  void scan_in_range(const Regex &regex, Range range, const Callback &callback, bool splay = false) {
+    ScanSource source{*this, splay};
+    ::scan_in_range(source, regex, range, callback);
   }
 
   optional<Range> find_in_range(const Regex &regex, Range range, bool splay = false) {
@@ -638,47 +547,253 @@ struct TextBuffer::Layer {
   }
 
   bool is_modified(const Layer *base_layer) {
+    if (this == base_layer) return false;
     if (size() != base_layer->size()) return true;
 
-    bool result = false;
-    uint32_t start_offset = 0;
-    for_each_chunk_in_range(Point(), extent(), [&](TextSlice chunk) {
-      if (chunk.text == &(*base_layer->text) ||
-          equal(chunk.begin(), chunk.end(), base_layer->text->begin() + start_offset)) {
-        start_offset += chunk.size();
-        return false;
+    Patch combination;
+    const Patch *changes_since_base = &patch;
+    if (previous_layer != base_layer) {
+      vector<const Patch *> patches;
+      const Layer *layer = this;
+      while (layer != base_layer) {
+        patches.insert(patches.begin(), &layer->patch);
+        layer = layer->previous_layer;
       }
-      result = true;
-      return true;
+
+      bool left_to_right = true;
+      for (const Patch *patch : patches) {
+        combination.combine(*patch, left_to_right);
+        left_to_right = !left_to_right;
+      }
+      changes_since_base = &combination;
+    }
+
+    // Skip over any leading changes that restore the text they replaced. The
+    // buffer can only differ from the base text between the first change that
+    // doesn't and the end of the last change, because everything after that
+    // is the base text shifted by the total change in size, which is zero.
+    // That span can still cover most of the buffer, and changes are not
+    // marked as differing from the base, because separate changes can cancel
+    // each other out. Only `TextBuffer::is_modified`'s cached result is O(1).
+    const Text &base_text = base_layer->get_text();
+    auto bounds = changes_since_base->get_bounds();
+    Patch::ChangeIterator changes;
+    changes_since_base->iterate_changes(changes);
+    while (auto change = changes.next()) {
+      uint32_t base_offset = base_text.offset_for_position(change->old_start);
+      if (change->new_text &&
+          change->preceding_old_text_size == change->preceding_new_text_size &&
+          change->old_text_size == change->new_text->size() &&
+          equal(change->new_text->begin(), change->new_text->end(), base_text.begin() + base_offset)) {
+        continue;
+      }
+
+      bool result = false;
+      for_each_chunk_in_range(change->new_start, bounds->new_end, [&](TextSlice chunk) {
+        if (equal(chunk.begin(), chunk.end(), base_text.begin() + base_offset)) {
+          base_offset += chunk.size();
+          return false;
+        }
+        result = true;
+        return true;
+      });
+      return result;
+    }
+
+    return false;
+  }
+};
+
+// Statistics are updated from the text that an edit removes and inserts,
+// plus the characters on either side of it, so that a CRLF pair which the
+// edit splits or joins is counted the same way before and after. Only the
+// lengths of the rows at the edges of the edit are looked up separately.
+//
+// Line endings are indexed by storing the more common kind of ending along
+// with the sorted rows that end the other way. Normally there are few of
+// those, so shifting them past an edit that adds or removes rows is cheap.
+struct TextBuffer::StatisticsIndex {
+  Statistics totals;
+  std::map<uint32_t, uint32_t> line_length_counts;
+  bool crlf_is_primary;
+  vector<uint32_t> rows_with_other_ending;
+
+  StatisticsIndex(Layer *layer) : totals{}, crlf_is_primary{false} {
+    vector<uint32_t> lf_rows, crlf_rows;
+    scan_range(layer, Point(), layer->extent(), 1, [&](uint32_t row, bool is_crlf) {
+      (is_crlf ? crlf_rows : lf_rows).push_back(row);
     });
+    crlf_is_primary = crlf_rows.size() > lf_rows.size();
+    rows_with_other_ending = move(crlf_is_primary ? lf_rows : crlf_rows);
+  }
 
-    return result;
+  void remove_range(Layer *layer, Point start, Point end) {
+    uint32_t end_row = scan_range(layer, start, end, -1, [](uint32_t, bool) {});
+    rows_with_other_ending.erase(
+      std::lower_bound(rows_with_other_ending.begin(), rows_with_other_ending.end(), start.row),
+      std::lower_bound(rows_with_other_ending.begin(), rows_with_other_ending.end(), end_row)
+    );
   }
 
-  bool has_astral() {
-    bool result = false;
-    for_each_chunk_in_range(Point(), extent(), [&](TextSlice chunk) {
-      for (auto ch : chunk) {
-        if ((ch & 0xf800) == 0xd800) {
-          result = true;
-          return true;
+  void insert_range(Layer *layer, Point start, Point old_end, Point new_end) {
+    auto insertion_point = std::lower_bound(
+      rows_with_other_ending.begin(), rows_with_other_ending.end(), start.row
+    );
+    if (new_end.row != old_end.row) {
+      for (auto iter = insertion_point; iter != rows_with_other_ending.end(); ++iter) {
+        *iter = *iter - old_end.row + new_end.row;
+      }
+    }
+
+    vector<uint32_t> inserted_rows;
+    scan_range(layer, start, new_end, 1, [&](uint32_t row, bool is_crlf) {
+      if (is_crlf != crlf_is_primary) inserted_rows.push_back(row);
+    });
+    rows_with_other_ending.insert(insertion_point, inserted_rows.begin(), inserted_rows.end());
+
+    // Swap which kind of line ending is stored explicitly once most rows use
+    // it. Waiting until it covers three quarters of the rows keeps edits
+    // near the middle from flipping back and forth.
+    uint32_t ending_count = totals.lf_count + totals.crlf_count;
+    if (rows_with_other_ending.size() * 4 > ending_count * 3) {
+      vector<uint32_t> rows_with_primary_ending;
+      rows_with_primary_ending.reserve(ending_count - rows_with_other_ending.size());
+      auto iter = rows_with_other_ending.begin();
+      for (uint32_t row = 0; row < layer->extent().row; row++) {
+        if (iter != rows_with_other_ending.end() && *iter == row) {
+          ++iter;
+        } else {
+          rows_with_primary_ending.push_back(row);
+        }
+      }
+      crlf_is_primary = !crlf_is_primary;
+      rows_with_other_ending = move(rows_with_primary_ending);
+    }
+  }
+
+  bool row_ends_with_crlf(uint32_t row) const {
+    return crlf_is_primary != std::binary_search(
+      rows_with_other_ending.begin(), rows_with_other_ending.end(), row
+    );
+  }
+
+  uint32_t crlf_count_in_rows(uint32_t start_row, uint32_t end_row) const {
+    uint32_t other_count = std::lower_bound(
+      rows_with_other_ending.begin(), rows_with_other_ending.end(), end_row
+    ) - std::lower_bound(
+      rows_with_other_ending.begin(), rows_with_other_ending.end(), start_row
+    );
+    return crlf_is_primary ? end_row - start_row - other_count : other_count;
+  }
+
+  // Adds or subtracts the statistics of the given range along with one
+  // character on either side of it. Returns the row following the last line
+  // ending that was scanned.
+  template <typename Callback>
+  uint32_t scan_range(Layer *layer, Point start, Point end, int32_t sign,
+                      const Callback &line_ending_callback) {
+    Point scan_start = start.column > 0 ? Point(start.row, start.column - 1) : start;
+    Point scan_end = end;
+    layer->for_each_chunk_in_range(end, Point(end.row + 1, 0), [&](TextSlice chunk) {
+      scan_end = chunk.front() == '\n' ? Point(end.row + 1, 0) : Point(end.row, end.column + 1);
+      return true;
+    });
+
+    uint32_t row = scan_start.row;
+    uint32_t column = scan_start.column;
+    bool after_cr = false;
+
+    layer->for_each_chunk_in_range(scan_start, scan_end, [&](TextSlice chunk) {
+      for (uint16_t character : chunk) {
+        if (after_cr) {
+          after_cr = false;
+          if (character == '\n') {
+            totals.crlf_count += sign;
+            update_line_length(column - 1, sign);
+            line_ending_callback(row, true);
+            row++;
+            column = 0;
+            continue;
+          }
+          totals.cr_count += sign;
+        }
+
+        switch (character) {
+          case '\n':
+            totals.lf_count += sign;
+            update_line_length(column, sign);
+            line_ending_callback(row, false);
+            row++;
+            column = 0;
+            continue;
+          case '\r':
+            after_cr = true;
+            break;
+          case 0:
+            totals.nul_count += sign;
+            break;
+          default:
+            if ((character & 0xf800) == 0xd800) totals.surrogate_count += sign;
+            break;
         }
+        column++;
       }
       return false;
     });
-    return result;
+
+    // A '\r' at the end of the scan is paired with the following character,
+    // if any, in the same way on both sides of an edit. The last row usually
+    // extends past the scan, so its length is looked up instead. It is left
+    // alone when it starts after the edited range.
+    if (after_cr) totals.cr_count += sign;
+    if (Point(row, 0) <= end) {
+      update_line_length(layer->clip_position(Point(row, UINT32_MAX)).position.column, sign);
+    }
+    totals.longest_line_length = line_length_counts.empty() ? 0 : line_length_counts.rbegin()->first;
+    return row;
+  }
+
+  size_t memory_usage() const {
+    // Red-black tree nodes hold three pointers and a color alongside the entry.
+    return sizeof(StatisticsIndex) +
+      line_length_counts.size() * (sizeof(std::pair<const uint32_t, uint32_t>) + 4 * sizeof(void *)) +
+      rows_with_other_ending.capacity() * sizeof(uint32_t);
+  }
+
+  void update_line_length(uint32_t length, int32_t sign) {
+    if (sign > 0) {
+      line_length_counts[length]++;
+    } else {
+      auto iter = line_length_counts.find(length);
+      assert(iter != line_length_counts.end());
+      if (--iter->second == 0) line_length_counts.erase(iter);
+    }
   }
 };
 
 TextBuffer::TextBuffer(u16string &&text) :
   base_layer{new Layer(move(text))},
-  top_layer{base_layer} {}
+  top_layer{base_layer},
+  statistics_index{nullptr},
+  transaction_depth{0},
+  loading{false},
+  journal{nullptr},
+  journal_size{0},
+  checkpoint_size{0} {}
 
 TextBuffer::TextBuffer() :
   base_layer{new Layer(Text{})},
-  top_layer{base_layer} {}
+  top_layer{base_layer},
+  statistics_index{nullptr},
+  transaction_depth{0},
+  loading{false},
+  journal{nullptr},
+  journal_size{0},
+  checkpoint_size{0} {}
 
 TextBuffer::~TextBuffer() {
+  delete statistics_index;
+  delete journal;
   Layer *layer = top_layer;
   while (layer) {
     Layer *previous_layer = layer->previous_layer;
@@ -691,6 +806,17 @@ TextBuffer::TextBuffer(const std::u16string &text) :
   TextBuffer{u16string{text.begin(), text.end()}} {}
 
 void TextBuffer::reset(Text &&new_base_text) {
+  reset(std::make_shared<Text>(move(new_base_text)));
+}
+
+// The new base text may also be referenced by a patch describing the reload.
+// It is copied before being modified, like any other shared base text.
+void TextBuffer::reset(shared_ptr<Text> new_base_text) {
+  loading = false;
+  base_text_before_loading.reset();
+  changes_before_loading.clear();
+  delete journal;
+  journal = nullptr;
   bool has_snapshot = false;
   auto layer = top_layer;
   while (layer) {
@@ -702,7 +828,11 @@ void TextBuffer::reset(Text &&new_base_text) {
   }
 
   if (has_snapshot) {
-    set_text(move(new_base_text.content));
+    if (new_base_text.use_count() > 1) {
+      set_text(u16string{new_base_text->content});
+    } else {
+      set_text(move(new_base_text->content));
+    }
     flush_changes();
     return;
   }
@@ -714,15 +844,93 @@ void TextBuffer::reset(Text &&new_base_text) {
     layer = previous_layer;
   }
 
-  top_layer->extent_ = new_base_text.extent();
-  top_layer->size_ = new_base_text.size();
+  delete statistics_index;
+  statistics_index = nullptr;
+
+  top_layer->extent_ = new_base_text->extent();
+  top_layer->size_ = new_base_text->size();
   top_layer->text = move(new_base_text);
+  top_layer->reload_text = nullptr;
+  top_layer->spilled_line_offsets = LineOffsets();
   top_layer->patch.clear();
+  is_modified_cache = optional<bool>{};
   top_layer->uses_patch = false;
   base_layer = top_layer;
   top_layer->previous_layer = nullptr;
 }
 
+// While a buffer is loading, its text is a prefix of the file that grows as
+// more of it is decoded, so its extent is provisional. The buffer can't be
+// edited until loading finishes, which means that the top layer is always the
+// base layer and the text can be appended in place.
+//
+// The previous contents are kept until loading finishes, so that a load that
+// is cancelled or fails part of the way through can be undone. Only one load
+// can be in progress, so this returns false while the buffer is loading.
+bool TextBuffer::begin_loading(Text &&prefix) {
+  if (loading) return false;
+  base_layer->get_text();
+  shared_ptr<Text> base_text = base_layer->text;
+  vector<uint8_t> changes;
+  if (is_modified()) {
+    Serializer serializer(changes);
+    serialize_changes(serializer);
+  }
+
+  reset(move(prefix));
+  loading = true;
+  base_text_before_loading = move(base_text);
+  changes_before_loading = move(changes);
+  return true;
+}
+
+void TextBuffer::append_loaded_text(Text &&text) {
+  if (!loading) return;
+  assert(top_layer == base_layer);
+
+  Point end = extent();
+  if (statistics_index) statistics_index->remove_range(top_layer, end, end);
+
+  // Snapshots may be reading the base text on other threads, so extend a copy
+  // of it in a new layer rather than changing it underneath them.
+  if (base_layer->snapshot_count > 0) {
+    Text new_base_text{base_layer->get_text()};
+    new_base_text.append(text);
+    top_layer = new Layer(top_layer);
+    top_layer->text = std::make_shared<Text>(move(new_base_text));
+    top_layer->uses_patch = false;
+    base_layer = top_layer;
+  } else {
+    base_layer->get_text();
+    if (base_layer->text.use_count() > 1) base_layer->text = std::make_shared<Text>(*base_layer->text);
+    base_layer->text->append(text);
+  }
+
+  top_layer->extent_ = end.traverse(text.extent());
+  top_layer->size_ += text.size();
+  if (statistics_index) statistics_index->insert_range(top_layer, end, end, top_layer->extent_);
+}
+
+void TextBuffer::finish_loading() {
+  loading = false;
+  base_text_before_loading.reset();
+  changes_before_loading.clear();
+}
+
+void TextBuffer::cancel_loading() {
+  if (!loading) return;
+  vector<uint8_t> changes = move(changes_before_loading);
+  reset(move(base_text_before_loading));
+  if (!changes.empty()) {
+    Deserializer deserializer(changes);
+    deserialize_changes(deserializer);
+  }
+}
+
+bool TextBuffer::is_loading() const {
+  return loading;
+}
+
 Patch TextBuffer::get_inverted_changes(const Snapshot *snapshot) const {
   vector<const Patch *> patches;
   Layer *layer = top_layer;
@@ -740,59 +948,216 @@ Patch TextBuffer::get_inverted_changes(const Snapshot *snapshot) const {
 
   TextSlice base{*snapshot->base_layer.text};
   Patch result;
-  for (auto change : combination.get_changes()) {
+  Patch::ChangeIterator changes;
+  combination.iterate_changes(changes);
+  while (auto change = changes.next()) {
     result.splice(
-      change.old_start,
-      change.new_end.traversal(change.new_start),
-      change.old_end.traversal(change.old_start),
-      *change.new_text,
-      Text{base.slice({change.old_start, change.old_end})},
-      change.new_text->size()
+      change->old_start,
+      change->new_end.traversal(change->new_start),
+      change->old_end.traversal(change->old_start),
+      *change->new_text,
+      Text{base.slice({change->old_start, change->old_end})},
+      change->new_text->size()
     );
   }
   return result;
 }
 
 void TextBuffer::serialize_changes(Serializer &serializer) {
+  size_t start_size = serializer.size();
   serializer.append(top_layer->size_);
   top_layer->extent_.serialize(serializer);
   if (top_layer == base_layer) {
     Patch().serialize(serializer);
-    return;
-  }
-
-  if (top_layer->previous_layer == base_layer) {
+  } else if (top_layer->previous_layer == base_layer) {
     top_layer->patch.serialize(serializer);
-    return;
-  }
+  } else {
+    vector<const Patch *> patches;
+    Layer *layer = top_layer;
+    while (layer != base_layer) {
+      patches.insert(patches.begin(), &layer->patch);
+      layer = layer->previous_layer;
+    }
 
-  vector<const Patch *> patches;
-  Layer *layer = top_layer;
-  while (layer != base_layer) {
-    patches.insert(patches.begin(), &layer->patch);
-    layer = layer->previous_layer;
+    Patch combination;
+    bool left_to_right = true;
+    for (const Patch *patch : patches) {
+      combination.combine(*patch, left_to_right);
+      left_to_right = !left_to_right;
+    }
+    combination.serialize(serializer);
   }
 
-  Patch combination;
-  bool left_to_right = true;
-  for (const Patch *patch : patches) {
-    combination.combine(*patch, left_to_right);
-    left_to_right = !left_to_right;
+  // This is a new checkpoint. Record subsequent changes in the journal.
+  delete journal;
+  journal = new Patch();
+  journal_size = 0;
+  checkpoint_size = serializer.size() - start_size;
+}
+
+static const uint32_t JOURNAL_ENTRY_MARKER = 0x4a524e4c;
+
+static uint32_t journal_entry_checksum(const vector<uint8_t> &payload) {
+  uint32_t result = 2166136261u;
+  for (uint8_t byte : payload) {
+    result ^= byte;
+    result *= 16777619u;
   }
-  combination.serialize(serializer);
+  return result;
+}
+
+// Appends the changes made since the last checkpoint or journal entry. Each
+// entry is framed by a marker, its size and a checksum, so that a torn write
+// at the end of a journal is detected when the journal is replayed.
+bool TextBuffer::serialize_journal_entry(Serializer &serializer) {
+  if (!journal || journal->get_change_count() == 0) return false;
+
+  vector<uint8_t> payload;
+  Serializer payload_serializer(payload);
+  payload_serializer.append(top_layer->size_);
+  top_layer->extent_.serialize(payload_serializer);
+  journal->serialize(payload_serializer);
+
+  size_t start_size = serializer.size();
+  serializer.append<uint32_t>(JOURNAL_ENTRY_MARKER);
+  serializer.append<uint32_t>(payload.size());
+  serializer.append<uint32_t>(journal_entry_checksum(payload));
+  serializer.append_bytes(payload.data(), payload.size());
+  journal_size += serializer.size() - start_size;
+  journal->clear();
+  return true;
+}
+
+// The next autosave has to write a checkpoint with `serialize_changes` when
+// there is no journal to append to, such as after a save. Once the journal
+// outgrows its checkpoint, a new checkpoint is also cheaper to replay.
+bool TextBuffer::should_compact_journal() const {
+  return !journal || journal_size > checkpoint_size;
 }
 
 bool TextBuffer::deserialize_changes(Deserializer &deserializer) {
-  if (top_layer != base_layer || base_layer->previous_layer) return false;
+  if (top_layer != base_layer || base_layer->previous_layer || loading) return false;
   top_layer = new Layer(base_layer);
   top_layer->size_ = deserializer.read<uint32_t>();
   top_layer->extent_ = Point(deserializer);
   top_layer->patch = Patch(deserializer);
+  is_modified_cache = optional<bool>{};
+  delete statistics_index;
+  statistics_index = nullptr;
+  delete journal;
+  journal = nullptr;
+
+  // Replay any journal entries that follow the checkpoint, stopping at the
+  // first one that is incomplete or corrupt. Each entry starts with a marker,
+  // the payload size and a checksum.
+  while (deserializer.remaining() >= 3 * sizeof(uint32_t) &&
+         deserializer.read<uint32_t>() == JOURNAL_ENTRY_MARKER) {
+    uint32_t payload_size = deserializer.read<uint32_t>();
+    uint32_t checksum = deserializer.read<uint32_t>();
+    const uint8_t *payload_bytes = deserializer.read_bytes(payload_size);
+    if (!payload_bytes) break;
+
+    vector<uint8_t> payload(payload_bytes, payload_bytes + payload_size);
+    if (journal_entry_checksum(payload) != checksum) break;
+
+    Deserializer entry_deserializer(payload);
+    uint32_t size = entry_deserializer.read<uint32_t>();
+    Point extent(entry_deserializer);
+    Patch changes(entry_deserializer);
+
+    // Check that the entry produces the size and extent it recorded before
+    // applying it, so that an entry written against different text leaves
+    // the buffer as it was.
+    uint32_t expected_size = top_layer->size_;
+    Point expected_extent = top_layer->extent_;
+    bool entry_applies = true;
+    Patch::ChangeIterator change_iterator;
+    changes.iterate_changes(change_iterator);
+    while (auto change = change_iterator.next()) {
+      auto start = top_layer->clip_position(change->old_start);
+      auto end = top_layer->clip_position(change->old_end);
+      if (start.position != change->old_start || end.position != change->old_end) {
+        entry_applies = false;
+        break;
+      }
+      expected_size += change->new_text->size() - (end.offset - start.offset);
+      expected_extent = change->new_end.traverse(top_layer->extent_.traversal(change->old_end));
+    }
+    if (!entry_applies || expected_size != size || expected_extent != extent) break;
+
+    changes.iterate_changes(change_iterator);
+    while (auto change = change_iterator.next()) {
+      set_text_in_range(
+        Range{change->new_start, change->new_start.traverse(change->old_end.traversal(change->old_start))},
+        u16string(change->new_text->content)
+      );
+    }
+  }
+
   return true;
 }
 
 const Text &TextBuffer::base_text() const {
-  return *base_layer->text;
+  return base_layer->get_text();
+}
+
+// Base texts that have been interned by any buffer, keyed by their digest.
+// The buffers own the texts; entries expire when the last buffer lets go.
+static std::mutex interned_texts_mutex;
+static std::unordered_map<size_t, std::weak_ptr<Text>> interned_texts;
+
+bool TextBuffer::intern_base_text() {
+  if (!reload_base_text()) return false;
+  shared_ptr<Text> &text = base_layer->text;
+  size_t digest = text->digest();
+
+  std::lock_guard<std::mutex> lock(interned_texts_mutex);
+  for (auto iter = interned_texts.begin(); iter != interned_texts.end();) {
+    if (iter->second.expired()) {
+      iter = interned_texts.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  auto &entry = interned_texts[digest];
+  shared_ptr<Text> interned_text = entry.lock();
+  if (!interned_text) {
+    entry = text;
+  } else if (interned_text != text && *interned_text == *text) {
+    text = interned_text;
+  }
+
+  interned_text.reset();
+  return text.use_count() > 1;
+}
+
+// Release the base text, keeping only its extent, size, line offsets and
+// digest resident. The given function must reproduce the same text; it is
+// called the first time the characters are needed again, or by
+// `reload_base_text`. The base text can't be released while a snapshot refers
+// to it, because snapshots may be read on other threads, or while the buffer
+// is loading.
+bool TextBuffer::spill_base_text(std::function<optional<Text>()> &&reload) {
+  if (base_layer->is_spilled() || base_layer->snapshot_count > 0 || loading) return false;
+  base_layer->spilled_line_offsets = base_layer->text->line_offsets;
+  base_layer->spilled_line_offsets.shrink_to_fit();
+  base_layer->spilled_digest = base_layer->text->digest();
+  base_layer->text.reset();
+  base_layer->reload_text = move(reload);
+  return true;
+}
+
+bool TextBuffer::is_base_text_spilled() const {
+  return base_layer->is_spilled();
+}
+
+// Reloads a spilled base text now. If the characters can't be reloaded, or
+// don't match the ones that were spilled, the base text stays spilled and
+// reads of it see U+FFFD characters, so callers that report errors should
+// reload before reading.
+bool TextBuffer::reload_base_text() {
+  return !base_layer->is_spilled() || base_layer->reload_spilled_text();
 }
 
 Point TextBuffer::extent() const {
@@ -815,17 +1180,9 @@ const uint16_t *TextBuffer::line_ending_for_row(uint32_t row) {
   static uint16_t CRLF[] = {'\r', '\n', 0};
   static uint16_t NONE[] = {0};
 
-  const uint16_t *result = NONE;
-  top_layer->for_each_chunk_in_range(
-    clip_position(Point(row, UINT32_MAX)).position,
-    Point(row + 1, 0),
-    [&result](TextSlice slice) {
-      auto begin = slice.begin();
-      if (begin == slice.end()) return false;
-      result = (*begin == '\r') ? CRLF : LF;
-      return true;
-    }, true);
-  return result;
+  if (row == extent().row) return NONE;
+  statistics();
+  return statistics_index->row_ends_with_crlf(row) ? CRLF : LF;
 }
 
 void TextBuffer::with_line_for_row(uint32_t row, const std::function<void(const char16_t *, uint32_t)> &callback) {
@@ -890,17 +1247,97 @@ void TextBuffer::set_text(const u16string &new_text) {
 }
 
 void TextBuffer::set_text_in_range(Range old_range, u16string &&string) {
+  if (loading) return;
   if (top_layer == base_layer || top_layer->snapshot_count > 0) {
     top_layer = new Layer(top_layer);
   }
 
   auto start = clip_position(old_range.start);
   auto end = old_range.end == old_range.start ? start : clip_position(old_range.end);
+  set_text_in_clipped_range(start, end, Text{move(string)});
+}
+
+optional<vector<Range>> TextBuffer::set_text_in_ranges(vector<pair<Range, u16string>> &&edits) {
+  if (loading) return optional<vector<Range>>{};
+
+  // All of the ranges refer to the text as it is before any of the edits, so
+  // clip them up front and make sure they don't overlap.
+  vector<pair<ClipResult, ClipResult>> clipped_ranges;
+  clipped_ranges.reserve(edits.size());
+  for (const auto &edit : edits) {
+    auto start = clip_position(edit.first.start);
+    auto end = edit.first.end == edit.first.start ? start : clip_position(edit.first.end);
+    if (end.offset < start.offset) return optional<vector<Range>>{};
+    if (!clipped_ranges.empty() && start.offset < clipped_ranges.back().second.offset) {
+      return optional<vector<Range>>{};
+    }
+    clipped_ranges.push_back({start, end});
+  }
+
+  if (top_layer == base_layer || top_layer->snapshot_count > 0) {
+    top_layer = new Layer(top_layer);
+  }
+
+  // Apply the edits from last to first, so that the clipped positions of the
+  // remaining edits stay valid. Each splice lands right next to the node that
+  // the previous one splayed to the root, so the patch is only traversed once.
+  vector<Point> inserted_extents(edits.size());
+  for (size_t i = edits.size(); i > 0; i--) {
+    Text new_text{move(edits[i - 1].second)};
+    inserted_extents[i - 1] = new_text.extent();
+    set_text_in_clipped_range(clipped_ranges[i - 1].first, clipped_ranges[i - 1].second, move(new_text));
+  }
+
+  vector<Range> result;
+  result.reserve(edits.size());
+  Point previous_old_end, previous_new_end;
+  for (size_t i = 0; i < edits.size(); i++) {
+    Point new_start = previous_new_end.traverse(
+      clipped_ranges[i].first.position.traversal(previous_old_end)
+    );
+    Point new_end = new_start.traverse(inserted_extents[i]);
+    result.push_back(Range{new_start, new_end});
+    previous_old_end = clipped_ranges[i].second.position;
+    previous_new_end = new_end;
+  }
+
+  return result;
+}
+
+void TextBuffer::begin_transaction() {
+  transaction_depth++;
+}
+
+void TextBuffer::commit_transaction() {
+  if (transaction_depth == 0 || --transaction_depth > 0) return;
+
+  // Splicing a long run of changes into the patch leaves it in whatever shape
+  // the splay operations produced, which is often close to a linked list.
+  // Rebalance it once here rather than paying for deep non-splaying reads.
+  if (top_layer != base_layer && top_layer->snapshot_count == 0) {
+    top_layer->patch.rebalance();
+  }
+}
+
+void TextBuffer::set_text_in_clipped_range(ClipResult start, ClipResult end, Text &&new_text) {
+  is_modified_cache = optional<bool>{};
+  if (statistics_index) statistics_index->remove_range(top_layer, start.position, end.position);
+
   Point deleted_extent = end.position.traversal(start.position);
-  Text new_text{move(string)};
   Point inserted_extent = new_text.extent();
-  Point new_range_end = start.position.traverse(new_text.extent());
+  Point new_range_end = start.position.traverse(inserted_extent);
   uint32_t deleted_text_size = end.offset - start.offset;
+  if (journal) {
+    journal->splice(
+      start.position,
+      deleted_extent,
+      inserted_extent,
+      optional<Text>{},
+      Text{new_text},
+      deleted_text_size
+    );
+  }
+
   top_layer->extent_ = new_range_end.traverse(top_layer->extent_.traversal(end.position));
   top_layer->size_ += new_text.size() - deleted_text_size;
   top_layer->patch.splice(
@@ -932,6 +1369,10 @@ void TextBuffer::set_text_in_range(Range old_range, u16string &&string) {
       top_layer->patch.splice_old(change->old_start, Point(), Point());
     }
   }
+
+  if (statistics_index) {
+    statistics_index->insert_range(top_layer, start.position, end.position, new_range_end);
+  }
 }
 
 optional<Range> TextBuffer::find(const Regex &regex, Range range) const {
@@ -960,12 +1401,80 @@ vector<SubsequenceMatch> TextBuffer::find_words_with_subsequence_in_range(const
   return top_layer->find_words_with_subsequence_in_range(query, non_word_characters, range);
 }
 
+// Cached until the text or the base layer changes.
 bool TextBuffer::is_modified() const {
-  return top_layer->is_modified(base_layer);
+  if (!is_modified_cache) is_modified_cache = top_layer->is_modified(base_layer);
+  return *is_modified_cache;
 }
 
 bool TextBuffer::has_astral() {
-  return top_layer->has_astral();
+  return statistics().surrogate_count > 0;
+}
+
+TextBuffer::Statistics TextBuffer::statistics() {
+  if (!statistics_index) statistics_index = new StatisticsIndex(top_layer);
+  return statistics_index->totals;
+}
+
+TextBuffer::LineEndingCounts TextBuffer::line_ending_counts(uint32_t start_row, uint32_t end_row) {
+  end_row = std::min(end_row, extent().row);
+  if (start_row >= end_row) return {0, 0};
+  statistics();
+  uint32_t crlf_count = statistics_index->crlf_count_in_rows(start_row, end_row);
+  return {end_row - start_row - crlf_count, crlf_count};
+}
+
+bool TextBuffer::has_mixed_line_endings() {
+  auto totals = statistics();
+  return totals.lf_count > 0 && totals.crlf_count > 0;
+}
+
+void TextBuffer::normalize_line_endings(const u16string &line_ending) {
+  statistics();
+
+  // When the requested line ending is the more common one, only the rows
+  // that are indexed as ending differently need to be visited.
+  vector<uint32_t> rows;
+  bool use_crlf = line_ending == u"\r\n";
+  if ((use_crlf || line_ending == u"\n") && use_crlf == statistics_index->crlf_is_primary) {
+    rows = statistics_index->rows_with_other_ending;
+  } else {
+    for (uint32_t row = 0, last_row = extent().row; row < last_row; row++) {
+      if (line_ending != (statistics_index->row_ends_with_crlf(row) ? u"\r\n" : u"\n")) {
+        rows.push_back(row);
+      }
+    }
+  }
+
+  vector<pair<Range, u16string>> changes;
+  changes.reserve(rows.size());
+  for (uint32_t row : rows) {
+    uint32_t line_length = top_layer->clip_position(Point{row, UINT32_MAX}).position.column;
+    changes.push_back({Range{Point(row, line_length), Point(row + 1, 0)}, line_ending});
+  }
+  if (changes.empty()) return;
+
+  // Updating the index for each replaced line ending would shift its rows
+  // once per edit, so set it aside and account for the whole batch at once.
+  StatisticsIndex *index = statistics_index;
+  statistics_index = nullptr;
+  if (!set_text_in_ranges(move(changes))) {
+    statistics_index = index;
+    return;
+  }
+
+  // Each '\n' became "\r\n", so every row keeps its length and now ends
+  // with CRLF. Other replacements can join a preceding '\r' to the new
+  // ending, so the index is rebuilt the next time it is needed instead.
+  if (use_crlf) {
+    index->totals.crlf_count += index->totals.lf_count;
+    index->totals.lf_count = 0;
+    index->crlf_is_primary = true;
+    index->rows_with_other_ending.clear();
+    statistics_index = index;
+  } else {
+    delete index;
+  }
 }
 
 bool TextBuffer::is_modified(const Snapshot *snapshot) const {
@@ -996,6 +1505,60 @@ string TextBuffer::get_dot_graph() const {
   return result.str();
 }
 
+TextBuffer::MemoryUsage TextBuffer::get_memory_usage() const {
+  MemoryUsage result{};
+  if (statistics_index) result.index_bytes = statistics_index->memory_usage();
+
+  for (const Layer *layer = top_layer; layer; layer = layer->previous_layer) {
+    result.layer_count++;
+    if (layer->snapshot_count > 0) result.snapshot_layer_count++;
+
+    if (layer->text) {
+      if (layer == base_layer) {
+        result.base_text_bytes += layer->text->memory_usage();
+      } else {
+        result.snapshot_text_bytes += layer->text->memory_usage();
+      }
+    }
+    if (layer->is_spilled()) {
+      result.base_text_bytes += layer->spilled_line_offsets.capacity() * sizeof(uint32_t);
+    }
+
+    auto patch_memory_usage = layer->patch.get_memory_usage();
+    result.patch_node_bytes += sizeof(Layer) + patch_memory_usage.node_bytes + patch_memory_usage.stack_bytes;
+    result.patch_text_bytes += patch_memory_usage.text_bytes;
+  }
+
+  if (journal) {
+    auto journal_memory_usage = journal->get_memory_usage();
+    result.patch_node_bytes += journal_memory_usage.node_bytes + journal_memory_usage.stack_bytes;
+    result.patch_text_bytes += journal_memory_usage.text_bytes;
+  }
+
+  return result;
+}
+
+void TextBuffer::trim_memory(TrimLevel level) {
+  consolidate_layers();
+
+  // Snapshots may be reading their own layer and every layer below it on
+  // other threads, so those are left untouched.
+  for (Layer *layer = top_layer; layer; layer = layer->previous_layer) {
+    if (layer->snapshot_count > 0) break;
+    if (layer->text && layer->text.use_count() == 1) layer->text->shrink_to_fit();
+    layer->patch.trim_memory();
+  }
+
+  if (statistics_index) {
+    if (level >= TrimCaches) {
+      delete statistics_index;
+      statistics_index = nullptr;
+    } else {
+      statistics_index->rows_with_other_ending.shrink_to_fit();
+    }
+  }
+}
+
 size_t TextBuffer::layer_count() const {
   size_t result = 1;
   const Layer *layer = top_layer;
@@ -1007,15 +1570,27 @@ size_t TextBuffer::layer_count() const {
 }
 
 TextBuffer::Snapshot *TextBuffer::create_snapshot() {
+  // Snapshots can be read on other threads, so their base text must be resident.
+  base_layer->get_text();
   top_layer->snapshot_count++;
   base_layer->snapshot_count++;
   return new Snapshot(*this, *top_layer, *base_layer);
 }
 
 void TextBuffer::flush_changes() {
-  if (!top_layer->text) {
-    top_layer->text = Text{text()};
+  // Don't turn stand-ins for a base text that couldn't be reloaded into real
+  // text.
+  if (!reload_base_text()) return;
+
+  // The saved text is the new base, so earlier checkpoints and journal
+  // entries no longer apply. The next autosave has to write a checkpoint.
+  delete journal;
+  journal = nullptr;
+
+  if (!top_layer->has_text()) {
+    top_layer->text = std::make_shared<Text>(text());
     base_layer = top_layer;
+    is_modified_cache = optional<bool>{};
     consolidate_layers();
   }
 }
@@ -1068,14 +1643,22 @@ const Text &TextBuffer::Snapshot::base_text() const {
   return *base_layer.text;
 }
 
+shared_ptr<const Text> TextBuffer::Snapshot::shared_base_text() const {
+  return base_layer.text;
+}
+
 TextBuffer::Snapshot::Snapshot(TextBuffer &buffer, TextBuffer::Layer &layer,
                                TextBuffer::Layer &base_layer)
   : buffer{buffer}, layer{layer}, base_layer{base_layer} {}
 
 void TextBuffer::Snapshot::flush_preceding_changes() {
+  if (base_layer.is_spilled()) return;
   if (!layer.text) {
-    layer.text = Text{text()};
-    if (layer.is_above_layer(buffer.base_layer)) buffer.base_layer = &layer;
+    layer.text = std::make_shared<Text>(text());
+    if (layer.is_above_layer(buffer.base_layer)) {
+      buffer.base_layer = &layer;
+      buffer.is_modified_cache = optional<bool>{};
+    }
     buffer.consolidate_layers();
   }
 }
@@ -1105,7 +1688,7 @@ void TextBuffer::consolidate_layers() {
         mutable_layers.clear();
       }
 
-      if (layer->text) layer->uses_patch = false;
+      if (layer->has_text()) layer->uses_patch = false;
       mutable_layers.push_back(layer);
     }
 
@@ -1122,23 +1705,28 @@ void TextBuffer::squash_layers(const vector<Layer *> &layers) {
   if (layer_count < 2) return;
 
   // Find the highest layer that has already computed its text.
-  optional<Text> text;
+  shared_ptr<Text> text;
   for (layer_index = 0; layer_index < layer_count; layer_index++) {
-    if (layers[layer_index]->text) {
-      text = move(*layers[layer_index]->text);
+    if (layers[layer_index]->has_text()) {
+      layers[layer_index]->get_text();
+      text = move(layers[layer_index]->text);
       break;
     }
   }
 
-  // Incorporate into that text the patches from all the layers above.
+  // Incorporate into that text the patches from all the layers above. If the
+  // text is shared with other buffers, copy it first.
   if (text) {
+    if (layer_index > 0 && text.use_count() > 1) text = std::make_shared<Text>(*text);
     layer_index--;
+    Patch::ChangeIterator changes;
     for (; layer_index + 1 > 0; layer_index--) {
-      for (auto change : layers[layer_index]->patch.get_changes()) {
+      layers[layer_index]->patch.iterate_changes(changes);
+      while (auto change = changes.next()) {
         text->splice(
-          change.new_start,
-          change.old_end.traversal(change.old_start),
-          *change.new_text
+          change->new_start,
+          change->old_end.traversal(change->old_start),
+          *change->new_text
         );
       }
     }
@@ -1,6 +1,7 @@
 #ifndef SUPERSTRING_TEXT_BUFFER_H_
 #define SUPERSTRING_TEXT_BUFFER_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 #include "text.h"
@@ -12,10 +13,21 @@
 
 class TextBuffer {
   struct Layer;
+  struct StatisticsIndex;
   Layer *base_layer;
   Layer *top_layer;
+  StatisticsIndex *statistics_index;
+  uint32_t transaction_depth;
+  bool loading;
+  std::shared_ptr<Text> base_text_before_loading;
+  std::vector<uint8_t> changes_before_loading;
+  Patch *journal;
+  size_t journal_size;
+  size_t checkpoint_size;
+  mutable optional<bool> is_modified_cache;
   void squash_layers(const std::vector<Layer *> &);
   void consolidate_layers();
+  void set_text_in_clipped_range(ClipResult start, ClipResult end, Text &&);
 
 public:
   static uint32_t MAX_CHUNK_SIZE_TO_COPY;
@@ -41,15 +53,50 @@ public:
   void set_text(const std::u16string &);
   void set_text_in_range(Range old_range, std::u16string &&);
   void set_text_in_range(Range old_range, const std::u16string &);
+  optional<std::vector<Range>> set_text_in_ranges(std::vector<std::pair<Range, std::u16string>> &&);
+  void begin_transaction();
+  void commit_transaction();
   bool is_modified() const;
   bool has_astral();
+
+  struct Statistics {
+    uint32_t lf_count;
+    uint32_t crlf_count;
+    uint32_t cr_count;
+    uint32_t nul_count;
+    uint32_t surrogate_count;
+    uint32_t longest_line_length;
+  };
+
+  Statistics statistics();
+
+  struct LineEndingCounts {
+    uint32_t lf_count;
+    uint32_t crlf_count;
+  };
+
+  LineEndingCounts line_ending_counts(uint32_t start_row, uint32_t end_row);
+  bool has_mixed_line_endings();
+  void normalize_line_endings(const std::u16string &line_ending);
   std::vector<TextSlice> chunks() const;
 
   void reset(Text &&);
+  void reset(std::shared_ptr<Text>);
+  bool begin_loading(Text &&);
+  void append_loaded_text(Text &&);
+  void finish_loading();
+  void cancel_loading();
+  bool is_loading() const;
   void flush_changes();
   void serialize_changes(Serializer &);
+  bool serialize_journal_entry(Serializer &);
+  bool should_compact_journal() const;
   bool deserialize_changes(Deserializer &);
   const Text &base_text() const;
+  bool intern_base_text();
+  bool spill_base_text(std::function<optional<Text>()> &&reload);
+  bool is_base_text_spilled() const;
+  bool reload_base_text();
 
   optional<Range> find(const Regex &, Range range = Range::all_inclusive()) const;
   std::vector<Range> find_all(const Regex &, Range range = Range::all_inclusive()) const;
@@ -87,6 +134,7 @@ public:
     std::u16string text() const;
     std::u16string text_in_range(Range) const;
     const Text &base_text() const;
+    std::shared_ptr<const Text> shared_base_text() const;
     optional<Range> find(const Regex &, Range range = Range::all_inclusive()) const;
     std::vector<Range> find_all(const Regex &, Range range = Range::all_inclusive()) const;
     std::vector<SubsequenceMatch> find_words_with_subsequence_in_range(std::u16string query, const std::u16string &extra_word_characters, Range range) const;
@@ -98,6 +146,24 @@ public:
   bool is_modified(const Snapshot *) const;
   Patch get_inverted_changes(const Snapshot *) const;
 
+  struct MemoryUsage {
+    size_t base_text_bytes;
+    size_t snapshot_text_bytes;
+    size_t patch_node_bytes;
+    size_t patch_text_bytes;
+    size_t index_bytes;
+    uint32_t layer_count;
+    uint32_t snapshot_layer_count;
+  };
+
+  MemoryUsage get_memory_usage() const;
+
+  enum TrimLevel {
+    TrimContainers = 0,
+    TrimCaches = 1,
+  };
+
+  void trim_memory(TrimLevel level = TrimContainers);
   size_t layer_count()  const;
   std::string get_dot_graph() const;
 };
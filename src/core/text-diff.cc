@@ -18,8 +18,10 @@ static Point previous_column(Point position) {
 
 static int MAX_EDIT_DISTANCE = 4 * 1024;
 
-Patch text_diff(const Text &old_text, const Text &new_text) {
-  Patch result;
+// Returns false without changing the result if the texts are too different
+// to diff, in which case the caller should replace one with the other.
+static bool diff_texts(const Text &old_text, const Text &new_text, Patch &result) {
+  vector<Patch::SortedChange> changes;
   Text empty;
   Text cr{u"\r"};
   Text lf{u"\n"};
@@ -35,10 +37,7 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
     &edit_script
   );
 
-  if (edit_distance == -1 || edit_distance >= MAX_EDIT_DISTANCE) {
-    result.splice(Point(), old_text.extent(), new_text.extent(), old_text, new_text);
-    return result;
-  }
+  if (edit_distance == -1 || edit_distance >= MAX_EDIT_DISTANCE) return false;
 
   size_t old_offset = 0;
   size_t new_offset = 0;
@@ -55,7 +54,7 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         if (new_text.at(new_offset) == '\n' &&
             ((old_offset > 0 && old_text.at(old_offset - 1) == '\r') ||
              (new_offset > 0 && new_text.at(new_offset - 1) == '\r'))) {
-          result.splice(new_position, Point(1, 0), Point(1, 0), lf, lf);
+          changes.push_back({new_position, Point(1, 0), Point(1, 0), lf, lf, 0});
           old_position.row++;
           old_position.column = 0;
           new_position.row++;
@@ -72,7 +71,7 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         if (new_text.at(new_offset - 1) == '\r' &&
             ((old_offset < old_text.size() && old_text.at(old_offset) == '\n') ||
              (new_offset < new_text.size() && new_text.at(new_offset) == '\n'))) {
-          result.splice(previous_column(new_position), Point(0, 1), Point(0, 1), cr, cr);
+          changes.push_back({previous_column(new_position), Point(0, 1), Point(0, 1), cr, cr, 0});
         }
         break;
 
@@ -81,7 +80,7 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         Text deleted_text{old_text.begin() + old_offset, old_text.begin() + deletion_end};
         old_offset = deletion_end;
         Point next_old_position = old_text.position_for_offset(old_offset, 0, false);
-        result.splice(new_position, next_old_position.traversal(old_position), Point(), deleted_text, empty);
+        changes.push_back({new_position, next_old_position.traversal(old_position), Point(), move(deleted_text), empty, 0});
         old_position = next_old_position;
         break;
       }
@@ -91,12 +90,33 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         Text inserted_text{new_text.begin() + new_offset, new_text.begin() + insertion_end};
         new_offset = insertion_end;
         Point next_new_position = new_text.position_for_offset(new_offset, 0, false);
-        result.splice(new_position, Point(), next_new_position.traversal(new_position), empty, inserted_text);
+        changes.push_back({new_position, Point(), next_new_position.traversal(new_position), empty, move(inserted_text), 0});
         new_position = next_new_position;
         break;
       }
     }
   }
 
+  result = Patch::from_sorted_changes(move(changes));
+  return true;
+}
+
+Patch text_diff(const Text &old_text, const Text &new_text) {
+  Patch result;
+  if (!diff_texts(old_text, new_text, result)) {
+    result.splice(Point(), old_text.extent(), new_text.extent(), old_text, new_text);
+  }
+  return result;
+}
+
+// The pieces of a successful diff are bounded by the maximum edit distance,
+// but replacing a whole text would copy both of them, so the patch shares
+// them instead.
+Patch text_diff(const std::shared_ptr<const Text> &old_text,
+                const std::shared_ptr<const Text> &new_text) {
+  Patch result;
+  if (!diff_texts(*old_text, *new_text, result)) {
+    result.splice(Point(), old_text->extent(), new_text->extent(), old_text, new_text);
+  }
   return result;
 }
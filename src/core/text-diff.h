@@ -3,7 +3,10 @@
 
 #include "patch.h"
 #include "text.h"
+#include <memory>
 
 Patch text_diff(const Text &old_text, const Text &new_text);
+Patch text_diff(const std::shared_ptr<const Text> &old_text,
+                const std::shared_ptr<const Text> &new_text);
 
 #endif  // SUPERSTRING_TEXT_DIFF_H
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "text.h"
 #include <algorithm>
+#include <string.h>
 #include "text-slice.h"
 
 using std::function;
@@ -42,14 +43,20 @@ Text::Text(TextSlice slice) :
 Text::Text(const u16string &&content, const vector<uint32_t> &&line_offsets) :
   content{move(content)}, line_offsets{move(line_offsets)} {}
 
-Text::Text(Deserializer &deserializer) : line_offsets{0} {
+static u16string read_utf16(const uint8_t *bytes, uint32_t size) {
+  u16string result(size, 0);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for (uint32_t i = 0; i < size; i++) result[i] = bytes[2 * i] | (bytes[2 * i + 1] << 8);
+#else
+  if (size > 0) memcpy(&result[0], bytes, size * sizeof(char16_t));
+#endif
+  return result;
+}
+
+Text::Text(Deserializer &deserializer) : Text() {
   uint32_t size = deserializer.read<uint32_t>();
-  content.reserve(size);
-  for (uint32_t offset = 0; offset < size; offset++) {
-    uint16_t character = deserializer.read<uint16_t>();
-    content.push_back(character);
-    if (character == '\n') line_offsets.push_back(offset + 1);
-  }
+  const uint8_t *bytes = deserializer.read_bytes(static_cast<size_t>(size) * sizeof(char16_t));
+  if (bytes) *this = Text{read_utf16(bytes, size)};
 }
 
 void Text::serialize(Serializer &serializer) const {
@@ -59,6 +66,42 @@ void Text::serialize(Serializer &serializer) const {
   }
 }
 
+// The compact form starts with a varint holding the size and a flag saying
+// whether every character fits in one byte. Such text is stored one byte per
+// character; anything else is stored as little-endian UTF-16.
+void Text::serialize_compact(Serializer &serializer) const {
+  bool is_packed = std::all_of(content.begin(), content.end(), [](char16_t c) { return c < 0x100; });
+  serializer.append_varint((static_cast<uint64_t>(size()) << 1) | is_packed);
+
+  if (is_packed) {
+    uint8_t *bytes = serializer.extend(size());
+    for (char16_t character : content) *(bytes++) = character;
+    return;
+  }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for (char16_t character : content) serializer.append<uint16_t>(character);
+#else
+  serializer.append_bytes(content.data(), content.size() * sizeof(char16_t));
+#endif
+}
+
+Text Text::deserialize_compact(Deserializer &deserializer) {
+  uint64_t header = deserializer.read_varint<uint64_t>();
+  uint32_t size = header >> 1;
+  bool is_packed = header & 1;
+
+  u16string content;
+  if (is_packed) {
+    const uint8_t *bytes = deserializer.read_bytes(size);
+    if (bytes) content.assign(bytes, bytes + size);
+  } else {
+    const uint8_t *bytes = deserializer.read_bytes(static_cast<size_t>(size) * sizeof(char16_t));
+    if (bytes) content = read_utf16(bytes, size);
+  }
+  return Text{move(content)};
+}
+
 Point Text::extent(const std::u16string &string) {
   Point result;
   for (auto c : string) {
@@ -87,6 +130,15 @@ Text Text::concat(TextSlice a, TextSlice b, TextSlice c) {
   return result;
 }
 
+size_t Text::memory_usage() const {
+  return content.capacity() * sizeof(char16_t) + line_offsets.capacity() * sizeof(uint32_t);
+}
+
+void Text::shrink_to_fit() {
+  content.shrink_to_fit();
+  line_offsets.shrink_to_fit();
+}
+
 void Text::clear() {
   content.clear();
   line_offsets.assign({0});
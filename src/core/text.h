@@ -6,6 +6,7 @@
 #include <vector>
 #include <ostream>
 #include "serializer.h"
+#include "line-offsets.h"
 #include "point.h"
 #include "optional.h"
 
@@ -21,9 +22,10 @@ class Text {
 
  public:
   static Point extent(const std::u16string &);
+  static Text deserialize_compact(Deserializer &);
 
   std::u16string content;
-  std::vector<uint32_t> line_offsets;
+  LineOffsets line_offsets;
   Text(const std::u16string &&, const std::vector<uint32_t> &&);
 
   using const_iterator = std::u16string::const_iterator;
@@ -55,9 +57,12 @@ class Text {
   void append(TextSlice);
   void assign(TextSlice);
   void serialize(Serializer &) const;
+  void serialize_compact(Serializer &) const;
   uint32_t size() const;
   const char16_t *data() const;
   size_t digest() const;
+  size_t memory_usage() const;
+  void shrink_to_fit();
   void clear();
 
   bool operator!=(const Text &) const;
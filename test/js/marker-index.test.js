@@ -534,4 +534,34 @@ describe('MarkerIndex', () => {
     let result = index.findEndingIn({row: 0, column: 0}, {row: Infinity, column: Infinity})
     assert(result.has(1))
   })
+
+  it('reports its memory usage', () => {
+    let index = new MarkerIndex()
+    assert.equal(index.getMemoryUsage().nodeCount, 0)
+
+    index.insert(1, {row: 1, column: 2}, {row: 3, column: 4})
+    index.insert(2, {row: 2, column: 2}, {row: 3, column: 4})
+    const memoryUsage = index.getMemoryUsage()
+    assert.equal(memoryUsage.nodeCount, 3)
+    assert(memoryUsage.nodeBytes > 0)
+    assert(memoryUsage.markerIdSetBytes > 0)
+    assert(memoryUsage.hashTableBytes > 0)
+  })
+
+  it('can trim its memory without changing its markers', () => {
+    let index = new MarkerIndex()
+    for (let i = 0; i < 100; i++) {
+      index.insert(i, {row: i, column: 0}, {row: i + 1, column: 0})
+    }
+    for (let i = 0; i < 90; i++) {
+      index.remove(i)
+    }
+
+    const snapshot = index.dump()
+    index.trimMemory()
+    assert.deepEqual(index.dump(), snapshot)
+    const intersecting = index.findIntersecting({row: 95, column: 0}, {row: 95, column: 0})
+    assert.equal(intersecting.size, 2)
+    assert(intersecting.has(94) && intersecting.has(95))
+  })
 })
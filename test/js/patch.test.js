@@ -60,6 +60,26 @@ describe('Patch', function () {
     patch.delete();
   })
 
+  it('honors the storeText option set to false', function () {
+    const patch = new Patch({storeText: false})
+
+    patch.splice({row: 0, column: 5}, {row: 0, column: 1}, {row: 0, column: 2}, 'a', 'bc')
+    patch.splice({row: 0, column: 10}, {row: 0, column: 3}, {row: 0, column: 4}, 'def', 'ghij')
+    assert.deepEqual(JSON.parse(JSON.stringify(patch.getChanges())), [
+      {
+        oldStart: {row: 0, column: 5}, oldEnd: {row: 0, column: 6},
+        newStart: {row: 0, column: 5}, newEnd: {row: 0, column: 7}
+      },
+      {
+        oldStart: {row: 0, column: 9}, oldEnd: {row: 0, column: 12},
+        newStart: {row: 0, column: 10}, newEnd: {row: 0, column: 14}
+      }
+    ])
+    assert.equal(patch.getMemoryUsage().textBytes, 0)
+
+    patch.delete();
+  })
+
   describe('.compose', () => {
     it('combines the given patches into one', () => {
       const patches = [new Patch(), new Patch(), new Patch()]
@@ -175,6 +195,38 @@ describe('Patch', function () {
     patch2.delete();
   })
 
+  it('can transform concurrent patches over each other', function () {
+    const patch = new Patch()
+    patch.splice({row: 0, column: 1}, {row: 0, column: 2}, {row: 0, column: 1}, 'bc', 'X')
+    const otherPatch = new Patch()
+    otherPatch.splice({row: 0, column: 1}, {row: 0, column: 0}, {row: 0, column: 1}, '', 'Y')
+
+    const transformedPatch = patch.transform(otherPatch, 'after')
+    assert.deepEqual(JSON.parse(JSON.stringify(transformedPatch.getChanges())), [
+      {
+        oldStart: {row: 0, column: 2}, oldEnd: {row: 0, column: 4},
+        newStart: {row: 0, column: 2}, newEnd: {row: 0, column: 3},
+        oldText: 'bc',
+        newText: 'X'
+      }
+    ])
+
+    const transformedOtherPatch = otherPatch.transform(patch, 'before')
+    assert.deepEqual(JSON.parse(JSON.stringify(transformedOtherPatch.getChanges())), [
+      {
+        oldStart: {row: 0, column: 1}, oldEnd: {row: 0, column: 1},
+        newStart: {row: 0, column: 1}, newEnd: {row: 0, column: 2},
+        oldText: '',
+        newText: 'Y'
+      }
+    ])
+
+    patch.delete()
+    otherPatch.delete()
+    transformedPatch.delete()
+    transformedOtherPatch.delete()
+  })
+
   it('can copy patches', function () {
     const patch = new Patch()
     patch.splice({row: 0, column: 3}, {row: 0, column: 4}, {row: 0, column: 5}, 'ciao', 'hello')
@@ -373,6 +425,36 @@ describe('Patch', function () {
     }
   })
 
+  it('reports its memory usage', () => {
+    const patch = new Patch()
+    assert.equal(patch.getMemoryUsage().nodeCount, 0)
+
+    patch.splice({row: 0, column: 5}, {row: 0, column: 1}, {row: 0, column: 3}, 'a', 'bcd')
+    patch.splice({row: 0, column: 10}, {row: 0, column: 1}, {row: 0, column: 3}, 'e', 'fgh')
+    const memoryUsage = patch.getMemoryUsage()
+    assert.equal(memoryUsage.nodeCount, 2)
+    assert(memoryUsage.nodeBytes > 0)
+    assert(memoryUsage.textBytes >= 16)
+
+    patch.delete()
+  })
+
+  it('translates packed positions between old and new coordinates', () => {
+    const patch = new Patch()
+    patch.splice({row: 0, column: 2}, {row: 0, column: 3}, {row: 1, column: 1})
+    patch.splice({row: 2, column: 0}, {row: 0, column: 0}, {row: 0, column: 4})
+
+    const oldPositions = new Uint32Array([0, 6, 0, 1, 0, 3, 1, 0])
+    assert.deepEqual(Array.from(patch.translateOldPositions(oldPositions)), [1, 2, 0, 1, 0, 2, 2, 4])
+    assert.deepEqual(Array.from(patch.translateOldPositions(oldPositions, 'forward')), [1, 2, 0, 1, 1, 1, 2, 4])
+    assert.deepEqual(Array.from(oldPositions), [0, 6, 0, 1, 0, 3, 1, 0])
+
+    const newPositions = new Uint32Array([1, 1, 2, 2, 2, 5])
+    assert.deepEqual(Array.from(patch.translateNewPositions(newPositions)), [0, 5, 1, 0, 1, 1])
+
+    patch.delete()
+  })
+
   it('does not crash when inconsistent splices are applied', () => {
     this.timeout(Infinity)
 
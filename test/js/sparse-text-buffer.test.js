@@ -0,0 +1,63 @@
+const fs = require('fs')
+const path = require('path')
+const temp = require('temp').track()
+const {assert} = require('chai')
+const {SparseTextBuffer} = require('../..')
+
+describe('SparseTextBuffer', () => {
+  if (!SparseTextBuffer) return
+
+  it('reads lines, ranges and search results from a file without loading all of it', () => {
+    const filePath = path.join(temp.mkdirSync(), 'file.txt')
+    let content = ''
+    for (let i = 0; i < 10000; i++) content += `line ${i}\r\n`
+    fs.writeFileSync(filePath, content, 'utf8')
+
+    const buffer = new SparseTextBuffer(filePath, 'UTF-8')
+    assert.equal(buffer.lineForRow(5), 'line 5')
+    assert.equal(buffer.getMemoryUsage().indexedChunkCount, 1)
+
+    assert.equal(buffer.lineForRow(9999), 'line 9999')
+    assert.equal(buffer.lineForRow(10000), '')
+    assert.equal(buffer.lineForRow(10001), undefined)
+    assert.equal(buffer.lineLengthForRow(9999), 9)
+    assert.equal(buffer.getTextInRange({start: {row: 1, column: 5}, end: {row: 2, column: 4}}), '1\r\nline')
+    assert.deepEqual(buffer.getExtent(), {row: 10000, column: 0})
+    assert.equal(buffer.getLength(), content.length)
+    assert.equal(buffer.characterIndexForPosition({row: 1, column: 2}), 10)
+
+    assert.deepEqual(buffer.findSync(/line 99\d\d/), {
+      start: {row: 9900, column: 0},
+      end: {row: 9900, column: 9}
+    })
+    assert.equal(buffer.findAllSync(/line \d+5\r\n/).length, 999)
+  })
+
+  it('can save its line index to a sidecar file and restore it when the file is reopened', () => {
+    const directory = temp.mkdirSync()
+    const filePath = path.join(directory, 'file.txt')
+    const indexPath = path.join(directory, 'file.txt.index')
+    let content = ''
+    for (let i = 0; i < 10000; i++) content += `line ${i}\n`
+    fs.writeFileSync(filePath, content, 'utf8')
+
+    const buffer = new SparseTextBuffer(filePath, 'UTF-8')
+    assert.deepEqual(buffer.getExtent(), {row: 10000, column: 0})
+    buffer.saveIndex(indexPath)
+
+    const reopenedBuffer = new SparseTextBuffer(filePath, 'UTF-8')
+    assert(reopenedBuffer.loadIndex(indexPath))
+    assert.equal(reopenedBuffer.getMemoryUsage().cachedChunkCount, 0)
+    assert.deepEqual(reopenedBuffer.getExtent(), {row: 10000, column: 0})
+    assert.equal(reopenedBuffer.lineForRow(7777), 'line 7777')
+
+    const otherEncodingBuffer = new SparseTextBuffer(filePath, 'ISO-8859-1')
+    assert(!otherEncodingBuffer.loadIndex(indexPath))
+    assert(!otherEncodingBuffer.loadIndex(path.join(directory, 'missing.index')))
+  })
+
+  it('throws when the file cannot be opened', () => {
+    assert.throws(() => new SparseTextBuffer(path.join(temp.mkdirSync(), 'missing'), 'UTF-8'), /ENOENT/)
+    assert.throws(() => new SparseTextBuffer(__filename, 'NOT-AN-ENCODING'), /Invalid encoding name/)
+  })
+})
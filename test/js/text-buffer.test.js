@@ -403,6 +403,98 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.loadProgressively', () => {
+    if (!TextBuffer.prototype.loadProgressively) return
+
+    it('exposes the beginning of the file before the rest has been decoded', () => {
+      const buffer = new TextBuffer('abc')
+
+      const {path: filePath} = temp.openSync()
+      const content = 'abc def ghi jkl\n'.repeat(200 * 1024)
+      fs.writeFileSync(filePath, content)
+
+      const observations = []
+      return buffer.loadProgressively(filePath, {initialRowCount: 10}, (percentDone) => {
+        observations.push({percentDone, loading: buffer.isLoading(), lineCount: buffer.getLineCount()})
+        assert.throws(() => buffer.setText('x'), 'Cannot edit a buffer while it is loading')
+      }).then((loaded) => {
+        assert(loaded)
+        assert(!buffer.isLoading())
+        assert.equal(buffer.getText(), content)
+        assert(!buffer.isModified())
+
+        assert(observations.length > 1)
+        assert(observations[0].loading)
+        assert(observations[0].lineCount > 10)
+        assert(observations[0].lineCount < 200 * 1024)
+        assert.deepEqual(observations, observations.slice().sort((a, b) => a.percentDone - b.percentDone))
+      })
+    })
+
+    it('does not replace a modified buffer unless forced to', () => {
+      const buffer = new TextBuffer('abc')
+      buffer.setText('def')
+
+      const {path: filePath} = temp.openSync()
+      fs.writeFileSync(filePath, 'ghi')
+
+      return buffer.loadProgressively(filePath).then((loaded) => {
+        assert(!loaded)
+        assert.equal(buffer.getText(), 'def')
+        return buffer.loadProgressively(filePath, {force: true})
+      }).then((loaded) => {
+        assert(loaded)
+        assert.equal(buffer.getText(), 'ghi')
+      })
+    })
+
+    it('rejects a second load while the first is still in progress', () => {
+      const buffer = new TextBuffer('abc')
+
+      const {path: filePath1} = temp.openSync()
+      const content = 'abc def ghi jkl\n'.repeat(200 * 1024)
+      fs.writeFileSync(filePath1, content)
+      const {path: filePath2} = temp.openSync()
+      fs.writeFileSync(filePath2, 'xyz')
+
+      const firstLoad = buffer.loadProgressively(filePath1, {initialRowCount: 10})
+      return buffer.loadProgressively(filePath2).then(() => {
+        throw new Error('Expected the second load to fail')
+      }, (error) => {
+        assert.match(error.message, /already loading/)
+        return firstLoad
+      }).then((loaded) => {
+        assert(loaded)
+        assert.equal(buffer.getText(), content)
+        return buffer.loadProgressively(filePath2, {force: true})
+      }).then((loaded) => {
+        assert(loaded)
+        assert.equal(buffer.getText(), 'xyz')
+      })
+    })
+
+    it('restores the previous contents when cancelled from the progress callback', () => {
+      const buffer = new TextBuffer('abc')
+      buffer.setText('def')
+
+      const {path: filePath} = temp.openSync()
+      fs.writeFileSync(filePath, 'abc def ghi jkl\n'.repeat(200 * 1024))
+
+      let progressCallCount = 0
+      return buffer.loadProgressively(filePath, {force: true, initialRowCount: 10}, () => {
+        progressCallCount++
+        assert(buffer.isLoading())
+        return false
+      }).then((loaded) => {
+        assert(!loaded)
+        assert.equal(progressCallCount, 1)
+        assert(!buffer.isLoading())
+        assert.equal(buffer.getText(), 'def')
+        assert(buffer.isModified())
+      })
+    })
+  })
+
   describe('.baseTextMatchesFile', () => {
     if (!TextBuffer.prototype.baseTextMatchesFile) return;
 
@@ -776,6 +868,121 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.setTextInRanges', () => {
+    it('applies multiple edits and returns the ranges of the inserted text', () => {
+      const buffer = new TextBuffer('abc\ndef\nghi')
+
+      const newRanges = buffer.setTextInRanges([
+        Range(Point(0, 1), Point(0, 2)),
+        Range(Point(1, 0), Point(1, 0)),
+        Range(Point(2, 1), Point(2, 3))
+      ], ['XY', '1\n2', ''])
+
+      assert.equal(buffer.getText(), 'aXYc\n1\n2def\ng')
+      assert.deepEqual(newRanges, [
+        Range(Point(0, 1), Point(0, 3)),
+        Range(Point(1, 0), Point(2, 1)),
+        Range(Point(3, 1), Point(3, 1))
+      ])
+    })
+
+    it('throws an error when the ranges overlap', () => {
+      const buffer = new TextBuffer('abc\ndef')
+      assert.throws(() => {
+        buffer.setTextInRanges([
+          Range(Point(0, 1), Point(1, 1)),
+          Range(Point(0, 2), Point(0, 3))
+        ], ['a', 'b'])
+      }, /Ranges must be sorted/)
+      assert.equal(buffer.getText(), 'abc\ndef')
+    })
+  })
+
+  describe('.beginTransaction and .commitTransaction', () => {
+    it('applies the changes made during the transaction', () => {
+      const buffer = new TextBuffer('abc\ndef')
+      buffer.beginTransaction()
+      buffer.setTextInRange(Range(Point(0, 1), Point(0, 2)), 'B')
+      buffer.setTextInRange(Range(Point(1, 1), Point(1, 2)), 'E')
+      assert.equal(buffer.getText(), 'aBc\ndEf')
+      buffer.commitTransaction()
+      assert.equal(buffer.getText(), 'aBc\ndEf')
+      assert.equal(buffer.isModified(), true)
+    })
+  })
+
+  describe('.getStatistics', () => {
+    it('returns line ending and character counts that are kept up to date with edits', () => {
+      const buffer = new TextBuffer('ab\r\ncd\ref\n')
+      assert.deepEqual(buffer.getStatistics(), {
+        lfCount: 1,
+        crlfCount: 1,
+        crCount: 1,
+        nulCount: 0,
+        surrogateCount: 0,
+        longestLineLength: 5
+      })
+
+      buffer.setTextInRange(Range(Point(1, 3), Point(1, 3)), '\n\u0000\uD83D\uDE01')
+      assert.deepEqual(buffer.getStatistics(), {
+        lfCount: 1,
+        crlfCount: 2,
+        crCount: 0,
+        nulCount: 1,
+        surrogateCount: 2,
+        longestLineLength: 5
+      })
+    })
+  })
+
+  describe('.getLineEndingCounts, .hasMixedLineEndings and .normalizeLineEndings', () => {
+    it('tracks and converts the line endings of each row', () => {
+      const buffer = new TextBuffer('a\nb\r\nc\r\nd')
+      assert.deepEqual(buffer.getLineEndingCounts(0, 3), {lfCount: 1, crlfCount: 2})
+      assert.deepEqual(buffer.getLineEndingCounts(1, 2), {lfCount: 0, crlfCount: 1})
+      assert.equal(buffer.hasMixedLineEndings(), true)
+
+      buffer.normalizeLineEndings('\r\n')
+      assert.equal(buffer.getText(), 'a\r\nb\r\nc\r\nd')
+      assert.equal(buffer.lineEndingForRow(0), '\r\n')
+      assert.equal(buffer.hasMixedLineEndings(), false)
+    })
+  })
+
+  describe('.getMemoryUsage', () => {
+    it('reports the memory held by the base text, the changes and snapshots', () => {
+      const buffer = new TextBuffer('abc\ndef')
+      let memoryUsage = buffer.getMemoryUsage()
+      assert.equal(memoryUsage.layerCount, 1)
+      assert(memoryUsage.baseTextBytes >= 14)
+      assert.equal(memoryUsage.patchTextBytes, 0)
+
+      buffer.setTextInRange(Range(Point(0, 1), Point(0, 2)), 'xyz')
+      memoryUsage = buffer.getMemoryUsage()
+      assert.equal(memoryUsage.layerCount, 2)
+      assert.equal(memoryUsage.snapshotLayerCount, 0)
+      assert(memoryUsage.patchTextBytes >= 6)
+    })
+  })
+
+  describe('.trimMemory', () => {
+    it('releases unused capacity without changing the buffer contents', () => {
+      const buffer = new TextBuffer('abc\r\ndef\nghi')
+      buffer.setTextInRange(Range(Point(0, 1), Point(0, 2)), 'xyz')
+      buffer.getStatistics()
+      assert(buffer.getMemoryUsage().indexBytes > 0)
+
+      buffer.trimMemory()
+      assert.equal(buffer.getText(), 'axyzc\r\ndef\nghi')
+      assert(buffer.isModified())
+
+      buffer.trimMemory(1)
+      assert.equal(buffer.getMemoryUsage().indexBytes, 0)
+      assert.equal(buffer.getText(), 'axyzc\r\ndef\nghi')
+      assert.equal(buffer.getStatistics().crlfCount, 1)
+    })
+  })
+
   describe('.getCharacterAtPosition', () => {
     it('return a character at the given position', () => {
       const buffer = new TextBuffer()
@@ -886,6 +1093,74 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.spillBaseText', () => {
+    if (!TextBuffer.prototype.spillBaseText) return
+
+    it('writes the base text to a new file and reloads it when it is needed', () => {
+      const buffer = new TextBuffer('abc\r\ndef\nghi')
+      buffer.setTextInRange(Range(Point(1, 1), Point(1, 2)), 'xyz')
+      const directoryPath = temp.mkdirSync()
+      const baseTextBytes = buffer.getMemoryUsage().baseTextBytes
+
+      assert(buffer.spillBaseText(directoryPath))
+      assert(buffer.isBaseTextSpilled())
+      assert.equal(fs.readdirSync(directoryPath).length, 1)
+      assert(buffer.getMemoryUsage().baseTextBytes < baseTextBytes / 2)
+      assert.deepEqual(buffer.getExtent(), Point(2, 3))
+      assert(!buffer.spillBaseText(directoryPath))
+
+      assert.equal(buffer.getText(), 'abc\r\ndxyzf\nghi')
+      assert(!buffer.isBaseTextSpilled())
+      assert.deepEqual(fs.readdirSync(directoryPath), [])
+      assert(buffer.isModified())
+    })
+
+    it('refuses to read or save a base text that no longer matches its file', () => {
+      const buffer = new TextBuffer('abc\ndef')
+      const directoryPath = temp.mkdirSync()
+      assert(buffer.spillBaseText(directoryPath))
+      const filePath = path.join(directoryPath, fs.readdirSync(directoryPath)[0])
+      const spilledContent = fs.readFileSync(filePath)
+
+      fs.truncateSync(filePath, 4)
+      assert.throws(() => buffer.getText(), /could not be reloaded/)
+      assert(buffer.isBaseTextSpilled())
+
+      // A file of the same size with different characters is rejected too.
+      fs.writeFileSync(filePath, Buffer.from('abc\ndeg', 'utf16le'))
+      assert.throws(() => buffer.lineForRow(1), /could not be reloaded/)
+      assert(buffer.isBaseTextSpilled())
+
+      const savePath = path.join(directoryPath, 'saved')
+      return buffer.save(savePath).then(() => {
+        throw new Error('Expected the save to fail')
+      }, (error) => {
+        assert.match(error.message, /could not be reloaded/)
+        assert(!fs.existsSync(savePath))
+
+        fs.writeFileSync(filePath, spilledContent)
+        assert.equal(buffer.getText(), 'abc\ndef')
+        assert(!buffer.isBaseTextSpilled())
+        assert(!fs.existsSync(filePath))
+      })
+    })
+  })
+
+  describe('.internBaseText', () => {
+    it('shares the base text between buffers with identical contents', () => {
+      const buffer1 = new TextBuffer('interned\ntext')
+      const buffer2 = new TextBuffer('interned\ntext')
+      assert(!buffer1.internBaseText())
+      assert(buffer2.internBaseText())
+
+      buffer1.setTextInRange(Range(Point(0, 0), Point(0, 1)), 'I')
+      assert.equal(buffer1.getText(), 'Interned\ntext')
+      assert.equal(buffer2.getText(), 'interned\ntext')
+      assert(buffer1.isModified())
+      assert(!buffer2.isModified())
+    })
+  })
+
   describe('.serializeChanges and .deserializeChanges', () => {
     if (!TextBuffer.prototype.serializeChanges) return
 
@@ -901,6 +1176,35 @@ describe('TextBuffer', () => {
       buffer2.deserializeChanges(changes)
       assert.equal(buffer2.getText(), '\n123D')
     })
+
+    it('appends subsequent changes to a journal that is replayed after the changes', () => {
+      const buffer = new TextBuffer('abc')
+      buffer.setTextInRange(Range(Point(0, 0), Point(0, 0)), '\n')
+      const checkpoint = buffer.serializeChanges()
+      assert.equal(buffer.serializeJournalEntry(), undefined)
+
+      buffer.setTextInRange(Range(Point(1, 3), Point(1, 3)), 'D')
+      const entry1 = buffer.serializeJournalEntry()
+      buffer.setTextInRange(Range(Point(1, 0), Point(1, 1)), 'A')
+      const entry2 = buffer.serializeJournalEntry()
+      assert.equal(buffer.getText(), '\nAbcD')
+
+      const buffer2 = new TextBuffer('abc')
+      buffer2.deserializeChanges(Buffer.concat([checkpoint, entry1, entry2]))
+      assert.equal(buffer2.getText(), '\nAbcD')
+
+      const buffer3 = new TextBuffer('abc')
+      buffer3.deserializeChanges(Buffer.concat([checkpoint, entry1, entry2.slice(0, entry2.length - 1)]))
+      assert.equal(buffer3.getText(), '\nabcD')
+
+      for (let i = 0; i < 10; i++) {
+        buffer.setTextInRange(Range(Point(0, 0), Point(0, 0)), 'a fairly long line of inserted text\n')
+        buffer.serializeJournalEntry()
+      }
+      assert(buffer.shouldCompactJournal())
+      buffer.serializeChanges()
+      assert(!buffer.shouldCompactJournal())
+    })
   })
 
   describe('.find (sync and async)', () => {
@@ -70,6 +70,25 @@ TEST_CASE("EncodingConversion::decode - four-byte UTF-16 characters") {
   REQUIRE(string == u"ab" "\xd83d" "\xde01" "cd");
 }
 
+TEST_CASE("EncodingConversion::decode - stopping a stream early") {
+  auto conversion = transcoding_from("UTF-8");
+  FILE *file = tmpfile();
+  string input(100, 'a');
+  fwrite(input.data(), 1, input.size(), file);
+  rewind(file);
+
+  u16string string;
+  vector<char> buffer(10);
+  vector<size_t> progress;
+  REQUIRE(conversion->decode(string, file, buffer, [&progress](size_t bytes_read) {
+    progress.push_back(bytes_read);
+    return bytes_read < 30;
+  }));
+  REQUIRE(progress == vector<size_t>({10, 20, 30}));
+  REQUIRE(string == u16string(30, 'a'));
+  fclose(file);
+}
+
 TEST_CASE("EncodingConversion::encode - basic") {
   auto conversion = transcoding_to("UTF-8");
   u16string string = u"abγdefg\nhijklmnop";
@@ -1,10 +1,39 @@
 #include "test-helpers.h"
+#include "text-slice.h"
 
 using Change = Patch::Change;
+using std::u16string;
 using std::vector;
 
 static optional<Text> null_text;
 
+static u16string get_random_string_without_carriage_returns(Generator &rand, uint32_t character_count) {
+  u16string result = get_random_string(rand, character_count);
+  std::replace(result.begin(), result.end(), u'\r', u'\n');
+  return result;
+}
+
+static void splice_random_changes(Generator &rand, Text &text, Patch &patch,
+                                  bool include_old_text, bool include_noops,
+                                  bool include_carriage_returns = true) {
+  for (uint i = 0, n = rand() % 10; i < n; i++) {
+    Range range = get_random_range(rand, text);
+    Text deleted_text{TextSlice(text).slice(range)};
+    Text inserted_text{include_carriage_returns ?
+      get_random_string(rand, rand() % 5) :
+      get_random_string_without_carriage_returns(rand, rand() % 5)};
+    if (include_noops && rand() % 5 == 0) inserted_text = deleted_text;
+
+    if (include_old_text) {
+      patch.splice(range.start, range.extent(), inserted_text.extent(), deleted_text, inserted_text);
+    } else {
+      patch.splice(range.start, range.extent(), inserted_text.extent(), optional<Text>{}, inserted_text,
+                   deleted_text.size());
+    }
+    text.splice(range.start, range.extent(), TextSlice(inserted_text));
+  }
+}
+
 TEST_CASE("Patch::splice – simple non-overlapping") {
   Patch patch;
 
@@ -214,6 +243,39 @@ TEST_CASE("Patch::splice - inconsistent old text") {
   }));
 }
 
+TEST_CASE("Patch::splice - shared texts") {
+  auto deleted_text = std::make_shared<const Text>(u"abc\ndef");
+  auto inserted_text = std::make_shared<const Text>(u"xyz");
+
+  Patch patch;
+  patch.splice(Point{1, 0}, Point{1, 3}, Point{0, 3}, deleted_text, inserted_text);
+  REQUIRE(patch.get_changes().front().old_text == deleted_text.get());
+  REQUIRE(patch.get_changes().front().new_text == inserted_text.get());
+  REQUIRE(patch.get_memory_usage().text_bytes == 0);
+
+  Patch inverted_patch = patch.invert();
+  REQUIRE(inverted_patch.get_changes().front().old_text == inserted_text.get());
+  REQUIRE(inverted_patch.get_changes().front().new_text == deleted_text.get());
+
+  Patch combined_patch;
+  combined_patch.combine(patch);
+  REQUIRE(combined_patch.get_changes().front().old_text == deleted_text.get());
+  REQUIRE(combined_patch.get_changes().front().new_text == inserted_text.get());
+
+  // Changes that are extended get their own copies of the shared texts.
+  patch.splice(Point{1, 3}, Point{0, 1}, Point{0, 2}, Text{u"g"}, Text{u"!!"});
+  REQUIRE(*patch.get_changes().front().old_text == Text{u"abc\ndefg"});
+  REQUIRE(*patch.get_changes().front().new_text == Text{u"xyz!!"});
+  REQUIRE(*deleted_text == Text{u"abc\ndef"});
+  REQUIRE(*inserted_text == Text{u"xyz"});
+
+  inverted_patch.splice(Point{2, 4}, Point{}, Point{0, 1}, Text{u""}, Text{u"?"});
+  inverted_patch.splice_old(Point{1, 3}, Point{0, 1}, Point{});
+  REQUIRE(inverted_patch.get_change_count() == 1);
+  REQUIRE(*inverted_patch.get_changes().front().new_text == Text{u"abc\ndef?"});
+  REQUIRE(*deleted_text == Text{u"abc\ndef"});
+}
+
 TEST_CASE("Patch::find_changes_in_new_range") {
   Patch patch;
 
@@ -259,6 +321,180 @@ TEST_CASE("Patch::find_changes_in_new_range") {
   }));
 }
 
+TEST_CASE("Patch::ChangeIterator") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    Text text{get_random_string(rand, 30)};
+    Patch patch;
+    splice_random_changes(rand, text, patch, true, false);
+
+    Patch::ChangeIterator iterator;
+    auto collect = [&iterator]() {
+      vector<Change> result;
+      while (auto change = iterator.next()) result.push_back(*change);
+      return result;
+    };
+
+    patch.iterate_changes(iterator);
+    REQUIRE(collect() == patch.get_changes());
+
+    for (uint j = 0; j < 5; j++) {
+      Range range = get_random_range(rand, text);
+      patch.iterate_changes_in_new_range(iterator, range.start, range.end);
+      REQUIRE(collect() == patch.get_changes_in_new_range(range.start, range.end));
+      patch.iterate_changes_in_old_range(iterator, range.start, range.end);
+      REQUIRE(collect() == patch.get_changes_in_old_range(range.start, range.end));
+
+      vector<Change> expected_changes = patch.get_changes_in_new_range(range.start, range.end);
+      patch.grab_changes_in_new_range(iterator, range.start, range.end);
+      REQUIRE(collect() == expected_changes);
+      expected_changes = patch.get_changes_in_old_range(range.start, range.end);
+      patch.grab_changes_in_old_range(iterator, range.start, range.end);
+      REQUIRE(collect() == expected_changes);
+    }
+  }
+}
+
+TEST_CASE("Patch::translate_positions") {
+  Patch patch;
+  patch.splice(Point{0, 2}, Point{0, 3}, Point{1, 1});
+  patch.splice(Point{2, 0}, Point{}, Point{0, 4});
+
+  vector<Point> positions{{0, 6}, {0, 1}, {0, 3}, {1, 0}, {0, 5}};
+  patch.translate_positions(positions.data(), positions.size(), Patch::OldToNew);
+  REQUIRE(positions == vector<Point>({{1, 2}, {0, 1}, {0, 2}, {2, 4}, {1, 1}}));
+
+  positions = {{0, 3}, {1, 0}};
+  patch.translate_positions(positions.data(), positions.size(), Patch::OldToNew, Patch::ClipForward);
+  REQUIRE(positions == vector<Point>({{1, 1}, {2, 4}}));
+
+  positions = {{0, 1}, {1, 0}, {1, 1}, {2, 2}, {2, 5}};
+  patch.translate_positions(positions.data(), positions.size(), Patch::NewToOld);
+  REQUIRE(positions == vector<Point>({{0, 1}, {0, 2}, {0, 5}, {1, 0}, {1, 1}}));
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    Text text{get_random_string(rand, 30)};
+    Patch patch{rand() % 2 == 0};
+    splice_random_changes(rand, text, patch, true, false);
+
+    auto direction = rand() % 2 ? Patch::OldToNew : Patch::NewToOld;
+    auto clip_direction = rand() % 2 ? Patch::ClipBackward : Patch::ClipForward;
+    vector<Point> positions;
+    for (uint j = 0, n = rand() % 20; j < n; j++) {
+      positions.push_back({rand() % 5, rand() % 10});
+    }
+    if (rand() % 2) std::sort(positions.begin(), positions.end());
+
+    vector<Point> translated_positions = positions;
+    patch.translate_positions(translated_positions.data(), translated_positions.size(),
+                              direction, clip_direction);
+
+    for (size_t j = 0; j < positions.size(); j++) {
+      Point position = positions[j];
+      Point expected_position = position;
+      if (direction == Patch::OldToNew) {
+        auto change = patch.get_change_starting_before_old_position(position);
+        if (change && position >= change->old_end) {
+          expected_position = change->new_end.traverse(position.traversal(change->old_end));
+        } else if (change) {
+          expected_position = clip_direction == Patch::ClipBackward ? change->new_start : change->new_end;
+        }
+      } else {
+        auto change = patch.get_change_starting_before_new_position(position);
+        if (change && position >= change->new_end) {
+          expected_position = change->old_end.traverse(position.traversal(change->new_end));
+        } else if (change) {
+          expected_position = clip_direction == Patch::ClipBackward ? change->old_start : change->old_end;
+        }
+      }
+      REQUIRE(translated_positions[j] == expected_position);
+    }
+  }
+}
+
+TEST_CASE("Patch::transform") {
+  Patch patch, other_patch;
+  patch.splice(Point{0, 1}, Point{0, 2}, Point{0, 1}, Text{u"bc"}, Text{u"X"});
+  patch.splice(Point{0, 4}, Point{}, Point{0, 1}, Text{u""}, Text{u"Z"});
+  other_patch.splice(Point{0, 2}, Point{0, 2}, Point{0, 1}, Text{u"cd"}, Text{u"Y"});
+  other_patch.splice(Point{0, 4}, Point{}, Point{0, 1}, Text{u""}, Text{u"W"});
+
+  // "abcdef" becomes "aXdeZf" and "abYeWf" respectively, and "aXYeZWf" once
+  // both are applied.
+  REQUIRE(patch.transform(other_patch, Patch::InsertBeforeOther).get_changes() == vector<Change>({
+    Change{
+      Point{0, 1}, Point{0, 2},
+      Point{0, 1}, Point{0, 2},
+      get_text(u"b").get(), get_text(u"X").get(),
+      0, 0, 1
+    },
+    Change{
+      Point{0, 4}, Point{0, 4},
+      Point{0, 4}, Point{0, 5},
+      get_text(u"").get(), get_text(u"Z").get(),
+      1, 1, 0
+    }
+  }));
+  REQUIRE(other_patch.transform(patch, Patch::InsertAfterOther).get_changes() == vector<Change>({
+    Change{
+      Point{0, 2}, Point{0, 3},
+      Point{0, 2}, Point{0, 3},
+      get_text(u"d").get(), get_text(u"Y").get(),
+      0, 0, 1
+    },
+    Change{
+      Point{0, 5}, Point{0, 5},
+      Point{0, 5}, Point{0, 6},
+      get_text(u"").get(), get_text(u"W").get(),
+      1, 1, 0
+    }
+  }));
+
+  auto apply = [](Text text, const Patch &patch) {
+    auto changes = patch.get_changes();
+    for (auto iter = changes.rbegin(); iter != changes.rend(); ++iter) {
+      REQUIRE(Text{TextSlice(text).slice({iter->old_start, iter->old_end})} == *iter->old_text);
+      text.splice(iter->old_start, iter->old_end.traversal(iter->old_start), TextSlice(*iter->new_text));
+    }
+    return text;
+  };
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 1000; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    // Carriage returns can join with line feeds that the other patch
+    // inserts next to them, which makes the results differ in line endings.
+    Text text{get_random_string_without_carriage_returns(rand, 30)};
+    Text text1{text}, text2{text};
+    Patch patch1, patch2;
+    splice_random_changes(rand, text1, patch1, true, true, false);
+    splice_random_changes(rand, text2, patch2, true, true, false);
+    REQUIRE(apply(text, patch1) == text1);
+    REQUIRE(apply(text, patch2) == text2);
+
+    bool first_patch_inserts_first = rand() % 2;
+    Patch transformed_patch1 = patch1.transform(
+      patch2, first_patch_inserts_first ? Patch::InsertBeforeOther : Patch::InsertAfterOther
+    );
+    Patch transformed_patch2 = patch2.transform(
+      patch1, first_patch_inserts_first ? Patch::InsertAfterOther : Patch::InsertBeforeOther
+    );
+    REQUIRE(apply(text2, transformed_patch1) == apply(text1, transformed_patch2));
+  }
+}
+
 TEST_CASE("Patch::serialize") {
   Patch patch;
 
@@ -297,9 +533,11 @@ TEST_CASE("Patch::serialize") {
   vector<uint8_t> bytes;
   Serializer serializer(bytes);
   patch.serialize(serializer);
+  serializer.append<uint32_t>(42);
 
   Deserializer deserializer(bytes);
   Patch patch_copy(deserializer);
+  REQUIRE(deserializer.read<uint32_t>() == 42);
   REQUIRE(patch_copy.get_changes() == vector<Change>({
     Change {
       Point {0, 0}, Point {0, 0},
@@ -327,3 +565,396 @@ TEST_CASE("Patch::serialize") {
     }
   }));
 }
+
+TEST_CASE("Patch::Patch(Deserializer &) - legacy format") {
+  vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+  serializer.append<uint32_t>(1); // version
+  serializer.append<uint32_t>(1); // change count
+  Point{0, 1}.serialize(serializer); // old extent
+  Point{0, 2}.serialize(serializer); // new extent
+  Point{0, 1}.serialize(serializer); // old distance from left ancestor
+  Point{0, 1}.serialize(serializer); // new distance from left ancestor
+  serializer.append<uint32_t>(1);
+  Text{u"b"}.serialize(serializer);
+  serializer.append<uint32_t>(1);
+  Text{u"XY"}.serialize(serializer);
+  serializer.append<uint32_t>(42);
+
+  Deserializer deserializer(bytes);
+  Patch patch(deserializer);
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 1}, Point {0, 2},
+      Point {0, 1}, Point {0, 3},
+      get_text(u"b").get(), get_text(u"XY").get(),
+      0, 0, 0
+    }
+  }));
+  REQUIRE(deserializer.read<uint32_t>() == 42);
+
+  vector<uint8_t> compact_bytes;
+  Serializer compact_serializer(compact_bytes);
+  patch.serialize(compact_serializer);
+  REQUIRE(compact_bytes.size() < bytes.size() / 2);
+}
+
+TEST_CASE("Patch::from_sorted_changes") {
+  vector<Patch::SortedChange> changes;
+  changes.push_back({Point{0, 1}, Point{0, 2}, Point{0, 1}, Text{u"ab"}, Text{u"c"}, 0});
+  changes.push_back({Point{0, 2}, Point{0, 1}, Point{}, Text{u"d"}, Text{u""}, 0});
+  changes.push_back({Point{0, 4}, Point{}, Point{}, Text{u""}, Text{u""}, 0});
+  changes.push_back({Point{1, 0}, Point{0, 3}, Point{1, 0}, optional<Text>{}, Text{u"efg\n"}, 3});
+
+  Patch patch = Patch::from_sorted_changes(move(changes));
+  REQUIRE(patch.get_change_count() == 2);
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change{
+      Point{0, 1}, Point{0, 4},
+      Point{0, 1}, Point{0, 2},
+      get_text(u"abd").get(), get_text(u"c").get(),
+      0, 0, 3
+    },
+    Change{
+      Point{1, 0}, Point{1, 3},
+      Point{1, 0}, Point{2, 0},
+      nullptr, get_text(u"efg\n").get(),
+      3, 1, 3
+    }
+  }));
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    Patch spliced_patch;
+    vector<Patch::SortedChange> changes;
+    Point position;
+    for (uint j = 0, n = rand() % 50; j < n; j++) {
+      if (rand() % 2) position = position.traverse(Point{rand() % 3, rand() % 5});
+      Text old_text{get_random_string(rand, rand() % 5)};
+      Text new_text{get_random_string(rand, rand() % 5)};
+      spliced_patch.splice(position, old_text.extent(), new_text.extent(), old_text, new_text);
+      changes.push_back({position, old_text.extent(), new_text.extent(), old_text, new_text, 0});
+      position = position.traverse(new_text.extent());
+    }
+
+    Patch patch = Patch::from_sorted_changes(move(changes));
+    REQUIRE(patch.get_change_count() == spliced_patch.get_change_count());
+    REQUIRE(patch.get_changes() == spliced_patch.get_changes());
+
+    Text text{get_random_string(rand, 5)};
+    Point start{rand() % 10, rand() % 10};
+    patch.splice(start, Point{}, text.extent(), Text{}, text);
+    spliced_patch.splice(start, Point{}, text.extent(), Text{}, text);
+    REQUIRE(patch.get_changes() == spliced_patch.get_changes());
+  }
+}
+
+TEST_CASE("Patch::combine - merging") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 1000; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    bool include_old_text = rand() % 2;
+    Text text{get_random_string(rand, 30)};
+    Patch patch, other_patch;
+    splice_random_changes(rand, text, patch, include_old_text, false);
+    splice_random_changes(rand, text, other_patch, include_old_text, true);
+
+    // Patches with many more changes than the patch they're combined with
+    // splice its changes in rather than merging with it.
+    Patch merged_patch = patch.copy();
+    Patch spliced_patch = patch.copy();
+    for (uint32_t row = 1000; row < 1400; row += 2) {
+      spliced_patch.splice(Point{row, 0}, Point{}, Point{0, 1}, Text{u""}, Text{u"x"});
+    }
+
+    bool left_to_right = rand() % 2;
+    REQUIRE(merged_patch.combine(other_patch, left_to_right));
+    REQUIRE(spliced_patch.combine(other_patch, left_to_right));
+
+    vector<Change> spliced_changes;
+    for (const Change &change : spliced_patch.get_changes()) {
+      if (change.old_start.row < 500) spliced_changes.push_back(change);
+    }
+    REQUIRE(merged_patch.get_changes() == spliced_changes);
+    REQUIRE(merged_patch.get_change_count() == spliced_changes.size());
+  }
+}
+
+TEST_CASE("Patch::compose_all") {
+  SECTION("random patches") {
+    auto t = time(nullptr);
+    for (uint i = 0; i < 200; i++) {
+      uint32_t seed = t * 1000 + i;
+      Generator rand(seed);
+      cout << "seed: " << seed << "\n";
+
+      bool include_old_text = rand() % 2;
+      Text original_text{get_random_string(rand, 30)};
+      Text text{original_text};
+      Patch sequential_composition;
+      vector<Patch> patches, patch_copies;
+      bool left_to_right = true;
+      for (uint32_t j = 0, n = rand() % 20; j < n; j++) {
+        Patch patch;
+        splice_random_changes(rand, text, patch, include_old_text, true);
+        REQUIRE(sequential_composition.combine(patch, left_to_right));
+        left_to_right = !left_to_right;
+        patch_copies.push_back(patch.copy());
+        patches.push_back(std::move(patch));
+      }
+
+      // Small patches are combined one at a time, whatever the thread count.
+      auto composition = Patch::compose_all(std::move(patch_copies), 1);
+      REQUIRE(composition);
+      REQUIRE(composition->get_changes() == sequential_composition.get_changes());
+      composition = Patch::compose_all(std::move(patches), 2 + rand() % 4);
+      REQUIRE(composition);
+      REQUIRE(composition->get_changes() == sequential_composition.get_changes());
+      auto changes = composition->get_changes();
+      Text composed_text{original_text};
+      for (auto iter = changes.rbegin(); iter != changes.rend(); ++iter) {
+        if (include_old_text) {
+          REQUIRE(*iter->old_text == Text{TextSlice(original_text).slice({iter->old_start, iter->old_end})});
+        }
+        composed_text.splice(iter->old_start, iter->old_end.traversal(iter->old_start),
+                             TextSlice(*iter->new_text));
+      }
+      REQUIRE(composed_text == text);
+    }
+  }
+
+  SECTION("many patches") {
+    Patch sequential_composition;
+    vector<Patch> patches, patch_copies;
+    for (uint32_t i = 0; i < 256; i++) {
+      Patch patch;
+      for (uint32_t row = 0; row < 64; row++) {
+        patch.splice(Point{row, i}, Point{}, Point{0, 1}, Text{u""}, Text{u"x"});
+      }
+      REQUIRE(sequential_composition.combine(patch));
+      patch_copies.push_back(patch.copy());
+      patches.push_back(std::move(patch));
+    }
+
+    auto composition = Patch::compose_all(std::move(patches), 4);
+    REQUIRE(composition);
+    REQUIRE(patches.empty());
+    REQUIRE(composition->get_change_count() == 64);
+    REQUIRE(composition->get_changes() == sequential_composition.get_changes());
+
+    // The patches are grouped the same way for any thread count.
+    auto single_threaded_composition = Patch::compose_all(std::move(patch_copies), 1);
+    REQUIRE(single_threaded_composition);
+    REQUIRE(single_threaded_composition->get_changes() == composition->get_changes());
+  }
+
+  SECTION("patches large enough to compose in several runs") {
+    auto t = time(nullptr);
+    for (uint i = 0; i < 5; i++) {
+      uint32_t seed = t * 1000 + i;
+      Generator rand(seed);
+      cout << "seed: " << seed << "\n";
+
+      Text original_text{get_random_string(rand, 2000)};
+      Text text{original_text};
+      vector<Patch> patches, patch_copies;
+      for (uint32_t j = 0; j < 400; j++) {
+        Patch patch;
+        for (uint32_t k = 0; k < 30; k++) {
+          splice_random_changes(rand, text, patch, true, true);
+        }
+        patch_copies.push_back(patch.copy());
+        patches.push_back(std::move(patch));
+      }
+
+      auto composition = Patch::compose_all(std::move(patches), 1 + rand() % 4);
+      REQUIRE(composition);
+      auto other_composition = Patch::compose_all(std::move(patch_copies), 1 + rand() % 4);
+      REQUIRE(other_composition);
+      REQUIRE(composition->get_changes() == other_composition->get_changes());
+
+      auto changes = composition->get_changes();
+      Text composed_text{original_text};
+      for (auto iter = changes.rbegin(); iter != changes.rend(); ++iter) {
+        composed_text.splice(iter->old_start, iter->old_end.traversal(iter->old_start),
+                             TextSlice(*iter->new_text));
+      }
+      REQUIRE(composed_text == text);
+    }
+  }
+
+  SECTION("inconsistent patches") {
+    for (unsigned thread_count = 1; thread_count <= 4; thread_count++) {
+      vector<Patch> patches;
+      for (uint32_t i = 0; i < 4; i++) patches.push_back(Patch{});
+      patches[0].splice(Point{5, 0}, Point{}, Point{0, 1}, Text{u""}, Text{u"x"});
+      patches[1].splice(Point{5, 0}, Point{}, Point{0, 1}, Text{u""}, Text{u"x"});
+      patches[2].splice(Point{0, 0}, Point{}, Point{1, 4}, Text{u""}, Text{u"\n    "});
+      patches[3].splice(Point{1, 0}, Point{1, 0}, Point{}, Text{u"  \n"}, Text{u""}, 3);
+      REQUIRE(!Patch::compose_all(std::move(patches), thread_count));
+    }
+  }
+
+  SECTION("no patches") {
+    auto composition = Patch::compose_all(vector<Patch>{});
+    REQUIRE(composition);
+    REQUIRE(composition->get_change_count() == 0);
+  }
+}
+
+TEST_CASE("Patch::get_memory_usage") {
+  Patch patch;
+  REQUIRE(patch.get_memory_usage().node_count == 0);
+  REQUIRE(patch.get_memory_usage().text_bytes == 0);
+
+  patch.splice(Point {0, 5}, Point {0, 3}, Point {0, 4}, Text {u"abc"}, Text {u"defg"});
+  patch.splice(Point {0, 10}, Point {0, 3}, Point {0, 4}, Text {u"hij"}, Text {u"klmn"});
+  auto memory_usage = patch.get_memory_usage();
+  REQUIRE(memory_usage.node_count == 2);
+  REQUIRE(memory_usage.node_bytes > 0);
+  REQUIRE(memory_usage.text_bytes >= 14 * sizeof(char16_t));
+
+  patch.clear();
+  auto cleared_memory_usage = patch.get_memory_usage();
+  REQUIRE(cleared_memory_usage.node_count == 0);
+  REQUIRE(cleared_memory_usage.node_bytes >= memory_usage.node_bytes);
+
+  patch.splice(Point {0, 5}, Point {0, 3}, Point {0, 4}, Text {u"abc"}, Text {u"defg"});
+  REQUIRE(patch.get_memory_usage().node_bytes == cleared_memory_usage.node_bytes);
+
+  patch.clear();
+  patch.trim_memory();
+  REQUIRE(patch.get_memory_usage().node_bytes == 0);
+}
+
+TEST_CASE("Patch::trim_memory") {
+  Patch patch;
+  patch.splice(Point {0, 5}, Point {0, 3}, Point {0, 1000}, Text {u"abc"}, Text {u16string(1000, 'x')});
+  patch.splice(Point {0, 10}, Point {0, 990}, Point {0, 0}, Text {u16string(990, 'x')}, Text {u""});
+  patch.grab_changes_in_new_range(Point {0, 0}, Point {0, 20});
+  auto memory_usage = patch.get_memory_usage();
+
+  patch.trim_memory();
+  auto trimmed_memory_usage = patch.get_memory_usage();
+  REQUIRE(trimmed_memory_usage.node_count == memory_usage.node_count);
+  REQUIRE(trimmed_memory_usage.text_bytes < memory_usage.text_bytes);
+  REQUIRE(trimmed_memory_usage.stack_bytes == 0);
+  REQUIRE(patch.get_changes() == vector<Patch::Change>({
+    Change{
+      Point {0, 5}, Point {0, 8},
+      Point {0, 5}, Point {0, 15},
+      get_text(u"abc").get(),
+      get_text(u"xxxxxxxxxx").get(),
+      0, 0, 3
+    }
+  }));
+
+  patch.splice(Point {0, 0}, Point {0, 1}, Point {0, 2});
+  REQUIRE(patch.get_change_count() == 2);
+
+  SECTION("releasing slabs after most changes are merged away") {
+    Patch patch;
+    for (uint32_t i = 0; i < 2000; i++) {
+      patch.splice(Point {0, 2 * i}, Point {0, 1}, Point {0, 1}, Text {u"a"}, Text {u"b"});
+    }
+    patch.splice(Point {0, 0}, Point {0, 4000}, Point {0, 1}, optional<Text> {}, Text {u"c"});
+    REQUIRE(patch.get_change_count() == 1);
+    auto memory_usage = patch.get_memory_usage();
+
+    patch.trim_memory();
+    REQUIRE(patch.get_memory_usage().node_bytes < memory_usage.node_bytes / 100);
+    REQUIRE(patch.get_changes().size() == 1);
+    REQUIRE(patch.get_changes()[0].new_end == Point(0, 1));
+
+    patch.splice(Point {0, 5}, Point {0, 1}, Point {0, 2});
+    REQUIRE(patch.get_change_count() == 2);
+  }
+}
+
+TEST_CASE("Patch - without text") {
+  SECTION("random splices") {
+    auto t = time(nullptr);
+    for (uint i = 0; i < 500; i++) {
+      uint32_t seed = t * 1000 + i;
+      Generator rand(seed);
+      cout << "seed: " << seed << "\n";
+
+      // A patch that doesn't store text behaves like one that is never
+      // given any text, except that it takes deleted text sizes from the
+      // deleted texts.
+      Text text{get_random_string(rand, 30)};
+      Patch patch{true, false}, patch_given_no_text;
+      for (uint j = 0, n = rand() % 10; j < n; j++) {
+        Range range = get_random_range(rand, text);
+        Text deleted_text{TextSlice(text).slice(range)};
+        Text inserted_text{get_random_string(rand, rand() % 5)};
+        patch.splice(range.start, range.extent(), inserted_text.extent(), deleted_text, inserted_text);
+        patch_given_no_text.splice(range.start, range.extent(), inserted_text.extent(),
+                                   optional<Text>{}, optional<Text>{}, deleted_text.size());
+        text.splice(range.start, range.extent(), TextSlice(inserted_text));
+      }
+      REQUIRE(patch.get_changes() == patch_given_no_text.get_changes());
+      REQUIRE(patch.get_memory_usage().text_bytes == 0);
+
+      Patch other_patch;
+      splice_random_changes(rand, text, other_patch, true, false);
+      Patch other_patch_given_no_text;
+      for (const Change &change : other_patch.get_changes()) {
+        other_patch_given_no_text.splice(change.new_start, change.old_end.traversal(change.old_start),
+                                         change.new_end.traversal(change.new_start),
+                                         optional<Text>{}, optional<Text>{}, change.old_text->size());
+      }
+      REQUIRE(patch.combine(other_patch, rand() % 2));
+      REQUIRE(patch_given_no_text.combine(other_patch_given_no_text));
+      REQUIRE(patch.get_changes() == patch_given_no_text.get_changes());
+      REQUIRE(patch.invert().get_changes() == patch_given_no_text.invert().get_changes());
+      REQUIRE(patch.copy().get_changes() == patch_given_no_text.get_changes());
+    }
+  }
+
+  SECTION("memory usage") {
+    Patch patch, patch_without_text{true, false};
+    for (uint32_t row = 0; row < 100; row++) {
+      patch.splice(Point{row, 0}, Point{0, 1}, Point{0, 2}, Text{u"a"}, Text{u"bc"});
+      patch_without_text.splice(Point{row, 0}, Point{0, 1}, Point{0, 2}, Text{u"a"}, Text{u"bc"});
+    }
+    REQUIRE(patch_without_text.get_change_count() == patch.get_change_count());
+    REQUIRE(patch_without_text.get_memory_usage().node_bytes * 2 < patch.get_memory_usage().node_bytes);
+    REQUIRE(patch_without_text.get_memory_usage().node_bytes < 100 * 128);
+
+    auto changes = patch_without_text.get_changes();
+    REQUIRE(changes[0] == (Change{
+      Point{0, 0}, Point{0, 1},
+      Point{0, 0}, Point{0, 2},
+      nullptr, nullptr,
+      0, 0, 1
+    }));
+  }
+
+  SECTION("serialization") {
+    Patch patch{true, false};
+    patch.splice(Point{0, 5}, Point{0, 1}, Point{0, 2}, Text{u"a"}, Text{u"bc"});
+    patch.splice(Point{1, 0}, Point{0, 3}, Point{}, Text{u"def"}, Text{u""});
+
+    vector<uint8_t> bytes;
+    Serializer serializer(bytes);
+    patch.serialize(serializer);
+    Deserializer deserializer(bytes);
+    Patch patch_copy(deserializer);
+    REQUIRE(patch_copy.get_changes() == patch.get_changes());
+    REQUIRE(patch_copy.get_memory_usage().node_bytes == patch.get_memory_usage().node_bytes);
+
+    // The copy still discards text that is spliced into it.
+    patch_copy.splice(Point{2, 0}, Point{0, 1}, Point{0, 1}, Text{u"g"}, Text{u"h"});
+    REQUIRE(patch_copy.get_change_count() == 3);
+    REQUIRE(patch_copy.get_memory_usage().text_bytes == 0);
+    REQUIRE(patch_copy.get_changes()[2].new_text == nullptr);
+  }
+}
@@ -0,0 +1,193 @@
+#include "test-helpers.h"
+#include "encoding-conversion.h"
+#include "regex.h"
+#include "sparse-text-buffer.h"
+#include "text-buffer.h"
+
+using std::u16string;
+using std::vector;
+
+static FILE *write_temp_file(const u16string &content, const char *encoding) {
+  FILE *file = tmpfile();
+  vector<char> buffer(64);
+  transcoding_to(encoding)->encode(content, 0, content.size(), file, buffer);
+  rewind(file);
+  return file;
+}
+
+TEST_CASE("SparseTextBuffer - basic queries") {
+  u16string content = u"abc\r\ndγf\n\nghijklmnopqrstuvwxyz\r\nlast";
+  SparseTextBuffer buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 16};
+
+  REQUIRE(buffer.line_for_row(0) == u16string(u"abc"));
+  REQUIRE(!buffer.is_fully_indexed());
+  REQUIRE(buffer.line_for_row(1) == u16string(u"dγf"));
+  REQUIRE(buffer.line_for_row(2) == u16string(u""));
+  REQUIRE(buffer.line_for_row(3) == u16string(u"ghijklmnopqrstuvwxyz"));
+  REQUIRE(buffer.line_for_row(4) == u16string(u"last"));
+  REQUIRE(buffer.line_for_row(5) == optional<u16string>{});
+  REQUIRE(*buffer.line_length_for_row(3) == 20);
+
+  REQUIRE(buffer.extent() == Point(4, 4));
+  REQUIRE(buffer.size() == content.size());
+  REQUIRE(buffer.is_fully_indexed());
+
+  REQUIRE(buffer.clip_position({0, 10}).position == Point(0, 3));
+  REQUIRE(buffer.clip_position({3, 18}).offset == 28);
+  REQUIRE(buffer.clip_position({9, 1}).position == Point(4, 4));
+  REQUIRE(buffer.text_in_range({{1, 1}, {3, 17}}) == u"γf\n\nghijklmnopqrstuvw");
+
+  u16string error_message;
+  Regex regex(u"[a-z]\\r?\\n", &error_message);
+  REQUIRE(buffer.find(regex) == Range({Point{0, 2}, Point{1, 0}}));
+  REQUIRE(buffer.find_all(regex) == vector<Range>({
+    Range{Point{0, 2}, Point{1, 0}},
+    Range{Point{1, 2}, Point{2, 0}},
+    Range{Point{3, 19}, Point{4, 0}},
+  }));
+}
+
+TEST_CASE("SparseTextBuffer - empty file") {
+  SparseTextBuffer buffer{write_temp_file(u"", "UTF-8"), std::move(*transcoding_from("UTF-8"))};
+  REQUIRE(buffer.extent() == Point());
+  REQUIRE(buffer.size() == 0);
+  REQUIRE(buffer.line_for_row(0) == u16string(u""));
+  REQUIRE(buffer.line_for_row(1) == optional<u16string>{});
+  REQUIRE(buffer.text_in_range({{0, 0}, {1, 0}}) == u"");
+}
+
+TEST_CASE("SparseTextBuffer - bounded chunk cache") {
+  u16string content;
+  for (uint32_t i = 0; i < 1000; i++) content += u"the quick brown fox\r\n";
+  SparseTextBuffer buffer{write_temp_file(content, "UTF-16LE"), std::move(*transcoding_from("UTF-16LE")), 256, 4};
+
+  REQUIRE(buffer.line_for_row(2) == u16string(u"the quick brown fox"));
+  REQUIRE(buffer.get_memory_usage().indexed_chunk_count == 1);
+
+  REQUIRE(buffer.line_for_row(999) == u16string(u"the quick brown fox"));
+  REQUIRE(buffer.line_for_row(1000) == u16string(u""));
+  REQUIRE(buffer.get_memory_usage().cached_chunk_count == 4);
+
+  u16string error_message;
+  Regex regex(u"fox\\r\\nthe", &error_message);
+  REQUIRE(buffer.find_all(regex).size() == 999);
+  REQUIRE(buffer.get_memory_usage().cached_chunk_count == 4);
+}
+
+TEST_CASE("SparseTextBuffer - random queries") {
+  u16string error_message;
+  Regex regex(u"[a-f]+\\r?\\n|γ", &error_message);
+
+  for (uint32_t i = 0; i < 100; i++) {
+    uint32_t seed = time(0) + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    u16string content = get_random_string(rand, rand() % 500);
+    for (uint32_t j = 0; j < 10; j++) {
+      content.insert(rand() % (content.size() + 1), u"γ");
+    }
+
+    TextBuffer expected{content};
+    const char *encoding = rand() % 2 ? "UTF-8" : "UTF-16LE";
+    SparseTextBuffer buffer{
+      write_temp_file(content, encoding),
+      std::move(*transcoding_from(encoding)),
+      16 + rand() % 64,
+      1 + rand() % 4
+    };
+
+    for (uint32_t j = 0; j < 10; j++) {
+      uint32_t row = rand() % (expected.extent().row + 2);
+      REQUIRE(buffer.line_for_row(row) == expected.line_for_row(row));
+
+      Range range = get_random_range(rand, expected);
+      REQUIRE(buffer.text_in_range(range) == expected.text_in_range(range));
+      REQUIRE(buffer.clip_position(range.end).position == expected.clip_position(range.end).position);
+      REQUIRE(buffer.clip_position(range.end).offset == expected.clip_position(range.end).offset);
+      REQUIRE(buffer.find_all(regex, range) == expected.find_all(regex, range));
+    }
+
+    REQUIRE(buffer.extent() == expected.extent());
+    REQUIRE(buffer.size() == expected.size());
+    REQUIRE(buffer.find_all(regex) == expected.find_all(regex));
+  }
+}
+
+TEST_CASE("SparseTextBuffer::serialize_index and ::deserialize_index") {
+  u16string content;
+  for (uint32_t i = 0; i < 100; i++) content += u"abc γ\r\ndef\n";
+  FILE *file = write_temp_file(content, "UTF-8");
+  SparseTextBuffer buffer{file, std::move(*transcoding_from("UTF-8")), 64};
+  REQUIRE(buffer.extent() == Point(200, 0));
+
+  vector<uint8_t> index;
+  Serializer serializer(index);
+  buffer.serialize_index(serializer);
+
+  SECTION("restoring the index of an unchanged file") {
+    FILE *file = write_temp_file(content, "UTF-8");
+    SparseTextBuffer restored_buffer{file, std::move(*transcoding_from("UTF-8")), 64};
+    Deserializer deserializer(index);
+    REQUIRE(restored_buffer.deserialize_index(deserializer));
+    REQUIRE(restored_buffer.is_fully_indexed());
+    REQUIRE(restored_buffer.get_memory_usage().cached_chunk_count == 0);
+    REQUIRE(restored_buffer.extent() == Point(200, 0));
+    REQUIRE(restored_buffer.line_for_row(151) == u16string(u"def"));
+    REQUIRE(restored_buffer.text_in_range({{98, 2}, {99, 2}}) == u"c γ\r\nde");
+  }
+
+  SECTION("restoring a partial index") {
+    SparseTextBuffer partial_buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 64};
+    partial_buffer.line_for_row(20);
+    vector<uint8_t> partial_index;
+    Serializer serializer(partial_index);
+    partial_buffer.serialize_index(serializer);
+
+    SparseTextBuffer restored_buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 64};
+    Deserializer deserializer(partial_index);
+    REQUIRE(restored_buffer.deserialize_index(deserializer));
+    REQUIRE(!restored_buffer.is_fully_indexed());
+    REQUIRE(restored_buffer.line_for_row(199) == u16string(u"def"));
+    REQUIRE(restored_buffer.extent() == Point(200, 0));
+  }
+
+  SECTION("rejecting the index of a changed file") {
+    content[0] = 'x';
+    SparseTextBuffer changed_buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 64};
+    Deserializer deserializer(index);
+    REQUIRE(!changed_buffer.deserialize_index(deserializer));
+    REQUIRE(!changed_buffer.is_fully_indexed());
+    REQUIRE(changed_buffer.line_for_row(0) == u16string(u"xbc γ"));
+  }
+
+  SECTION("rejecting a truncated index") {
+    index.resize(index.size() - 4);
+    SparseTextBuffer restored_buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 64};
+    Deserializer deserializer(index);
+    REQUIRE(!restored_buffer.deserialize_index(deserializer));
+  }
+
+  SECTION("rejecting a chunk count that the data can't hold") {
+    index.resize(index.size() - 40);
+    SparseTextBuffer restored_buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 64};
+    Deserializer deserializer(index);
+    REQUIRE(!restored_buffer.deserialize_index(deserializer));
+    REQUIRE(restored_buffer.line_for_row(199) == u16string(u"def"));
+  }
+
+  SECTION("rejecting a chunk with more characters than bytes") {
+    // The last record's character count is followed by two more fields and the trailer.
+    uint32_t character_count = 1000;
+    memcpy(&index[index.size() - 16], &character_count, sizeof(character_count));
+    SparseTextBuffer restored_buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 64};
+    Deserializer deserializer(index);
+    REQUIRE(!restored_buffer.deserialize_index(deserializer));
+  }
+
+  SECTION("rejecting an index built with a different chunk size") {
+    SparseTextBuffer restored_buffer{write_temp_file(content, "UTF-8"), std::move(*transcoding_from("UTF-8")), 128};
+    Deserializer deserializer(index);
+    REQUIRE(!restored_buffer.deserialize_index(deserializer));
+  }
+}
@@ -28,6 +28,160 @@ TEST_CASE("TextBuffer::set_text_in_range - basic") {
   REQUIRE(buffer.text_in_range(Range {{0, 1}, {10, 1}}) == u"z");
 }
 
+TEST_CASE("TextBuffer::set_text_in_ranges - basic") {
+  TextBuffer buffer{u"abc\ndef\nghi"};
+
+  auto new_ranges = buffer.set_text_in_ranges({
+    {Range{{0, 1}, {0, 2}}, u"BB"},
+    {Range{{1, 0}, {1, 0}}, u"x\ny"},
+    {Range{{1, 3}, {2, 1}}, u""},
+  });
+  REQUIRE(buffer.text() == u"aBBc\nx\nydefhi");
+  REQUIRE(new_ranges);
+  REQUIRE(*new_ranges == vector<Range>({
+    Range{{0, 1}, {0, 3}},
+    Range{{1, 0}, {2, 1}},
+    Range{{2, 4}, {2, 4}},
+  }));
+
+  SECTION("adjacent ranges") {
+    auto new_ranges = buffer.set_text_in_ranges({
+      {Range{{0, 0}, {0, 1}}, u"1"},
+      {Range{{0, 1}, {0, 1}}, u"2"},
+      {Range{{0, 1}, {0, 3}}, u"3"},
+    });
+    REQUIRE(buffer.text() == u"123c\nx\nydefhi");
+    REQUIRE(*new_ranges == vector<Range>({
+      Range{{0, 0}, {0, 1}},
+      Range{{0, 1}, {0, 2}},
+      Range{{0, 2}, {0, 3}},
+    }));
+  }
+
+  SECTION("overlapping ranges") {
+    auto new_ranges = buffer.set_text_in_ranges({
+      {Range{{0, 0}, {0, 2}}, u"1"},
+      {Range{{0, 1}, {0, 3}}, u"2"},
+    });
+    REQUIRE(!new_ranges);
+    REQUIRE(buffer.text() == u"aBBc\nx\nydefhi");
+
+    TextBuffer unmodified_buffer{u"abc"};
+    size_t layer_count = unmodified_buffer.layer_count();
+    REQUIRE(!unmodified_buffer.set_text_in_ranges({
+      {Range{{0, 0}, {0, 2}}, u"1"},
+      {Range{{0, 1}, {0, 3}}, u"2"},
+    }));
+    REQUIRE(unmodified_buffer.layer_count() == layer_count);
+    REQUIRE(!unmodified_buffer.is_modified());
+  }
+}
+
+TEST_CASE("TextBuffer::set_text_in_ranges - random edits") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 20; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    TextBuffer buffer{get_random_string(rand, 100)};
+    TextBuffer expected_buffer{buffer.text()};
+
+    for (uint j = 0; j < 5; j++) {
+      vector<pair<Range, u16string>> edits;
+      Point min_start;
+      for (uint k = 0, count = rand() % 10; k < count; k++) {
+        Range range = get_random_range(rand, buffer);
+        if (range.start < min_start) continue;
+        edits.push_back({range, get_random_string(rand, rand() % 5)});
+        min_start = range.end;
+      }
+
+      for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+        expected_buffer.set_text_in_range(edit->first, u16string(edit->second));
+      }
+
+      auto new_ranges = buffer.set_text_in_ranges(vector<pair<Range, u16string>>(edits));
+      REQUIRE(new_ranges);
+      REQUIRE(buffer.text() == expected_buffer.text());
+      REQUIRE(buffer.extent() == expected_buffer.extent());
+      REQUIRE(buffer.size() == expected_buffer.size());
+      for (size_t k = 0; k < edits.size(); k++) {
+        // Ranges that end between a CR and an LF get clipped when read back.
+        const u16string &text = edits[k].second;
+        if (!text.empty() && (text.back() == '\r' || text.front() == '\n')) continue;
+        REQUIRE(buffer.text_in_range((*new_ranges)[k]) == text);
+      }
+    }
+  }
+}
+
+TEST_CASE("TextBuffer::begin_transaction and ::commit_transaction") {
+  TextBuffer buffer{u"abc\ndef\nghi"};
+  buffer.set_text_in_range({{0, 0}, {0, 1}}, u"A");
+  REQUIRE(buffer.layer_count() == 2);
+
+  SECTION("applies the changes of nested transactions") {
+    buffer.begin_transaction();
+    buffer.set_text_in_range({{1, 1}, {1, 2}}, u"E");
+    buffer.begin_transaction();
+    buffer.set_text_in_range({{2, 2}, {2, 3}}, u"I\n");
+    buffer.commit_transaction();
+    REQUIRE(buffer.text() == u"Abc\ndEf\nghI\n");
+    buffer.commit_transaction();
+    buffer.commit_transaction();
+    REQUIRE(buffer.layer_count() == 2);
+    REQUIRE(buffer.text() == u"Abc\ndEf\nghI\n");
+    REQUIRE(buffer.extent() == Point(3, 0));
+    REQUIRE(buffer.size() == 12);
+    REQUIRE(buffer.is_modified());
+  }
+
+  SECTION("leaves layers that are referenced by snapshots intact") {
+    auto snapshot1 = buffer.create_snapshot();
+    buffer.begin_transaction();
+    buffer.set_text_in_range({{1, 1}, {1, 2}}, u"E");
+    auto snapshot2 = buffer.create_snapshot();
+    buffer.set_text_in_range({{2, 2}, {2, 3}}, u"I");
+    buffer.commit_transaction();
+    REQUIRE(buffer.text() == u"Abc\ndEf\nghI");
+    REQUIRE(snapshot1->text() == u"Abc\ndef\nghi");
+    REQUIRE(snapshot2->text() == u"Abc\ndEf\nghi");
+    delete snapshot2;
+    delete snapshot1;
+    REQUIRE(buffer.text() == u"Abc\ndEf\nghI");
+  }
+}
+
+TEST_CASE("TextBuffer::commit_transaction - random edits") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 20; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    TextBuffer buffer{get_random_string(rand, 100)};
+    TextBuffer expected_buffer{buffer.text()};
+
+    for (uint j = 0; j < 5; j++) {
+      buffer.begin_transaction();
+      for (uint k = 0, count = rand() % 20; k < count; k++) {
+        Range range = get_random_range(rand, buffer);
+        u16string text = get_random_string(rand, rand() % 5);
+        buffer.set_text_in_range(range, u16string(text));
+        expected_buffer.set_text_in_range(range, move(text));
+      }
+      buffer.commit_transaction();
+
+      REQUIRE(buffer.layer_count() <= 2);
+      REQUIRE(buffer.text() == expected_buffer.text());
+      REQUIRE(buffer.extent() == expected_buffer.extent());
+      REQUIRE(buffer.size() == expected_buffer.size());
+      REQUIRE(buffer.is_modified() == expected_buffer.is_modified());
+    }
+  }
+}
+
 TEST_CASE("TextBuffer::line_length_for_row - basic") {
   TextBuffer buffer{u"a\n\nb\r\rc\r\n\r\n"};
   REQUIRE(*buffer.line_length_for_row(0) == 1);
@@ -197,6 +351,40 @@ TEST_CASE("TextBuffer::is_modified") {
   }
 }
 
+TEST_CASE("TextBuffer::is_modified - separate changes that cancel out") {
+  TextBuffer buffer{u"aab"};
+  buffer.set_text_in_range({{0, 0}, {0, 1}}, u"");
+  REQUIRE(buffer.is_modified());
+  buffer.set_text_in_range({{0, 1}, {0, 1}}, u"a");
+  REQUIRE(buffer.text() == u"aab");
+  REQUIRE(!buffer.is_modified());
+}
+
+TEST_CASE("TextBuffer::is_modified - random edits") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 20; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    u16string base_text = get_random_string(rand, 20);
+    TextBuffer buffer{u16string(base_text)};
+    vector<TextBuffer::Snapshot *> snapshots;
+
+    for (uint j = 0; j < 20; j++) {
+      Range range = get_random_range(rand, buffer);
+      u16string text = rand() % 2 ? get_random_string(rand, rand() % 3) : base_text.substr(0, rand() % 3);
+      buffer.set_text_in_range(range, move(text));
+      if (rand() % 5 == 0) snapshots.push_back(buffer.create_snapshot());
+      REQUIRE(buffer.is_modified() == (buffer.text() != base_text));
+      REQUIRE(buffer.is_modified() == (buffer.text() != base_text));
+    }
+
+    for (auto snapshot : snapshots) delete snapshot;
+    REQUIRE(buffer.is_modified() == (buffer.text() != base_text));
+  }
+}
+
 TEST_CASE("TextBuffer::flush_changes") {
   TextBuffer buffer{u"abcdef"};
   REQUIRE(buffer.layer_count() == 1);
@@ -299,6 +487,132 @@ TEST_CASE("Snapshot::flush_preceding_changes") {
   }
 }
 
+TEST_CASE("TextBuffer::serialize_journal_entry") {
+  TextBuffer buffer{u"abc\ndef\nghi"};
+  vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+
+  REQUIRE(!buffer.serialize_journal_entry(serializer));
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"B");
+  buffer.serialize_changes(serializer);
+  size_t checkpoint_size = bytes.size();
+  REQUIRE(!buffer.serialize_journal_entry(serializer));
+
+  buffer.set_text_in_range({{1, 0}, {1, 0}}, u"xyz");
+  buffer.set_text_in_range({{1, 3}, {1, 4}}, u"");
+  REQUIRE(buffer.serialize_journal_entry(serializer));
+  size_t first_entry_end = bytes.size();
+  buffer.set_text_in_range({{2, 1}, {2, 3}}, u"\r\njk");
+  REQUIRE(buffer.serialize_journal_entry(serializer));
+  REQUIRE(buffer.text() == u"aBc\nxyzef\ng\r\njk");
+
+  SECTION("replaying the checkpoint and the journal") {
+    TextBuffer copy_buffer{u"abc\ndef\nghi"};
+    Deserializer deserializer(bytes);
+    REQUIRE(copy_buffer.deserialize_changes(deserializer));
+    REQUIRE(copy_buffer.text() == buffer.text());
+    REQUIRE(copy_buffer.is_modified());
+  }
+
+  SECTION("ignoring a torn entry at the end of the journal") {
+    bytes.resize(bytes.size() - 1);
+    TextBuffer copy_buffer{u"abc\ndef\nghi"};
+    Deserializer deserializer(bytes);
+    REQUIRE(copy_buffer.deserialize_changes(deserializer));
+    REQUIRE(copy_buffer.text() == u"aBc\nxyzef\nghi");
+  }
+
+  SECTION("ignoring an entry that is cut off inside its header") {
+    bytes.resize(first_entry_end + 6);
+    TextBuffer copy_buffer{u"abc\ndef\nghi"};
+    Deserializer deserializer(bytes);
+    REQUIRE(copy_buffer.deserialize_changes(deserializer));
+    REQUIRE(copy_buffer.text() == u"aBc\nxyzef\nghi");
+  }
+
+  SECTION("ignoring a corrupt entry") {
+    bytes[first_entry_end - 1] ^= 1;
+    TextBuffer copy_buffer{u"abc\ndef\nghi"};
+    Deserializer deserializer(bytes);
+    REQUIRE(copy_buffer.deserialize_changes(deserializer));
+    REQUIRE(copy_buffer.text() == u"aBc\ndef\nghi");
+  }
+
+  SECTION("ignoring an entry written against different text") {
+    TextBuffer copy_buffer{u"abc\ndef\ngh"};
+    Deserializer deserializer(bytes);
+    REQUIRE(copy_buffer.deserialize_changes(deserializer));
+    REQUIRE(copy_buffer.text() == u"aBc\nxyzef\ngh");
+  }
+
+  SECTION("ending the journal when the changes are saved") {
+    buffer.flush_changes();
+    REQUIRE(buffer.should_compact_journal());
+    buffer.set_text_in_range({{0, 0}, {0, 0}}, u"x");
+    REQUIRE(!buffer.serialize_journal_entry(serializer));
+
+    bytes.clear();
+    buffer.serialize_changes(serializer);
+    REQUIRE(!buffer.should_compact_journal());
+    buffer.set_text_in_range({{0, 0}, {0, 0}}, u"y");
+    REQUIRE(buffer.serialize_journal_entry(serializer));
+
+    TextBuffer copy_buffer{buffer.base_text().content};
+    Deserializer deserializer(bytes);
+    REQUIRE(copy_buffer.deserialize_changes(deserializer));
+    REQUIRE(copy_buffer.text() == buffer.text());
+  }
+
+  SECTION("compacting the journal") {
+    for (uint32_t i = 0; i < 10; i++) {
+      buffer.set_text_in_range({{0, 0}, {0, 0}}, u"a fairly long line of inserted text\n");
+      buffer.serialize_journal_entry(serializer);
+    }
+    REQUIRE(buffer.should_compact_journal());
+
+    bytes.clear();
+    buffer.serialize_changes(serializer);
+    REQUIRE(!buffer.should_compact_journal());
+    REQUIRE(bytes.size() > checkpoint_size);
+
+    TextBuffer copy_buffer{u"abc\ndef\nghi"};
+    Deserializer deserializer(bytes);
+    REQUIRE(copy_buffer.deserialize_changes(deserializer));
+    REQUIRE(copy_buffer.text() == buffer.text());
+  }
+
+  SECTION("random edits") {
+    for (uint32_t i = 0; i < 20; i++) {
+      uint32_t seed = time(0) + i;
+      Generator rand(seed);
+      cout << "seed: " << seed << "\n";
+
+      TextBuffer buffer{get_random_string(rand)};
+      u16string base_text = buffer.base_text().content;
+      vector<uint8_t> bytes;
+      Serializer serializer(bytes);
+      buffer.serialize_changes(serializer);
+
+      for (uint32_t j = 0; j < 10; j++) {
+        for (uint32_t k = 0, n = rand() % 4; k < n; k++) {
+          buffer.set_text_in_range(get_random_range(rand, buffer), get_random_string(rand, rand() % 5));
+        }
+        if (rand() % 5 == 0) {
+          bytes.clear();
+          buffer.serialize_changes(serializer);
+        } else {
+          buffer.serialize_journal_entry(serializer);
+        }
+      }
+
+      TextBuffer copy_buffer{base_text};
+      Deserializer deserializer(bytes);
+      REQUIRE(copy_buffer.deserialize_changes(deserializer));
+      REQUIRE(copy_buffer.text() == buffer.text());
+    }
+  }
+}
+
 TEST_CASE("TextBuffer::reset") {
   TextBuffer buffer{u"abcdef"};
   auto snapshot1 = buffer.create_snapshot();
@@ -329,6 +643,22 @@ TEST_CASE("TextBuffer::reset") {
   REQUIRE(!buffer.is_modified());
   REQUIRE(buffer.layer_count() == 1);
   REQUIRE(buffer.text() == u"456");
+
+  // A shared base text is never modified in place.
+  auto shared_text = std::make_shared<Text>(u"789");
+  buffer.reset(shared_text);
+  buffer.set_text_in_range({{0, 0}, {0, 1}}, u"X");
+  buffer.flush_changes();
+  REQUIRE(buffer.text() == u"X89");
+  REQUIRE(*shared_text == Text{u"789"});
+
+  auto snapshot = buffer.create_snapshot();
+  buffer.reset(shared_text);
+  buffer.set_text_in_range({{0, 0}, {0, 1}}, u"Y");
+  REQUIRE(buffer.text() == u"Y89");
+  REQUIRE(snapshot->text() == u"X89");
+  REQUIRE(*shared_text == Text{u"789"});
+  delete snapshot;
 }
 
 TEST_CASE("TextBuffer::find") {
@@ -468,6 +798,458 @@ TEST_CASE("TextBuffer::find_words_with_subsequence_in_range") {
 TEST_CASE("TextBuffer::has_astral") {
   REQUIRE(TextBuffer{u"ab" "\xd83d" "\xde01" "cd"}.has_astral());
   REQUIRE(!TextBuffer{u"abcd"}.has_astral());
+
+  TextBuffer buffer{u"abcd"};
+  REQUIRE(!buffer.has_astral());
+  buffer.set_text_in_range({{0, 2}, {0, 2}}, u"\xd83d" "\xde01");
+  REQUIRE(buffer.has_astral());
+  buffer.set_text_in_range({{0, 1}, {0, 5}}, u"");
+  REQUIRE(!buffer.has_astral());
+}
+
+static TextBuffer::Statistics get_statistics(const u16string &text) {
+  TextBuffer::Statistics result{};
+  uint32_t line_length = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    uint16_t character = text[i];
+    if (character == '\r' && i + 1 < text.size() && text[i + 1] == '\n') {
+      result.crlf_count++;
+      result.longest_line_length = std::max(result.longest_line_length, line_length);
+      line_length = 0;
+      i++;
+      continue;
+    }
+
+    if (character == '\n') {
+      result.lf_count++;
+      result.longest_line_length = std::max(result.longest_line_length, line_length);
+      line_length = 0;
+      continue;
+    }
+
+    if (character == '\r') result.cr_count++;
+    if (character == 0) result.nul_count++;
+    if ((character & 0xf800) == 0xd800) result.surrogate_count++;
+    line_length++;
+  }
+  result.longest_line_length = std::max(result.longest_line_length, line_length);
+  return result;
+}
+
+static void require_statistics(TextBuffer &buffer) {
+  auto expected = get_statistics(buffer.text());
+  auto actual = buffer.statistics();
+  REQUIRE(actual.lf_count == expected.lf_count);
+  REQUIRE(actual.crlf_count == expected.crlf_count);
+  REQUIRE(actual.cr_count == expected.cr_count);
+  REQUIRE(actual.nul_count == expected.nul_count);
+  REQUIRE(actual.surrogate_count == expected.surrogate_count);
+  REQUIRE(actual.longest_line_length == expected.longest_line_length);
+}
+
+TEST_CASE("TextBuffer::statistics") {
+  TextBuffer buffer{u"ab\r\ncd\ref\n\n"};
+  auto statistics = buffer.statistics();
+  REQUIRE(statistics.lf_count == 2);
+  REQUIRE(statistics.crlf_count == 1);
+  REQUIRE(statistics.cr_count == 1);
+  REQUIRE(statistics.longest_line_length == 5);
+
+  buffer.set_text_in_range({{1, 3}, {1, 3}}, u"\n");
+  statistics = buffer.statistics();
+  REQUIRE(statistics.lf_count == 2);
+  REQUIRE(statistics.crlf_count == 2);
+  REQUIRE(statistics.cr_count == 0);
+  REQUIRE(statistics.longest_line_length == 2);
+
+  buffer.set_text_in_range({{0, 0}, {0, 0}}, u16string(2, 0));
+  statistics = buffer.statistics();
+  REQUIRE(statistics.nul_count == 2);
+  REQUIRE(statistics.longest_line_length == 4);
+}
+
+TEST_CASE("TextBuffer::statistics - random edits") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 20; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    TextBuffer buffer{get_random_string(rand, 50)};
+    require_statistics(buffer);
+
+    for (uint j = 0; j < 20; j++) {
+      Range range = get_random_range(rand, buffer);
+      u16string text = get_random_string(rand, rand() % 10);
+      if (rand() % 5 == 0) text.push_back(0xd83d);
+      buffer.set_text_in_range(range, move(text));
+      require_statistics(buffer);
+    }
+  }
+}
+
+static u16string get_line_ending(TextBuffer &buffer, uint32_t row) {
+  u16string result;
+  for (const uint16_t *character = buffer.line_ending_for_row(row); *character != 0; character++) {
+    result.push_back(*character);
+  }
+  return result;
+}
+
+TEST_CASE("TextBuffer::line_ending_counts and ::has_mixed_line_endings") {
+  TextBuffer buffer{u"a\nb\r\nc\r\nd\re"};
+  REQUIRE(buffer.has_mixed_line_endings());
+  REQUIRE(buffer.line_ending_counts(0, 3).lf_count == 1);
+  REQUIRE(buffer.line_ending_counts(0, 3).crlf_count == 2);
+  REQUIRE(buffer.line_ending_counts(1, 2).lf_count == 0);
+  REQUIRE(buffer.line_ending_counts(1, 2).crlf_count == 1);
+  REQUIRE(buffer.line_ending_counts(3, 10).lf_count == 0);
+  REQUIRE(buffer.line_ending_counts(3, 10).crlf_count == 0);
+
+  buffer.set_text_in_range({{0, 1}, {0, 1}}, u"\r");
+  REQUIRE(!buffer.has_mixed_line_endings());
+  REQUIRE(get_line_ending(buffer, 0) == u16string(u"\r\n"));
+
+  buffer.set_text_in_range({{1, 1}, {1, 1}}, u"\n\n");
+  REQUIRE(buffer.has_mixed_line_endings());
+  REQUIRE(get_line_ending(buffer, 1) == u16string(u"\n"));
+  REQUIRE(get_line_ending(buffer, 2) == u16string(u"\n"));
+  REQUIRE(get_line_ending(buffer, 3) == u16string(u"\r\n"));
+  REQUIRE(get_line_ending(buffer, 5) == u16string(u""));
+  REQUIRE(buffer.line_ending_for_row(6) == nullptr);
+}
+
+TEST_CASE("TextBuffer::normalize_line_endings") {
+  TextBuffer buffer{u"a\nb\r\nc\r\nd\re"};
+  buffer.normalize_line_endings(u"\n");
+  REQUIRE(buffer.text() == u"a\nb\nc\nd\re");
+  REQUIRE(!buffer.has_mixed_line_endings());
+
+  buffer.normalize_line_endings(u"\r\n");
+  REQUIRE(buffer.text() == u"a\r\nb\r\nc\r\nd\re");
+  REQUIRE(buffer.statistics().crlf_count == 3);
+  REQUIRE(buffer.statistics().lf_count == 0);
+  REQUIRE(buffer.is_modified());
+  require_statistics(buffer);
+
+  buffer.set_text_in_range({{1, 0}, {1, 0}}, u"\n\n");
+  buffer.normalize_line_endings(u"\n");
+  REQUIRE(buffer.text() == u"a\n\n\nb\nc\nd\re");
+  REQUIRE(get_line_ending(buffer, 2) == u16string(u"\n"));
+  require_statistics(buffer);
+
+  buffer.normalize_line_endings(u"\r");
+  REQUIRE(buffer.text() == u"a\r\r\rb\rc\rd\re");
+  require_statistics(buffer);
+}
+
+TEST_CASE("TextBuffer::line_ending_for_row - random edits") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 20; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    TextBuffer buffer{get_random_string(rand, 50)};
+
+    for (uint j = 0; j < 20; j++) {
+      Range range = get_random_range(rand, buffer);
+      buffer.set_text_in_range(range, get_random_string(rand, rand() % 20));
+      if (rand() % 10 == 0) buffer.normalize_line_endings(rand() % 2 ? u"\n" : u"\r\n");
+
+      Text text{buffer.text()};
+      uint32_t last_row = text.extent().row;
+      uint32_t start_row = rand() % (last_row + 1);
+      uint32_t end_row = start_row + rand() % (last_row + 2 - start_row);
+      uint32_t expected_lf_count = 0, expected_crlf_count = 0;
+      for (uint32_t row = 0; row <= last_row; row++) {
+        u16string expected_ending;
+        if (row < last_row) {
+          uint32_t line_end = text.offset_for_position(Point(row + 1, 0)) - 1;
+          expected_ending = (line_end > 0 && text.content[line_end - 1] == '\r') ? u"\r\n" : u"\n";
+          if (row >= start_row && row < end_row) {
+            (expected_ending.size() == 2 ? expected_crlf_count : expected_lf_count)++;
+          }
+        }
+        REQUIRE(get_line_ending(buffer, row) == expected_ending);
+      }
+
+      auto counts = buffer.line_ending_counts(start_row, end_row);
+      REQUIRE(counts.lf_count == expected_lf_count);
+      REQUIRE(counts.crlf_count == expected_crlf_count);
+    }
+  }
+}
+
+TEST_CASE("TextBuffer::get_memory_usage") {
+  TextBuffer buffer{u"abc\ndef\nghi"};
+  auto memory_usage = buffer.get_memory_usage();
+  REQUIRE(memory_usage.layer_count == 1);
+  REQUIRE(memory_usage.snapshot_layer_count == 0);
+  REQUIRE(memory_usage.base_text_bytes >= 11 * sizeof(char16_t));
+  REQUIRE(memory_usage.patch_text_bytes == 0);
+  REQUIRE(memory_usage.index_bytes == 0);
+
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"xyz");
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text_in_range({{1, 1}, {1, 2}}, u"xyz");
+  buffer.statistics();
+  memory_usage = buffer.get_memory_usage();
+  REQUIRE(memory_usage.layer_count == 3);
+  REQUIRE(memory_usage.snapshot_layer_count == 2);
+  REQUIRE(memory_usage.patch_text_bytes >= 6 * sizeof(char16_t));
+  REQUIRE(memory_usage.index_bytes > 0);
+
+  snapshot->flush_preceding_changes();
+  memory_usage = buffer.get_memory_usage();
+  REQUIRE(memory_usage.base_text_bytes >= 13 * sizeof(char16_t));
+
+  delete snapshot;
+  memory_usage = buffer.get_memory_usage();
+  REQUIRE(memory_usage.layer_count == 2);
+  REQUIRE(memory_usage.snapshot_layer_count == 0);
+}
+
+TEST_CASE("TextBuffer::trim_memory") {
+  TextBuffer buffer{u"abc\r\ndef\nghi"};
+  buffer.set_text_in_range({{2, 0}, {2, 0}}, u16string(1000, 'x'));
+  buffer.flush_changes();
+  buffer.set_text_in_range({{2, 0}, {2, 1000}}, u"");
+  buffer.flush_changes();
+  buffer.set_text_in_range({{0, 1}, {0, 2}}, u"xyz");
+  auto statistics = buffer.statistics();
+
+  auto memory_usage = buffer.get_memory_usage();
+  buffer.trim_memory();
+  auto trimmed_memory_usage = buffer.get_memory_usage();
+  REQUIRE(trimmed_memory_usage.base_text_bytes < memory_usage.base_text_bytes);
+  REQUIRE(trimmed_memory_usage.index_bytes == memory_usage.index_bytes);
+  REQUIRE(buffer.text() == u"axyzc\r\ndef\nghi");
+  REQUIRE(buffer.is_modified());
+
+  buffer.trim_memory(TextBuffer::TrimCaches);
+  REQUIRE(buffer.get_memory_usage().index_bytes == 0);
+  REQUIRE(buffer.text() == u"axyzc\r\ndef\nghi");
+  REQUIRE(buffer.statistics().crlf_count == statistics.crlf_count);
+  REQUIRE(buffer.statistics().longest_line_length == statistics.longest_line_length);
+  REQUIRE(buffer.has_mixed_line_endings());
+
+  buffer.set_text_in_range({{1, 0}, {1, 0}}, u"123");
+  REQUIRE(buffer.text() == u"axyzc\r\n123def\nghi");
+
+  SECTION("layers that snapshots can read are left untouched") {
+    buffer.set_text_in_range({{2, 0}, {2, 0}}, u16string(1000, 'x'));
+    buffer.set_text_in_range({{2, 1}, {2, 1000}}, u"");
+    auto snapshot = buffer.create_snapshot();
+    memory_usage = buffer.get_memory_usage();
+    buffer.trim_memory();
+    REQUIRE(buffer.get_memory_usage().patch_node_bytes == memory_usage.patch_node_bytes);
+    REQUIRE(snapshot->text() == u"axyzc\r\n123def\nxghi");
+
+    delete snapshot;
+    buffer.trim_memory();
+    REQUIRE(buffer.get_memory_usage().patch_node_bytes < memory_usage.patch_node_bytes);
+    REQUIRE(buffer.text() == u"axyzc\r\n123def\nxghi");
+  }
+}
+
+TEST_CASE("TextBuffer::intern_base_text") {
+  TextBuffer buffer1{u"abc\ndef"};
+  TextBuffer buffer2{u"abc\ndef"};
+  TextBuffer buffer3{u"abc\ndefg"};
+  REQUIRE(!buffer1.intern_base_text());
+  REQUIRE(buffer2.intern_base_text());
+  REQUIRE(!buffer3.intern_base_text());
+  REQUIRE(&buffer1.base_text() == &buffer2.base_text());
+  REQUIRE(&buffer1.base_text() != &buffer3.base_text());
+
+  SECTION("edits and flushes do not affect other buffers") {
+    buffer1.set_text_in_range({{0, 1}, {0, 2}}, u"xyz");
+    REQUIRE(buffer1.text() == u"axyzc\ndef");
+    REQUIRE(buffer1.is_modified());
+    REQUIRE(buffer2.text() == u"abc\ndef");
+
+    buffer1.flush_changes();
+    REQUIRE(buffer1.base_text() == Text{u"axyzc\ndef"});
+    REQUIRE(buffer2.base_text() == Text{u"abc\ndef"});
+    REQUIRE(!buffer2.is_modified());
+
+    buffer2.trim_memory();
+    REQUIRE(buffer2.text() == u"abc\ndef");
+  }
+
+  SECTION("interned texts outlive the buffer that interned them") {
+    TextBuffer *buffer4 = new TextBuffer{u"abc\ndefg"};
+    REQUIRE(buffer4->intern_base_text());
+    buffer3.reset(Text{u"xyz"});
+    REQUIRE(!buffer4->intern_base_text());
+
+    TextBuffer buffer5{u"abc\ndefg"};
+    REQUIRE(buffer5.intern_base_text());
+    delete buffer4;
+    REQUIRE(buffer5.text() == u"abc\ndefg");
+  }
+}
+
+TEST_CASE("TextBuffer::spill_base_text") {
+  TextBuffer buffer{u"abc\ndef\r\nghi"};
+  buffer.set_text_in_range({{1, 1}, {1, 2}}, u"xyz");
+
+  FILE *file = tmpfile();
+  const u16string &content = buffer.base_text().content;
+  fwrite(content.data(), sizeof(char16_t), content.size(), file);
+  uint32_t size = content.size();
+  uint32_t reload_count = 0;
+  auto reload = [file, size, &reload_count]() {
+    u16string content(size, 0);
+    rewind(file);
+    REQUIRE(fread(&content[0], sizeof(char16_t), size, file) == size);
+    reload_count++;
+    return optional<Text>{Text{move(content)}};
+  };
+
+  auto base_text_bytes = buffer.get_memory_usage().base_text_bytes;
+  REQUIRE(buffer.spill_base_text(reload));
+  REQUIRE(buffer.is_base_text_spilled());
+  REQUIRE(!buffer.spill_base_text(reload));
+  REQUIRE(buffer.get_memory_usage().base_text_bytes < base_text_bytes / 2);
+  REQUIRE(buffer.size() == 14);
+  REQUIRE(buffer.extent() == Point(2, 3));
+  REQUIRE(buffer.character_at({1, 1}) == 'x');
+  REQUIRE(reload_count == 0);
+
+  SECTION("reading the base text reloads it once") {
+    REQUIRE(buffer.text() == u"abc\ndxyzf\r\nghi");
+    REQUIRE(*buffer.line_length_for_row(1) == 5);
+    REQUIRE(buffer.is_modified());
+    REQUIRE(reload_count == 1);
+    REQUIRE(!buffer.is_base_text_spilled());
+  }
+
+  SECTION("creating a snapshot reloads the base text") {
+    auto snapshot = buffer.create_snapshot();
+    REQUIRE(reload_count == 1);
+    REQUIRE(!buffer.spill_base_text(reload));
+    REQUIRE(snapshot->base_text() == Text{u"abc\ndef\r\nghi"});
+    delete snapshot;
+
+    REQUIRE(buffer.spill_base_text(reload));
+    REQUIRE(buffer.text() == u"abc\ndxyzf\r\nghi");
+    REQUIRE(reload_count == 2);
+  }
+
+  SECTION("flushing changes replaces the spilled text") {
+    buffer.flush_changes();
+    REQUIRE(!buffer.is_base_text_spilled());
+    REQUIRE(buffer.base_text() == Text{u"abc\ndxyzf\r\nghi"});
+    REQUIRE(!buffer.is_modified());
+  }
+
+  SECTION("resetting the buffer discards the spilled text") {
+    buffer.reset(Text{u"123"});
+    REQUIRE(!buffer.is_base_text_spilled());
+    REQUIRE(buffer.text() == u"123");
+    REQUIRE(reload_count == 0);
+  }
+
+  SECTION("text that can't be reloaded stays spilled") {
+    TextBuffer buffer{u"abc\ndef\r\nghi"};
+    buffer.set_text_in_range({{1, 1}, {1, 2}}, u"xyz");
+    optional<Text> reloaded_text;
+    REQUIRE(buffer.spill_base_text([&reloaded_text]() { return reloaded_text; }));
+    REQUIRE(!buffer.reload_base_text());
+    REQUIRE(buffer.is_base_text_spilled());
+
+    // Text of the same size and shape but with different characters is
+    // rejected too.
+    reloaded_text = Text{u"abc\ndeg\r\nghi"};
+    REQUIRE(!buffer.reload_base_text());
+    REQUIRE(!buffer.intern_base_text());
+
+    // Reads still see characters on the same rows, but the changes can't be
+    // flushed into a new base text.
+    REQUIRE(buffer.text() == u"\ufffd\ufffd\ufffd\n\ufffdxyz\ufffd\ufffd\n\ufffd\ufffd\ufffd");
+    REQUIRE(buffer.extent() == Point(2, 3));
+    REQUIRE(buffer.is_base_text_spilled());
+    buffer.flush_changes();
+    REQUIRE(buffer.is_base_text_spilled());
+    REQUIRE(buffer.is_modified());
+
+    reloaded_text = Text{u"abc\ndef\r\nghi"};
+    REQUIRE(buffer.reload_base_text());
+    REQUIRE(!buffer.is_base_text_spilled());
+    REQUIRE(buffer.text() == u"abc\ndxyzf\r\nghi");
+  }
+
+  fclose(file);
+}
+
+TEST_CASE("TextBuffer::begin_loading and ::append_loaded_text") {
+  TextBuffer buffer{u"old"};
+  REQUIRE(buffer.begin_loading(Text{u"abc\r"}));
+  REQUIRE(buffer.is_loading());
+  REQUIRE(buffer.text() == u"abc\r");
+  REQUIRE(buffer.extent() == Point(0, 4));
+  REQUIRE(buffer.statistics().cr_count == 1);
+
+  buffer.set_text_in_range({{0, 0}, {0, 1}}, u"x");
+  REQUIRE(!buffer.set_text_in_ranges({{Range{{0, 0}, {0, 1}}, u"x"}}));
+  REQUIRE(buffer.text() == u"abc\r");
+
+  buffer.append_loaded_text(Text{u"\ndef\n"});
+  REQUIRE(buffer.text() == u"abc\r\ndef\n");
+  REQUIRE(buffer.extent() == Point(2, 0));
+  REQUIRE(buffer.size() == 9);
+  REQUIRE(buffer.statistics().crlf_count == 1);
+  REQUIRE(buffer.statistics().cr_count == 0);
+  REQUIRE(buffer.statistics().lf_count == 1);
+
+  SECTION("appending while a snapshot refers to the base text") {
+    auto snapshot = buffer.create_snapshot();
+    buffer.append_loaded_text(Text{u"ghi"});
+    REQUIRE(snapshot->text() == u"abc\r\ndef\n");
+    REQUIRE(buffer.text() == u"abc\r\ndef\nghi");
+    REQUIRE(buffer.extent() == Point(2, 3));
+    delete snapshot;
+    REQUIRE(buffer.layer_count() == 1);
+    REQUIRE(buffer.base_text() == Text{u"abc\r\ndef\nghi"});
+  }
+
+  SECTION("finishing allows the buffer to be edited") {
+    buffer.append_loaded_text(Text{u"ghi"});
+    buffer.finish_loading();
+    REQUIRE(!buffer.is_loading());
+    REQUIRE(!buffer.is_modified());
+    buffer.append_loaded_text(Text{u"jkl"});
+    buffer.set_text_in_range({{2, 3}, {2, 3}}, u"!");
+    REQUIRE(buffer.text() == u"abc\r\ndef\nghi!");
+    REQUIRE(buffer.is_modified());
+  }
+
+  SECTION("beginning another load while loading") {
+    REQUIRE(!buffer.begin_loading(Text{u"xyz"}));
+    REQUIRE(buffer.text() == u"abc\r\ndef\n");
+    buffer.cancel_loading();
+    REQUIRE(buffer.text() == u"old");
+  }
+
+  SECTION("cancelling restores the previous contents") {
+    buffer.cancel_loading();
+    REQUIRE(!buffer.is_loading());
+    REQUIRE(buffer.text() == u"old");
+    REQUIRE(!buffer.is_modified());
+
+    buffer.set_text_in_range({{0, 0}, {0, 1}}, u"b");
+    REQUIRE(buffer.begin_loading(Text{u"abc"}));
+    buffer.append_loaded_text(Text{u"def"});
+    buffer.cancel_loading();
+    REQUIRE(buffer.text() == u"bld");
+    REQUIRE(buffer.base_text() == Text{u"old"});
+    REQUIRE(buffer.is_modified());
+
+    buffer.cancel_loading();
+    REQUIRE(buffer.text() == u"bld");
+  }
 }
 
 struct SnapshotData {
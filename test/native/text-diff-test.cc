@@ -104,6 +104,21 @@ TEST_CASE("text_diff - old text is a suffix of new text") {
   }));
 }
 
+TEST_CASE("text_diff - shared texts") {
+  auto old_text = std::make_shared<const Text>(u"abc\nghi\njk\nmno\n");
+  auto new_text = std::make_shared<const Text>(u"abc\ndef\nghi\njkl\nmno\n");
+  REQUIRE(text_diff(old_text, new_text).get_changes() == text_diff(*old_text, *new_text).get_changes());
+
+  // Texts that are too different to diff are shared rather than copied.
+  old_text = std::make_shared<const Text>(std::u16string(5000, 'a'));
+  new_text = std::make_shared<const Text>(std::u16string(5000, 'b'));
+  Patch patch = text_diff(old_text, new_text);
+  REQUIRE(patch.get_change_count() == 1);
+  REQUIRE(patch.get_changes().front().old_text == old_text.get());
+  REQUIRE(patch.get_changes().front().new_text == new_text.get());
+  REQUIRE(patch.get_memory_usage().text_bytes == 0);
+}
+
 TEST_CASE("text_diff - randomized changes") {
   auto t = time(nullptr);
   for (uint i = 0; i < 100; i++) {
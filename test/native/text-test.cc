@@ -108,3 +108,77 @@ TEST_CASE("Text::offset_for_position - empty lines") {
   REQUIRE(text.offset_for_position({1, UINT32_MAX}) == 2);
   REQUIRE(slice.position_for_offset(2) == Point(1, 0));
 }
+
+TEST_CASE("Text::serialize_compact") {
+  std::vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+
+  Text packed_text {u"abc\r\ndéf\n"};
+  packed_text.serialize_compact(serializer);
+  REQUIRE(bytes.size() == 1 + packed_text.size());
+
+  Text wide_text {u"αβγ\nδ"};
+  wide_text.serialize_compact(serializer);
+  REQUIRE(bytes.size() == 1 + packed_text.size() + 1 + 2 * wide_text.size());
+
+  Text empty_text;
+  empty_text.serialize_compact(serializer);
+
+  Deserializer deserializer(bytes);
+  Text packed_copy = Text::deserialize_compact(deserializer);
+  REQUIRE(packed_copy == packed_text);
+  REQUIRE(packed_copy.extent() == Point(2, 0));
+  Text wide_copy = Text::deserialize_compact(deserializer);
+  REQUIRE(wide_copy == wide_text);
+  REQUIRE(wide_copy.extent() == Point(1, 1));
+  REQUIRE(Text::deserialize_compact(deserializer) == empty_text);
+  REQUIRE(deserializer.remaining() == 0);
+}
+
+TEST_CASE("Text::Text(Deserializer &)") {
+  std::vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+  Text text {u"ab\nγ"};
+  text.serialize(serializer);
+
+  Deserializer deserializer(bytes.data(), bytes.size());
+  Text copy(deserializer);
+  REQUIRE(copy == text);
+  REQUIRE(copy.extent() == Point(1, 1));
+  REQUIRE(deserializer.remaining() == 0);
+
+  Deserializer truncated_deserializer(bytes.data(), bytes.size() - 1);
+  REQUIRE(Text(truncated_deserializer) == Text());
+
+  Deserializer short_deserializer(bytes.data(), 2);
+  REQUIRE(short_deserializer.read<uint32_t>() == 0);
+  REQUIRE(short_deserializer.remaining() == 0);
+  REQUIRE(short_deserializer.read<uint32_t>() == 0);
+  REQUIRE(short_deserializer.remaining() == 0);
+}
+
+TEST_CASE("LineOffsets") {
+  LineOffsets offsets{0};
+  REQUIRE(offsets.size() == 1);
+  REQUIRE(offsets.capacity() == 1);
+
+  for (uint32_t i = 1; i < 5; i++) offsets.push_back(i * 10);
+  REQUIRE(std::vector<uint32_t>(offsets.begin(), offsets.end()) == std::vector<uint32_t>({0, 10, 20, 30, 40}));
+
+  offsets.insert(offsets.begin() + 1, offsets.begin() + 3, offsets.end());
+  REQUIRE(std::vector<uint32_t>(offsets.begin(), offsets.end()) == std::vector<uint32_t>({0, 30, 40, 10, 20, 30, 40}));
+
+  LineOffsets moved_offsets{std::move(offsets)};
+  REQUIRE(moved_offsets.size() == 7);
+  REQUIRE(offsets.size() == 0);
+
+  moved_offsets.resize(1);
+  moved_offsets.shrink_to_fit();
+  REQUIRE(moved_offsets.capacity() == 1);
+  REQUIRE(moved_offsets.back() == 0);
+
+  LineOffsets copied_offsets{moved_offsets};
+  moved_offsets.assign({5});
+  REQUIRE(copied_offsets[0] == 0);
+  REQUIRE(moved_offsets[0] == 5);
+}